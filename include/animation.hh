@@ -41,6 +41,8 @@ namespace rw {
 
 		virtual void dump(util::DumpWriter out);
 
+		virtual void dumpJson(util::JsonWriter& out);
+
 		/// sub-classes may override this to implement custom functionality
 		virtual void postReadHook();
 
@@ -73,6 +75,8 @@ namespace rw {
 
 		virtual void dump(util::DumpWriter out);
 
+		virtual void dumpJson(util::JsonWriter& out);
+
 		/// sub-classes may override this to implement custom functionality
 		virtual void postReadHook();
 
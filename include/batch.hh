@@ -0,0 +1,53 @@
+/*
+ * File: batch.hh
+ * Author: DeadlyFugu
+ * License: zlib
+ * Description: Flattens a world and placed clumps into one vertex and index buffer per material
+ */
+
+#pragma once
+#include "vertex.hh"
+#include "transform.hh"
+
+namespace rw {
+	namespace vertex {
+		/// Part of a batch which came from one source
+		struct BatchRange {
+			uint32_t source; // see StaticBatch
+			uint32_t firstVertex;
+			uint32_t vertexCount;
+			uint32_t firstIndex;
+			uint32_t indexCount;
+		};
+
+		/// Triangles of every source drawn with one material
+		struct MaterialBatch {
+			MaterialChunk* material; // first material seen with this content (not owned)
+			VertexBuffer buffer; // a triangle list with one submesh, whose material is this batch's index
+			std::vector<BatchRange> ranges; // in source order
+		};
+
+		/// Sources are numbered with the world's atomic sections first, as WorldBsp numbers them,
+		/// then the atomics of each placed clump in order
+		struct StaticBatch {
+			std::vector<MaterialBatch> batches;
+			uint32_t sectionCount;
+			uint32_t sourceCount;
+		};
+
+		/// A clump and the transform placing it in the world, applied after its frames
+		struct ClumpPlacement {
+			ClumpChunk* clump;
+			geom::Transform transform;
+		};
+
+		/// Merges the faces of a world's sections (world may be null) and of placed clumps into one
+		/// batch per distinct material, matching materials by content hash so equal materials from
+		/// different lists share a batch. Each source's vertices are interleaved as described by
+		/// layout and copied once into each batch using them. Clump positions and normals are
+		/// transformed into the world from the first morph target, and faces of mirrored atomics
+		/// are rewound. Returns false if layout is invalid or the world's section tree is broken.
+		bool buildStaticBatch(WorldChunk* world, const std::vector<ClumpPlacement>& clumps, const Layout& layout,
+							  StaticBatch& out, IndexWidth width = INDEX_AUTO);
+	}
+}
\ No newline at end of file
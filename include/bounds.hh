@@ -0,0 +1,49 @@
+/*
+ * File: bounds.hh
+ * Author: DeadlyFugu
+ * License: zlib
+ * Description: Computes bounding boxes and spheres of geometry and world sections
+ */
+
+#pragma once
+#include "geometry.hh"
+#include "world.hh"
+
+namespace rw {
+	namespace geom {
+		struct AABB {
+			Vector3f min;
+			Vector3f max;
+		};
+
+		/// Same layout as the bounding spheres stored in morph targets and Delta Morph targets
+		struct Sphere {
+			float x;
+			float y;
+			float z;
+			float radius;
+		};
+
+		/// Box around count positions. Returns false, leaving box unchanged, if count is 0.
+		bool computeAABB(const VertexPosition* positions, size_t count, AABB& box);
+
+		/// Tight sphere around count positions: Ritter's sphere, refined by repeatedly shrinking it
+		/// and growing it back over the points, or the sphere around the box centre if smaller.
+		/// Every position is inside the result. Returns false, leaving sphere unchanged, if count is 0.
+		bool computeBoundingSphere(const VertexPosition* positions, size_t count, Sphere& sphere);
+	}
+
+	/// Recomputes the bounding sphere of each morph target from its positions, and the bound of
+	/// each Delta Morph target (around the base positions with that target's deltas fully applied),
+	/// then re-serializes the changed chunks. Targets without positions keep their bounds.
+	void updateBounds(GeometryChunk* geometry);
+
+	/// Recomputes the bounding box of an Atomic Section from its positions and re-serializes it
+	void updateBounds(AtomicSectionChunk* section);
+
+	/// Updates every Atomic Section of a world, then sets the world's box to their union
+	void updateBounds(WorldChunk* world);
+
+	/// Updates the bounds of every Geometry, Atomic Section and World found under root (inclusive)
+	void updateBounds(Chunk* root);
+}
\ No newline at end of file
@@ -0,0 +1,79 @@
+/*
+ * File: bsp.hh
+ * Author: DeadlyFugu
+ * License: zlib
+ * Description: Flattened copy of a world's section tree for fast spatial queries
+ */
+
+#pragma once
+#include "bounds.hh"
+
+namespace rw {
+	namespace geom {
+		/// Points p with dot(normal, p) + distance >= 0 are inside
+		struct Plane {
+			Vector3f normal;
+			float distance;
+		};
+
+		/// Planes facing inwards, e.g. left, right, top, bottom, near and far
+		struct Frustum {
+			Plane planes[6];
+		};
+	}
+
+	/// Node of a WorldBsp, laid out for 16-byte loads of min and max
+	struct BspNode {
+		float min[3]; // box around every section below this node
+		uint32_t skip; // index of the first node after this node's subtree
+		float max[3];
+		uint32_t section; // atomic section index of a leaf, or WorldBsp::NONE
+	};
+
+	/// Split plane of a BspNode: left holds coordinates below value on axis (0 x, 1 y, 2 z)
+	struct BspPlane {
+		uint32_t axis;
+		float value;
+	};
+
+	/// The section tree of a world as an array of nodes in depth-first order, so a node's left
+	/// child follows it and its right child starts at the left child's skip. Each node is bounded
+	/// by the boxes of the sections below it, so queries are box tests, walked without a stack
+	/// (descend by moving to the next node, or go past a subtree by moving to its skip). Atomic
+	/// sections are numbered in the order they appear in the stream.
+	class WorldBsp {
+	public:
+		static const uint32_t NONE = 0xffffffffu;
+
+		std::vector<BspNode> nodes;
+		std::vector<BspPlane> planes; // for each node, only meaningful for plane nodes
+		std::vector<AtomicSectionChunk*> sections;
+
+		/// Rebuilds from a world's sections, using their stored boxes. Returns false (leaving
+		/// this empty) if a Plane Section is missing a child or has an unknown plane type.
+		bool build(WorldChunk* world);
+
+		void clear();
+
+		/// Sets the skip of every node and the box of every plane node, from leaves already
+		/// holding their section's box. For filling nodes in pre-order without a WorldChunk.
+		void finishNodes();
+
+		/// Section containing a point, choosing sides by the split planes as RenderWare does
+		/// (so the point need not be inside its box), or NONE if there are no sections
+		uint32_t locatePoint(const geom::Vector3f& point) const;
+
+		/// Appends the index of each section whose box overlaps a box
+		void queryAABB(const geom::AABB& box, std::vector<uint32_t>& out) const;
+
+		/// Appends the index of each section whose box overlaps a sphere
+		void querySphere(const geom::Sphere& sphere, std::vector<uint32_t>& out) const;
+
+		/// Appends the index of each section whose box is not wholly outside one plane of a
+		/// frustum. Sections below a node whose box is inside every plane are not tested.
+		void queryFrustum(const geom::Frustum& frustum, std::vector<uint32_t>& out) const;
+
+	private:
+		void appendSubtree(uint32_t node, std::vector<uint32_t>& out) const;
+	};
+}
\ No newline at end of file
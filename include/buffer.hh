@@ -8,6 +8,8 @@
 #pragma once
 #include "util.hh"
 #include <string>
+#include <cstring>
+#include <cstdlib>
 
 namespace sk {
 	namespace types {
@@ -53,6 +55,7 @@ namespace sk {
 		u8* base;
 		u8* head;
 		u8* end;
+		unsigned origin_offs;
 		bool stretchy, owned;
 	public:
 
@@ -76,6 +79,16 @@ namespace sk {
 			other.base = nullptr;
 		}
 
+		// move assignment (releases currently owned data)
+		Buffer& operator=(Buffer&& other) {
+			if (this != &other) {
+				if (owned) free(base);
+				memcpy(this, &other, sizeof(Buffer));
+				other.base = nullptr;
+			}
+			return *this;
+		}
+
 		// returns a view (doesn't own data) copy of the buffer
 		Buffer view();
 
@@ -126,6 +139,9 @@ namespace sk {
 		// return size
 		unsigned size();
 
+		// return offset of base within the outermost buffer this was viewed from
+		unsigned origin();
+
 		// return bytes remaining until end
 		unsigned remaining();
 
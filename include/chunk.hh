@@ -81,24 +81,47 @@ enum ChunkType : uint32_t {
 	RW_RS_COLLISIONMODEL   = 0x253F2FA,
 	RW_RS_REFLECTIONMAT    = 0x253F2FC,
 	RW_RS_MESHEXTENSION    = 0x253F2FD,
-	RW_RS_FRAME            = 0x253F2FE
+	RW_RS_FRAME            = 0x253F2FE,
+
+	RW_MESHLET_PLG         = 0xFFFF0001 // rwstream extension, not written by RenderWare
 };
 
 namespace rw {
+	class StructChunk;
+
 	/// abstract section base class
 	class Chunk {
+	private:
+		uint64_t hashValue;
+		bool hashValid;
+	protected:
+		/// computes the value cached by hash()
+		virtual uint64_t computeHash() = 0;
 	public:
 		ChunkType type;
 		uint32_t version;
+		/// offset of the chunk header within the stream it was read from
+		uint32_t offset;
 
-		Chunk(ChunkType type, uint32_t version): type(type), version(version) {};
+		Chunk(ChunkType type, uint32_t version): hashValid(false), type(type), version(version), offset(0) {};
 		virtual ~Chunk() {};
 
+		/// hash of this chunk's type, version and stored bytes, combined bottom-up over its
+		/// children so equal subtrees have equal hashes. cached after the first call (not thread-safe)
+		uint64_t hash();
+		/// discards the cached hash; call on a modified chunk and each of its ancestors
+		void invalidateHash();
+		/// true when hash() would return a cached value without computing it
+		bool isHashCached() const { return hashValid; }
+
 		virtual void read(util::Buffer& in) = 0;
 		virtual void write(util::Buffer& out) = 0;
 
 		virtual void dump(util::DumpWriter out) = 0;
 
+		/// writes the decoded fields of this chunk (not its children) as JSON object members
+		virtual void dumpJson(util::JsonWriter&) {}
+
 		virtual bool isList() = 0;
 		virtual bool isData() = 0;
 	};
@@ -107,7 +130,9 @@ namespace rw {
 	class ListChunk : public Chunk {
 	public:
 		std::vector<Chunk*> children;
-
+	protected:
+		virtual uint64_t computeHash();
+	public:
 		ListChunk(ChunkType type, uint32_t version) : Chunk(type, version) {}
 		virtual ~ListChunk();
 
@@ -125,6 +150,8 @@ namespace rw {
 		Chunk* getChild(int idx);
 		int getChildCount();
 		std::vector<Chunk*> filterChildren(ChunkType type);
+		/// returns the first Struct child, or nullptr if there is none
+		StructChunk* getStruct();
 
 		virtual bool isList() {return true;}
 		virtual bool isData() {return false;}
@@ -134,6 +161,8 @@ namespace rw {
 	class StructChunk : public Chunk {
 	protected:
 		util::Buffer data;
+
+		virtual uint64_t computeHash();
 	public:
 		StructChunk(ChunkType type, uint32_t version) : Chunk(type, version), data(0) {}
 		StructChunk(ChunkType type, uint32_t version, util::Buffer& data) : Chunk(type, version), data(data.copy()) {}
@@ -147,8 +176,19 @@ namespace rw {
 		virtual void read(util::Buffer& in);
 		virtual void write(util::Buffer& out);
 
+		/// like read, but data views the memory of in rather than copying it (in must outlive this chunk)
+		void readView(util::Buffer& in);
+
+		/// replaces data with content (taking ownership of it) and discards the cached hash
+		void setData(util::Buffer&& content);
+
 		virtual void dump(util::DumpWriter out);
 
+		virtual void dumpJson(util::JsonWriter& out);
+
+		/// writes bytes [start, start + size) of data as a JSON blob member
+		void dumpJsonBlob(util::JsonWriter& out, const char* name, uint32_t start, uint32_t size);
+
 		/// sub-classes may override this to implement custom functionality
 		virtual void postReadHook() {}
 		/// sub-classes may override this to implement custom functionality
@@ -167,10 +207,42 @@ namespace rw {
 		StringChunk(ChunkType type, uint32_t version) : StructChunk(type, version) {}
 
 		virtual void dump(util::DumpWriter out);
+
+		virtual void dumpJson(util::JsonWriter& out);
 	};
 
 	const char* getChunkName(ChunkType i);
 
-	/// Reads an entire chunk from a buffer
-	Chunk* readChunk(util::Buffer& buf);
+	/// Creates an empty chunk of the class registered for type. Unregistered types become a
+	/// ListChunk if content appears to start with a child chunk, otherwise a StructChunk.
+	Chunk* createChunk(ChunkType type, uint32_t version, util::Buffer& content);
+
+	/// Deepest nesting readChunk accepts by default (the chunk read being depth 0)
+	const uint32_t DEFAULT_MAX_CHUNK_DEPTH = 1024;
+
+	/// Reads an entire chunk from a buffer. Nested lists are read from an explicit stack rather
+	/// than by recursion, so deeply nested input cannot exhaust the call stack; chunks nested
+	/// deeper than maxDepth are skipped with a warning, leaving their parent without them.
+	Chunk* readChunk(util::Buffer& buf, uint32_t maxDepth = DEFAULT_MAX_CHUNK_DEPTH);
+
+	/// Calls fn for a chunk and each of its descendants in pre-order, with their depth (the root
+	/// being 0), using an explicit stack. The children of a chunk are skipped if fn returns false.
+	void visitChunks(Chunk* root, const std::function<bool(Chunk*, uint32_t)>& fn);
+
+	/// Deep copy of a chunk tree. Struct data is copied (never shared), and every chunk is parsed
+	/// again, so decoded fields reflect the data as last serialized by preWriteHook.
+	Chunk* cloneChunk(Chunk* chunk);
+
+	/// Hash of a struct chunk with the given data, matching Chunk::hash()
+	uint64_t hashStructChunk(ChunkType type, uint32_t version, const void* data, size_t size);
+
+	/// Hash of a list chunk with the given child hashes, matching Chunk::hash()
+	uint64_t hashListChunk(ChunkType type, uint32_t version, const uint64_t* childHashes, size_t count);
+
+	/// Writes a chunk and its descendants as one JSON document
+	void exportJson(Chunk* chunk, util::JsonWriter& out);
+
+	/// Writes one JSON object per line for a chunk and each of its descendants (pre-order),
+	/// each with a "path" of child indices from the root
+	void exportNdjson(Chunk* chunk, util::JsonWriter& out);
 }
\ No newline at end of file
@@ -0,0 +1,32 @@
+/*
+ * File: cull.hh
+ * Author: DeadlyFugu
+ * License: zlib
+ * Description: Culls the atomics of many clump instances against a frustum or sphere in batches
+ */
+
+#pragma once
+#include "bsp.hh"
+#include "transform.hh"
+
+namespace rw {
+	/// Bounding spheres of a clump's atomics in clump space, from the first morph target of each
+	/// atomic's geometry placed by its frame. Atomics which could not be placed have a negative
+	/// radius and are never visible.
+	struct ClumpBounds {
+		std::vector<geom::Sphere> spheres; // for each atomic of the clump, in order
+	};
+
+	/// Returns false if the clump is missing its frame or geometry list
+	bool computeClumpBounds(ClumpChunk* clump, ClumpBounds& bounds);
+
+	/// Appends instance * atomic count + atomic for each atomic of each instance whose sphere is
+	/// not wholly outside one plane of a frustum, in ascending order. Instance transforms place
+	/// the clump in the world. Spheres are transformed and tested four instances at a time.
+	void cullInstances(const ClumpBounds& bounds, const geom::Transform* instances, size_t instanceCount,
+					   const geom::Frustum& frustum, std::vector<uint32_t>& visible);
+
+	/// As above, for atomics whose sphere overlaps a sphere (such as a light's range)
+	void cullInstances(const ClumpBounds& bounds, const geom::Transform* instances, size_t instanceCount,
+					   const geom::Sphere& range, std::vector<uint32_t>& visible);
+}
\ No newline at end of file
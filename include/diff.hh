@@ -0,0 +1,35 @@
+/*
+ * File: diff.hh
+ * Author: DeadlyFugu
+ * License: zlib
+ * Description: Structural comparison of two chunk trees
+ */
+
+#pragma once
+#include "chunk.hh"
+#include <string>
+
+namespace rw {
+	/// A chunk which differs between two trees
+	struct ChunkDiff {
+		enum Kind {
+			ADDED,   // only present in b
+			REMOVED, // only present in a
+			CHANGED, // present in both with different contents
+		};
+
+		Kind kind;
+		/// position in the tree, e.g. "Clump/Geometry List/Geometry[1]"
+		std::string path;
+		Chunk* a;
+		Chunk* b;
+		/// descriptions of the decoded fields which differ (CHANGED only)
+		std::vector<std::string> fields;
+	};
+
+	/// Compares two chunk trees, appending each difference to diffs in tree order.
+	/// Children with equal subtree hashes are paired first, in order, and the rest by type and
+	/// position among unpaired siblings of that type; subtrees with equal hashes are skipped
+	/// without being visited.
+	void diffChunks(Chunk* a, Chunk* b, std::vector<ChunkDiff>& diffs);
+}
\ No newline at end of file
@@ -109,6 +109,8 @@ namespace rw {
 
 		virtual void dump(util::DumpWriter out);
 
+		virtual void dumpJson(util::JsonWriter& out);
+
 		virtual void postReadHook();
 
 		virtual void preWriteHook();
@@ -122,6 +124,8 @@ namespace rw {
 
 		virtual void dump(util::DumpWriter out);
 
+		virtual void dumpJson(util::JsonWriter& out);
+
 		virtual void postReadHook();
 
 		virtual void preWriteHook();
@@ -141,6 +145,8 @@ namespace rw {
 
 		virtual void dump(util::DumpWriter out);
 
+		virtual void dumpJson(util::JsonWriter& out);
+
 		virtual void postReadHook();
 
 		virtual void preWriteHook();
@@ -157,6 +163,8 @@ namespace rw {
 
 		virtual void dump(util::DumpWriter out);
 
+		virtual void dumpJson(util::JsonWriter& out);
+
 		virtual void postReadHook();
 
 		virtual void preWriteHook();
@@ -177,6 +185,8 @@ namespace rw {
 
 		virtual void dump(util::DumpWriter out);
 
+		virtual void dumpJson(util::JsonWriter& out);
+
 		virtual void postReadHook();
 
 		virtual void preWriteHook();
@@ -209,6 +219,8 @@ namespace rw {
 
 		virtual void dump(util::DumpWriter out);
 
+		virtual void dumpJson(util::JsonWriter& out);
+
 		/// sub-classes may override this to implement custom functionality
 		virtual void postReadHook();
 
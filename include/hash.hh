@@ -0,0 +1,24 @@
+/*
+ * File: hash.hh
+ * Author: DeadlyFugu
+ * License: zlib
+ * Description: Fast non-cryptographic hashing used to identify chunk contents
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace rw {
+	namespace util {
+		/// 64-bit xxHash (XXH64) of len bytes at data
+		uint64_t hash64(const void* data, size_t len, uint64_t seed = 0);
+
+		/// Order-dependent combination of two hashes
+		inline uint64_t hashCombine(uint64_t a, uint64_t b) {
+			a ^= b + 0x9e3779b97f4a7c15ULL + (a << 6) + (a >> 2);
+			return a;
+		}
+	}
+}
\ No newline at end of file
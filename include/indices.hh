@@ -0,0 +1,109 @@
+/*
+ * File: indices.hh
+ * Author: DeadlyFugu
+ * License: zlib
+ * Description: Compact vertex index storage, using 16-bit indices whenever they fit
+ */
+
+#pragma once
+#include "util.hh"
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <vector>
+
+namespace rw {
+	namespace geom {
+		/// Narrows 32-bit indices to 16 bits (values must be below 65536)
+		void narrowIndices(const uint32_t* in, uint16_t* out, size_t count);
+
+		/// Widens 16-bit indices to 32 bits
+		void widenIndices(const uint16_t* in, uint32_t* out, size_t count);
+
+		/// Bitwise or of all indices; every index fits in 16 bits if the result does
+		uint32_t combineIndices(const uint32_t* in, size_t count);
+
+		/// Vertex indices stored as 16-bit values while every index is below 65536, and as 32-bit
+		/// values otherwise. Assigning indices picks the narrowest width that holds them; storing
+		/// an index too large for 16 bits widens the array.
+		class IndexArray {
+		public:
+			class const_iterator {
+			public:
+				typedef std::forward_iterator_tag iterator_category;
+				typedef uint32_t value_type;
+				typedef ptrdiff_t difference_type;
+				typedef const uint32_t* pointer;
+				typedef uint32_t reference;
+
+				const_iterator(const IndexArray* array, size_t i) : array(array), i(i) {}
+
+				uint32_t operator*() const { return (*array)[i]; }
+				const_iterator& operator++() { i++; return *this; }
+				const_iterator operator++(int) { const_iterator old = *this; i++; return old; }
+				bool operator==(const const_iterator& other) const { return i == other.i; }
+				bool operator!=(const const_iterator& other) const { return i != other.i; }
+
+			private:
+				const IndexArray* array;
+				size_t i;
+			};
+
+			IndexArray() : isWide(false) {}
+			IndexArray(const std::vector<uint32_t>& indices) : isWide(false) { assign(indices); }
+
+			size_t size() const { return isWide ? wide.size() : narrow.size(); }
+			bool empty() const { return size() == 0; }
+
+			/// Bytes per stored index, 2 or 4
+			uint32_t indexSize() const { return isWide ? 4 : 2; }
+			bool wideIndices() const { return isWide; }
+
+			/// Bytes used by the stored indices
+			size_t bytes() const { return size() * indexSize(); }
+
+			uint32_t operator[](size_t i) const { return isWide ? wide[i] : narrow[i]; }
+
+			const_iterator begin() const { return const_iterator(this, 0); }
+			const_iterator end() const { return const_iterator(this, size()); }
+
+			/// Typed access to the stored indices, nullptr when stored at the other width
+			const uint16_t* data16() const { return isWide ? nullptr : narrow.data(); }
+			const uint32_t* data32() const { return isWide ? wide.data() : nullptr; }
+			uint16_t* data16() { return isWide ? nullptr : narrow.data(); }
+			uint32_t* data32() { return isWide ? wide.data() : nullptr; }
+
+			void set(size_t i, uint32_t index);
+			void push_back(uint32_t index);
+			void clear();
+
+			/// Replaces the contents, stored at the narrowest width that holds every index
+			void assign(const uint32_t* indices, size_t count);
+			void assign(const std::vector<uint32_t>& indices) { assign(indices.data(), indices.size()); }
+
+			/// Copies the indices to out as 32-bit values
+			void copyTo(uint32_t* out) const;
+			void toVector(std::vector<uint32_t>& out) const;
+
+			/// Largest index, or 0 if empty
+			uint32_t maxIndex() const;
+
+			/// Switches to 16-bit storage if every index fits
+			void compact();
+
+			/// Switches to 32-bit storage
+			void widen();
+
+			/// Appends the indices to out with indexSize bytes each (2 or 4). Indices must fit.
+			void write(util::Buffer& out, uint32_t indexSize = 4) const;
+
+			bool operator==(const IndexArray& other) const;
+			bool operator!=(const IndexArray& other) const { return !(*this == other); }
+
+		private:
+			bool isWide;
+			std::vector<uint16_t> narrow;
+			std::vector<uint32_t> wide;
+		};
+	}
+}
\ No newline at end of file
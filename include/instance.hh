@@ -0,0 +1,96 @@
+/*
+ * File: instance.hh
+ * Author: DeadlyFugu
+ * License: zlib
+ * Description: Many lightweight instances of one clump sharing its geometry, materials and textures
+ */
+
+#pragma once
+#include "cull.hh"
+#include <memory>
+
+namespace rw {
+	/// A clump loaded once and shared, read-only, by any number of instances. The model owns the
+	/// clump and everything under it; pointers it hands out keep the whole model alive.
+	class ClumpModel : public std::enable_shared_from_this<ClumpModel> {
+	public:
+		const ClumpChunk* clump;
+		FrameHierarchy hierarchy;
+		std::vector<geom::Transform> restPose; // local transform of each frame, as stored
+		ClumpBounds bounds; // in the rest pose
+		std::vector<uint32_t> morphOffsets; // first morph weight of each atomic, then the total
+
+		/// Takes ownership of clump. Returns nullptr (deleting clump) if it is missing its frame
+		/// or geometry list, or has no frames.
+		static std::shared_ptr<const ClumpModel> create(ClumpChunk* clump);
+
+		ClumpModel(const ClumpModel&) = delete;
+		~ClumpModel();
+
+		/// Geometry of an atomic, or nullptr if the atomic has none
+		std::shared_ptr<const GeometryChunk> geometry(uint32_t atomic) const;
+
+		/// Material of an atomic's geometry, or nullptr if out of range
+		std::shared_ptr<const MaterialChunk> material(uint32_t atomic, uint32_t material) const;
+
+		/// Texture of a material of an atomic's geometry, or nullptr if it is untextured
+		std::shared_ptr<const TextureChunk> texture(uint32_t atomic, uint32_t material) const;
+
+		/// As geometry() and material(), without taking a reference
+		const GeometryChunk* findGeometry(uint32_t atomic) const;
+		const MaterialChunk* findMaterial(uint32_t atomic, uint32_t material) const;
+
+	private:
+		explicit ClumpModel(ClumpChunk* clump);
+	};
+
+	/// One placement of a shared model. Only what differs between instances is held: the pose
+	/// of its frames, morph weights and replaced materials. Pose and weights stay empty (using
+	/// the model's) until first changed, so an unposed instance costs little more than its size.
+	class ClumpInstance {
+	public:
+		/// A material of one atomic drawn with another
+		struct MaterialOverride {
+			uint32_t atomic;
+			uint32_t material;
+			std::shared_ptr<const MaterialChunk> replacement;
+		};
+
+		std::shared_ptr<const ClumpModel> model;
+		geom::Transform root; // places the clump in the world
+		std::vector<geom::Transform> pose; // local transform of each frame, or empty for the rest pose
+		std::vector<float> morphWeights; // by model->morphOffsets, or empty for the first morph target
+		std::vector<MaterialOverride> overrides;
+
+		explicit ClumpInstance(std::shared_ptr<const ClumpModel> model);
+
+		/// Local transform of a frame, in this instance's pose
+		const geom::Transform& local(uint32_t frame) const;
+
+		void setLocal(uint32_t frame, const geom::Transform& transform);
+
+		/// Returns to the model's rest pose, freeing the instance's own
+		void resetPose();
+
+		/// Weight of one of an atomic's morph targets
+		float morphWeight(uint32_t atomic, uint32_t target) const;
+
+		void setMorphWeight(uint32_t atomic, uint32_t target, float weight);
+
+		/// Positions of an atomic's geometry, blending its morph targets with positions by weight.
+		/// Returns false (with out empty) if the atomic has no geometry or positions.
+		bool morphPositions(uint32_t atomic, std::vector<geom::VertexPosition>& out) const;
+
+		/// Material to draw part of an atomic with, its override if set, or nullptr if out of range
+		const MaterialChunk* material(uint32_t atomic, uint32_t material) const;
+
+		/// Replaces a material of an atomic, or removes its override if replacement is nullptr
+		void setMaterial(uint32_t atomic, uint32_t material, std::shared_ptr<const MaterialChunk> replacement);
+	};
+
+	/// World transform of each frame of each instance, frame count transforms per instance in
+	/// order, evaluated together by the model's FrameHierarchy. Every instance must share one
+	/// model; returns false (with out empty) otherwise.
+	bool computeInstanceTransforms(const ClumpInstance* instances, size_t instanceCount,
+								   std::vector<geom::Transform>& out);
+}
\ No newline at end of file
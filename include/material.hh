@@ -59,6 +59,8 @@ namespace rw {
 
 		virtual void dump(util::DumpWriter out);
 
+		virtual void dumpJson(util::JsonWriter& out);
+
 		/// sub-classes may override this to implement custom functionality
 		virtual void postReadHook();
 
@@ -82,6 +84,8 @@ namespace rw {
 
 		virtual void dump(util::DumpWriter out);
 
+		virtual void dumpJson(util::JsonWriter& out);
+
 		/// sub-classes may override this to implement custom functionality
 		virtual void postReadHook();
 
@@ -97,6 +101,8 @@ namespace rw {
 
 		//virtual void dump(util::DumpWriter out);
 
+		virtual void dumpJson(util::JsonWriter& out);
+
 		/// sub-classes may override this to implement custom functionality
 		virtual void postReadHook();
 
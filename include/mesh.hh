@@ -0,0 +1,147 @@
+/*
+ * File: mesh.hh
+ * Author: DeadlyFugu
+ * License: zlib
+ * Description: Uniform access to the vertex and index data of Geometry and Atomic Section chunks
+ */
+
+#pragma once
+#include "geometry.hh"
+#include "world.hh"
+
+namespace rw {
+	/// Returns the BinMesh PLG among a geometry's extensions, or nullptr if it has none
+	BinMeshPLGChunk* findBinMesh(GeometryChunk* geometry);
+
+	/// Rewrites every object of a BinMesh as a triangle strip (strip = true) or triangle list,
+	/// then re-serializes it. Degenerate triangles are dropped.
+	void convertBinMesh(BinMeshPLGChunk* binMesh, bool strip);
+
+	struct BinMeshOptions {
+		bool strip; // build triangle strips rather than lists
+		bool indices16; // fail unless every index fits in 16 bits
+	};
+
+	/// Returns the Extension child of a geometry or section, adding one if it has none (or
+	/// replacing an empty one read as a struct). Pass the geometry's extensions to keep it in step.
+	ListChunk* getExtension(ListChunk* parent, std::vector<Chunk*>* extensions);
+
+	/// Regenerates the BinMesh of a geometry or section from its faces: one object per material
+	/// used, in material order, holding that material's faces in their original order. A BinMesh
+	/// (and Extension chunk) is added when there is none. Returns nullptr if an index is out of
+	/// range, or does not fit in 16 bits when that was requested.
+	BinMeshPLGChunk* rebuildBinMesh(GeometryChunk* geometry, const BinMeshOptions& options);
+	BinMeshPLGChunk* rebuildBinMesh(AtomicSectionChunk* section, const BinMeshOptions& options);
+
+	/// Checks a BinMesh's counts against its objects, that indices are in range and that each
+	/// material covers the same number of triangles as in faces. Warns about every mismatch.
+	bool validateBinMesh(BinMeshPLGChunk* binMesh, const std::vector<geom::Face>& faces, uint32_t vertexCount);
+
+	/// Average cache miss ratios (transformed vertices per triangle) around optimizeVertexCache
+	struct VertexCacheStats {
+		float facesBefore;
+		float facesAfter;
+		float binMeshBefore; // over trilist BinMesh objects, 0 if there are none
+		float binMeshAfter;
+	};
+
+	/// Reorders faces and trilist BinMesh objects for post-transform vertex cache reuse, then
+	/// renumbers vertices in the order they are first fetched, remapping every per-vertex array
+	/// (including each morph target). The chunk is re-serialized afterwards. Vertices are not
+	/// renumbered when the geometry or section has extensions other than BinMesh, which may be
+	/// per-vertex (such as Meshlet PLG or night vertex colours).
+	VertexCacheStats optimizeVertexCache(GeometryChunk* geometry, uint32_t cacheSize = 16);
+	VertexCacheStats optimizeVertexCache(AtomicSectionChunk* section, uint32_t cacheSize = 16);
+
+	/// Merges vertices with the same position, normal, colour and UVs in every layer and morph
+	/// target, rewriting faces and BinMesh indices and re-serializing the chunk. With epsilon > 0,
+	/// float attributes may differ by up to epsilon (colours must still match); each vertex joins
+	/// the first earlier one it matches. Faces and trilist BinMesh triangles left degenerate are
+	/// dropped. Like optimizeVertexCache, geometry or sections with other extensions are left
+	/// alone. Returns the number of vertices removed.
+	uint32_t weldVertices(GeometryChunk* geometry, float epsilon = 0);
+	uint32_t weldVertices(AtomicSectionChunk* section, float epsilon = 0);
+
+	/// Removes vertices which no face or BinMesh index uses, renumbering the rest in order, and
+	/// re-serializes the chunk. Geometry with other extensions is left alone. Returns the number
+	/// of vertices removed.
+	uint32_t compactVertices(GeometryChunk* geometry);
+
+	enum NormalWeighting {
+		NORMALS_AREA, // each face counts in proportion to its area
+		NORMALS_ANGLE // each face counts in proportion to its angle at the vertex
+	};
+
+	struct NormalOptions {
+		NormalWeighting weighting;
+		bool splitByMaterial; // smooth only across faces of one material, splitting shared vertices
+		unsigned threads; // 0 uses the hardware thread count
+	};
+
+	/// Generates vertex normals for each morph target with positions, replacing any it had, then
+	/// sets RW_GEOMETRY_NORMALS and re-serializes. When splitting by material, vertices used by
+	/// several materials are duplicated (in faces and BinMesh too), unless the geometry has other
+	/// extensions or the new vertices would not fit 16-bit faces; normals are then smoothed across
+	/// materials. Returns false, leaving the geometry unchanged, for native geometry or an index
+	/// out of range.
+	bool generateNormals(GeometryChunk* geometry, const NormalOptions& options);
+
+	namespace geom {
+		/// Read-only view of the vertex streams of one Geometry morph target or an Atomic Section.
+		/// Streams the mesh does not have (or which are shorter than vertexCount) are nullptr.
+		struct MeshView {
+			uint32_t vertexCount;
+			const VertexPosition* positions;
+			const VertexNormal* normals;
+			const VertexColor* colors;
+			std::vector<const VertexUVs*> uvLayers;
+			const std::vector<Face>* faces;
+			BinMeshPLGChunk* binMesh;
+
+			MeshView(GeometryChunk* geometry, uint32_t morphTarget = 0);
+			MeshView(AtomicSectionChunk* section);
+		};
+
+		/// Expands a triangle strip into a triangle list with the same winding, skipping degenerate
+		/// triangles. Returns the number of triangles appended to out.
+		size_t stripToList(const uint32_t* strip, size_t count, std::vector<uint32_t>& out);
+
+		/// Greedily covers a triangle list with strips, joined into one strip by degenerate triangles.
+		/// Appends the strip to out; degenerate input triangles are dropped.
+		void listToStrip(const uint32_t* list, size_t count, std::vector<uint32_t>& out);
+
+		/// Stable radix sort of faces by material. order receives face numbers grouped by material.
+		void sortFacesByMaterial(const std::vector<Face>& faces, std::vector<uint32_t>& order);
+
+		/// Average cache miss ratio of a triangle list on a FIFO cache of cacheSize vertices
+		float computeACMR(const uint32_t* indices, size_t count, uint32_t vertexCount, uint32_t cacheSize = 16);
+
+		/// Orders the triangles of a list for vertex cache reuse using Tipsify (Sander et al. 2007).
+		/// order receives triangle numbers in drawing order.
+		void tipsify(const uint32_t* indices, size_t count, uint32_t vertexCount, uint32_t cacheSize,
+					 std::vector<uint32_t>& order);
+
+		/// Reorders the triangles of a list in place with tipsify
+		void optimizeTriangleOrder(uint32_t* indices, size_t count, uint32_t vertexCount, uint32_t cacheSize = 16);
+
+		/// Numbers vertices in the order indices first reference them; unreferenced vertices follow
+		/// in their original order. remap[old] receives the new number of each vertex.
+		void buildFetchRemap(const uint32_t* indices, size_t count, uint32_t vertexCount,
+							 std::vector<uint32_t>& remap);
+
+		/// Finds duplicate vertices among vertexCount keys of width floats each (colors is optional).
+		/// With epsilon <= 0 keys must match bitwise, found through a hash of the whole key. Otherwise
+		/// each float may differ by up to epsilon, and candidates are found through a spatial grid of
+		/// epsilon-sized cells over the first three floats. remap[old] receives the new number of each
+		/// vertex, in order of first occurrence. Returns the number of distinct vertices.
+		uint32_t buildWeldRemap(const float* attributes, uint32_t width, const uint32_t* colors,
+								uint32_t vertexCount, float epsilon, std::vector<uint32_t>& remap);
+
+		/// Computes a unit normal per vertex from a triangle list, as the weighted sum of the normals
+		/// of the triangles using it. Triangles are weighted in parallel, each into its own corner
+		/// slots, then each vertex sums its corners in triangle order, so no two threads write the
+		/// same value and results do not depend on the thread count. Unused vertices get zero normals.
+		void computeNormals(const VertexPosition* positions, uint32_t vertexCount, const uint32_t* indices,
+							size_t count, NormalWeighting weighting, unsigned threads, VertexNormal* out);
+	}
+}
\ No newline at end of file
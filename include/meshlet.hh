@@ -0,0 +1,92 @@
+/*
+ * File: meshlet.hh
+ * Author: DeadlyFugu
+ * License: zlib
+ * Description: Splits Geometry and Atomic Section triangles into small clusters for culling
+ */
+
+#pragma once
+#include "bounds.hh"
+
+namespace rw {
+	struct MeshletOptions {
+		uint32_t maxVertices; // at most 255, e.g. 64
+		uint32_t maxTriangles; // at most 255, e.g. 124
+	};
+
+	namespace geom {
+		struct Meshlet {
+			uint32_t vertexOffset; // first entry in MeshletSet::vertices
+			uint32_t triangleOffset; // first triangle in MeshletSet::triangles
+			uint8_t vertexCount;
+			uint8_t triangleCount;
+			uint16_t material;
+			Sphere bounds;
+			/// the meshlet faces away from every viewpoint p where
+			/// dot(centre - p, coneAxis) >= coneCutoff * |centre - p| + radius (cutoff 1 never culls)
+			float coneAxis[3];
+			float coneCutoff;
+		};
+
+		/// Meshlets of one geometry or section, sharing flat vertex and triangle arrays
+		struct MeshletSet {
+			std::vector<Meshlet> meshlets;
+			IndexArray vertices; // vertex of the geometry for each meshlet-local vertex
+			std::vector<uint8_t> triangles; // three meshlet-local vertices per triangle
+
+			void clear() {
+				meshlets.clear();
+				vertices.clear();
+				triangles.clear();
+			}
+		};
+
+		/// Whether a meshlet's triangles all face away from viewpoint, by its normal cone
+		bool isMeshletBackfacing(const Meshlet& meshlet, const Vector3f& viewpoint);
+
+		/// Groups faces into meshlets of one material each. Triangles are added greedily to the
+		/// current meshlet, preferring those adjacent to it which add the fewest new vertices, then
+		/// those nearest its centre. A full meshlet is followed by one starting at the unused face
+		/// next to it nearest its centre, or else at the next unused face in order. Degenerate
+		/// faces are skipped. Returns false if an index is out of range or the limits are unusable.
+		bool buildMeshlets(const VertexPosition* positions, uint32_t vertexCount, const std::vector<Face>& faces,
+						   const MeshletOptions& options, MeshletSet& out);
+	}
+
+	/// Custom extension (not a RenderWare plugin) holding precomputed meshlets, indexing the
+	/// vertices of the Geometry or Atomic Section it belongs to
+	class MeshletPLGChunk : public StructChunk {
+	public:
+		uint32_t meshletCount;
+		uint32_t vertexCount; // entries in meshlets.vertices
+		uint32_t triangleCount;
+		uint32_t indexSize; // bytes per entry of meshlets.vertices, 2 or 4
+
+		geom::MeshletSet meshlets;
+
+		MeshletPLGChunk(ChunkType type, uint32_t version) : StructChunk(type, version) {}
+
+		virtual void dump(util::DumpWriter out);
+
+		virtual void dumpJson(util::JsonWriter& out);
+
+		virtual void postReadHook();
+
+		virtual void preWriteHook();
+	};
+
+	/// Builds meshlets from the faces and first morph target of a geometry, or a section.
+	/// Returns false for native geometry or geometry without positions.
+	bool buildMeshlets(GeometryChunk* geometry, const MeshletOptions& options, geom::MeshletSet& out);
+	bool buildMeshlets(AtomicSectionChunk* section, const MeshletOptions& options, geom::MeshletSet& out);
+
+	/// Returns the Meshlet PLG among a geometry's extensions, or nullptr if it has none
+	MeshletPLGChunk* findMeshlets(GeometryChunk* geometry);
+
+	/// Stores meshlets (taking their contents) in the Meshlet PLG of a geometry or section, adding
+	/// one (and an Extension chunk) if needed, and re-serializes it. Like other extensions, this
+	/// stops optimizeVertexCache and weldVertices (and compactVertices, for geometry) from
+	/// renumbering the geometry's or section's vertices afterwards.
+	MeshletPLGChunk* attachMeshlets(GeometryChunk* geometry, geom::MeshletSet& meshlets);
+	MeshletPLGChunk* attachMeshlets(AtomicSectionChunk* section, geom::MeshletSet& meshlets);
+}
\ No newline at end of file
@@ -0,0 +1,78 @@
+/*
+ * File: quantize.hh
+ * Author: DeadlyFugu
+ * License: zlib
+ * Description: Compression of vertex attributes into compact formats, with decoding and error metrics
+ */
+
+#pragma once
+#include "vertex.hh"
+
+namespace rw {
+	namespace vertex {
+		/// Converts IEEE half floats to floats
+		void decodeHalf(const uint16_t* in, float* out, size_t count);
+
+		/// Converts signed normalized 16-bit values to floats in [-1, 1]
+		void decodeSnorm16(const int16_t* in, float* out, size_t count);
+
+		/// Converts unsigned normalized 16-bit values to floats in [0, 1]
+		void decodeUnorm16(const uint16_t* in, float* out, size_t count);
+
+		/// Converts unsigned normalized 8-bit values to floats in [0, 1]
+		void decodeUnorm8(const uint8_t* in, float* out, size_t count);
+
+		/// Encodes unit normals as two snorm16 octahedral coordinates each
+		void encodeOctahedral(const geom::VertexNormal* in, int16_t* out, size_t count);
+
+		/// Decodes two snorm16 octahedral coordinates per normal into unit normals
+		void decodeOctahedral(const int16_t* in, geom::VertexNormal* out, size_t count);
+
+		struct QuantizationError {
+			double maxError;
+			double rmsError;
+		};
+
+		enum NormalEncoding {
+			NORMAL_SNORM16, // x, y, z as snorm16
+			NORMAL_OCTAHEDRAL // two snorm16 octahedral coordinates
+		};
+
+		enum ColorEncoding {
+			COLOR_RGBA8,
+			COLOR_RGB565 // only used when every colour is opaque
+		};
+
+		/// Compressed copy of a mesh's vertex streams. Positions and UVs are stored as half floats.
+		struct QuantizedMesh {
+			uint32_t vertexCount;
+			std::vector<uint16_t> positions; // x, y, z per vertex
+
+			NormalEncoding normalEncoding;
+			std::vector<int16_t> normals; // 3 or 2 values per vertex
+
+			ColorEncoding colorEncoding;
+			std::vector<uint8_t> colors; // 4 or 2 bytes per vertex
+
+			std::vector<std::vector<uint16_t>> uvLayers; // u, v per vertex
+
+			QuantizationError positionError; // distance in model units
+			QuantizationError normalError; // angle in degrees
+			QuantizationError colorError; // per channel on a 0-255 scale
+			QuantizationError uvError; // distance in UV units, over all layers
+		};
+
+		/// Compresses every stream present in mesh and measures the error introduced
+		void quantizeMesh(const geom::MeshView& mesh, QuantizedMesh& out,
+						  NormalEncoding normalEncoding = NORMAL_OCTAHEDRAL,
+						  ColorEncoding colorEncoding = COLOR_RGBA8);
+
+		void decodePositions(const QuantizedMesh& mesh, std::vector<geom::VertexPosition>& out);
+
+		void decodeNormals(const QuantizedMesh& mesh, std::vector<geom::VertexNormal>& out);
+
+		void decodeColors(const QuantizedMesh& mesh, std::vector<geom::VertexColor>& out);
+
+		void decodeUVs(const QuantizedMesh& mesh, uint32_t layer, std::vector<geom::VertexUVs>& out);
+	}
+}
\ No newline at end of file
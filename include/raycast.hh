@@ -0,0 +1,97 @@
+/*
+ * File: raycast.hh
+ * Author: DeadlyFugu
+ * License: zlib
+ * Description: Ray and segment intersection against Geometry and World triangles
+ */
+
+#pragma once
+#include "bsp.hh"
+
+namespace rw {
+	namespace geom {
+		struct Ray {
+			Vector3f origin;
+			Vector3f direction; // unit length
+			float maxDistance; // hits at or beyond this are ignored
+		};
+
+		/// Ray from a to b, which ignores hits beyond b
+		Ray segmentRay(const Vector3f& a, const Vector3f& b);
+
+		struct RayHit {
+			float distance;
+			uint32_t face; // index into the faces of the mesh (or section) hit
+			uint32_t material;
+			uint32_t section; // atomic section index in the world, NONE for a single mesh
+			float u, v; // barycentric coordinates of the hit from vertex2 and vertex3
+		};
+
+		/// Four triangles as vertex1 and its edges to vertex2 and vertex3, one per lane
+		struct alignas(16) TrianglePacket {
+			float origin[3][4];
+			float edge1[3][4];
+			float edge2[3][4];
+			uint32_t face[4]; // NONE for an unused lane
+		};
+
+		/// Bounding volume hierarchy over the triangles of one mesh, built with binned surface area
+		/// heuristic splits. Nodes are depth-first, so an inner node's left child follows it. Leaves
+		/// hold packets of up to four triangles, which are tested against a ray together. Triangles
+		/// are hit from either side.
+		class TriangleBvh {
+		public:
+			static const uint32_t NONE = 0xffffffffu;
+
+			struct Node {
+				float min[3];
+				uint32_t offset; // first packet of a leaf, right child of an inner node
+				float max[3];
+				uint32_t count; // packets of a leaf, 0 for an inner node
+			};
+
+			std::vector<Node> nodes;
+			std::vector<TrianglePacket> packets;
+			std::vector<uint16_t> materials; // for each face
+
+			/// Returns false (leaving this empty) if a face index is out of range
+			bool build(const VertexPosition* positions, uint32_t vertexCount, const std::vector<Face>& faces);
+
+			void clear();
+
+			/// Nearest hit along a ray, if any
+			bool intersect(const Ray& ray, RayHit& hit) const;
+
+			/// Whether a ray hits anything, stopping at the first hit found (for line of sight)
+			bool occluded(const Ray& ray) const;
+
+		private:
+			template<bool ANY>
+			bool traverse(const Ray& ray, RayHit& hit) const;
+		};
+	}
+
+	/// Builds the BVH of a geometry's first morph target, or of a section
+	bool buildTriangleBvh(GeometryChunk* geometry, geom::TriangleBvh& bvh);
+	bool buildTriangleBvh(AtomicSectionChunk* section, geom::TriangleBvh& bvh);
+
+	/// Ray queries over a world: sections are visited front to back by descending the split
+	/// planes of its WorldBsp (skipping those whose box the ray misses or reaches beyond the
+	/// nearest hit so far), and each section's triangles are tested through its own BVH
+	class WorldRaycaster {
+	public:
+		WorldBsp bsp;
+		std::vector<geom::TriangleBvh> sections; // by atomic section index
+
+		/// Returns false if the world's section tree cannot be flattened or is over 64 levels deep
+		bool build(WorldChunk* world);
+
+		bool intersect(const geom::Ray& ray, geom::RayHit& hit) const;
+
+		bool occluded(const geom::Ray& ray) const;
+
+	private:
+		template<bool ANY>
+		bool traverse(const geom::Ray& ray, geom::RayHit& hit) const;
+	};
+}
\ No newline at end of file
@@ -0,0 +1,74 @@
+/*
+ * File: sampler.hh
+ * Author: DeadlyFugu
+ * License: zlib
+ * Description: Samples keyframe animations as one track per bone
+ */
+
+#pragma once
+#include "animation.hh"
+#include "transform.hh"
+
+namespace rw {
+	/// Keyframes of a standard layout (interpolation type 1) AnimAnimation, split into one track
+	/// per bone. Built once and shared by any number of samplers.
+	class AnimationTracks {
+	public:
+		struct Key {
+			float rotation[4]; // quaternion x, y, z, w
+			float translation[3];
+			float time;
+		};
+
+		float duration;
+		std::vector<Key> keys; // the keys of each bone in time order, one bone after another
+		std::vector<uint32_t> firstKeys; // first key of each bone, then the key count
+
+		/// Follows each keyframe's previousOffset (the byte offset of the same bone's previous
+		/// keyframe) back to the keyframes starting each track, which are the first boneCount.
+		/// If boneCount is 0, it is taken as the number of leading keyframes at time 0.
+		/// Keyframes which do not continue the end of a track are dropped with a warning.
+		/// Returns false (leaving this empty) if the layout is not standard or there are no keys.
+		bool build(const AnimAnimationChunk* animation, uint32_t boneCount = 0);
+
+		void clear();
+
+		uint32_t boneCount() const;
+	};
+
+	/// Local rotation and translation of a bone
+	struct BonePose {
+		float rotation[4]; // quaternion x, y, z, w
+		float translation[3];
+	};
+
+	enum RotationBlend {
+		BLEND_NLERP, // normalized linear blend, cheapest, slightly uneven in speed
+		BLEND_SLERP, // constant speed, by a polynomial within about 3e-5 of exact slerp
+	};
+
+	/// Samples every track of an AnimationTracks at a time. Each sampler remembers where it
+	/// found each bone's keys, so a sampler per playing instance keeps key searches short.
+	class AnimationSampler {
+	public:
+		const AnimationTracks& tracks;
+
+		explicit AnimationSampler(const AnimationTracks& tracks);
+
+		/// Writes the pose of each bone at time (clamped to each track), boneCount() poses.
+		/// Keys are searched forwards from the last time sampled, falling back to a binary
+		/// search. Bones are blended four at a time with SIMD.
+		void sample(float time, BonePose* out, RotationBlend blend = BLEND_SLERP);
+
+		/// Forgets where keys were found, as after the tracks are rebuilt
+		void reset();
+
+	private:
+		std::vector<uint32_t> cursors; // for each bone, the key starting its last sampled segment
+
+		uint32_t findKey(uint32_t bone, float time);
+	};
+
+	/// Converts poses to local frame transforms, assuming unit quaternions
+	void poseToTransforms(const BonePose* poses, size_t count, geom::Transform* out);
+}
\ No newline at end of file
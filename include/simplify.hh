@@ -0,0 +1,54 @@
+/*
+ * File: simplify.hh
+ * Author: DeadlyFugu
+ * License: zlib
+ * Description: Quadric error mesh simplification and generation of LOD geometry chains
+ */
+
+#pragma once
+#include "mesh.hh"
+
+namespace rw {
+	namespace geom {
+		struct SimplifiedLevel {
+			std::vector<Face> faces;
+			float rmsError; // largest RMS quadric error of any collapse so far, in model units
+		};
+
+		/// Simplifies faces by half-edge collapses in order of quadric error (Garland & Heckbert
+		/// 1997), so every remaining vertex keeps its own attributes. A level is produced each time
+		/// the triangle count reaches the next of targets (in decreasing order). Collapses which
+		/// would move a locked vertex, flip a triangle or make the mesh non-manifold are skipped.
+		/// The error of a collapse is the root of its area weighted mean squared distance from the
+		/// planes of the input triangles around it, so single vertices may end up further away.
+		/// With maxError > 0, simplification stops before any collapse's error exceeds it, ending
+		/// levels with the partial result if it removed any triangles.
+		void simplifyFaces(const VertexPosition* positions, uint32_t vertexCount, const std::vector<bool>& locked,
+						   const std::vector<Face>& faces, const std::vector<size_t>& targets, float maxError,
+						   std::vector<SimplifiedLevel>& levels);
+	}
+
+	struct LodOptions {
+		uint32_t levels; // LODs to produce after the input geometry
+		float ratio; // triangles kept by each level, relative to the level before
+		float maxError; // largest RMS quadric error allowed, in model units (0 for no limit)
+	};
+
+	struct LodLevel {
+		GeometryChunk* geometry; // new chunk, owned by the caller
+		uint32_t triangleCount;
+		uint32_t vertexCount;
+		float rmsError; // largest RMS quadric error of any collapse, as for SimplifiedLevel
+	};
+
+	/// Marks vertices simplification must not move: those sharing a position with another vertex
+	/// (UV and colour seams), used by faces of several materials, or on an open or non-manifold edge
+	void findLockedVertices(GeometryChunk* geometry, std::vector<bool>& locked);
+
+	/// Builds a chain of simplified copies of a geometry, each with ratio times the triangles of
+	/// the one before, keeping material boundaries, seams and borders in place. Each copy has its
+	/// BinMesh rebuilt, unused vertices removed (if it has no other extensions) and its bounds
+	/// updated. The chain ends early once maxError would be exceeded or nothing can be collapsed.
+	/// The geometry must be serialized (preWriteHook) if it was edited.
+	std::vector<LodLevel> buildLodChain(GeometryChunk* geometry, const LodOptions& options);
+}
\ No newline at end of file
@@ -0,0 +1,95 @@
+/*
+ * File: store.hh
+ * Author: DeadlyFugu
+ * License: zlib
+ * Description: Content-addressed store which keeps each unique chunk once across many streams
+ */
+
+#pragma once
+#include "chunk.hh"
+#include <string>
+#include <unordered_map>
+
+namespace rw {
+	/// Splits streams into chunks and keeps one copy of each unique chunk, keyed by the same
+	/// hash as Chunk::hash(). Any stored stream can be rebuilt byte-for-byte, or loaded
+	/// directly as typed chunks whose struct data points into the store's memory.
+	class ChunkStore {
+	public:
+		typedef uint64_t Key;
+	private:
+		struct Node {
+			ChunkType type;
+			uint32_t version;
+			/// size of the chunk body in bytes
+			uint32_t size;
+			bool isList;
+			/// list nodes: keys of each child
+			std::vector<Key> children;
+			/// struct nodes: body bytes (owned, or inside the store file)
+			const uint8_t* data;
+			std::vector<uint8_t> owned;
+		};
+
+		struct Stream {
+			std::vector<Key> roots;
+			/// bytes after the last complete chunk
+			std::vector<uint8_t> trailing;
+		};
+
+		std::unordered_map<Key, Node> nodes;
+		std::unordered_map<std::string, Stream> streams;
+		/// contents of a store file opened with open()
+		util::Buffer file;
+		size_t inputBytes;
+
+		/// Stores the chunk at p, whose header and body must fit in len bytes, and which is nested
+		/// depth lists deep. Fails past DEFAULT_MAX_CHUNK_DEPTH so untrusted input cannot exhaust
+		/// the stack.
+		bool addChunk(const uint8_t* p, uint32_t len, Key& key, uint32_t depth);
+		/// Stores node (taking its children), setting key. Returns false on a hash collision.
+		bool addNode(Node& node, Key& key);
+		void rebuildNode(const Node& node, util::Buffer& out);
+		Chunk* loadNode(Key key, uint32_t offset);
+	public:
+		ChunkStore();
+		ChunkStore(const ChunkStore&) = delete;
+
+		/// Splits stream into chunks and stores the unique ones under name (replacing any
+		/// stream already stored under it). Returns false on a hash collision or a malformed chunk.
+		bool add(const std::string& name, util::Buffer& stream);
+
+		/// Reads a file and stores it under its path
+		bool addFile(const char* filepath);
+
+		bool contains(const std::string& name);
+
+		/// Names of all stored streams
+		std::vector<std::string> names();
+
+		/// Appends the original bytes of a stored stream to out (out must be stretchy)
+		bool rebuild(const std::string& name, util::Buffer& out);
+
+		/// Loads the first chunk of a stored stream, as readChunk would. Struct data of the
+		/// result views store memory, so the store must outlive it. Caller must delete it.
+		Chunk* load(const std::string& name);
+
+		/// Loads a single stored chunk by key, or returns nullptr if it is not stored
+		Chunk* loadChunk(Key key);
+
+		/// Number of unique chunks held
+		size_t chunkCount();
+
+		/// Total size of all streams added
+		size_t totalBytes();
+
+		/// Size of unique chunk data held (struct bodies plus list child keys)
+		size_t storedBytes();
+
+		/// Writes the store to a single file
+		bool save(const char* filepath);
+
+		/// Replaces the contents of this store with a file written by save()
+		bool open(const char* filepath);
+	};
+}
\ No newline at end of file
@@ -0,0 +1,70 @@
+/*
+ * File: stream.hh
+ * Author: DeadlyFugu
+ * License: zlib
+ * Description: Loads the atomic sections of a world on demand, by the region they cover
+ */
+
+#pragma once
+#include "bsp.hh"
+#include <cstdio>
+
+namespace rw {
+	/// A world whose atomic sections are only decoded while needed. Opening walks the chunk
+	/// headers of the section tree, reading just the plane of each Plane Section and the box at
+	/// the start of each Atomic Section, into a WorldBsp whose sections stay null until decoded.
+	/// Sections are numbered as WorldBsp numbers them.
+	class WorldStream {
+	public:
+		/// Where an atomic section's chunk lies in the stream, header included
+		struct SectionExtent {
+			uint32_t offset;
+			uint32_t size;
+		};
+
+		WorldBsp bsp;
+		std::vector<SectionExtent> extents; // for each section
+		MaterialListChunk* materialList; // decoded on open, (null) if the world has none
+
+		WorldStream();
+		WorldStream(const WorldStream&) = delete;
+		~WorldStream();
+
+		/// Indexes a world stored in a file, which is kept open to decode sections from
+		bool open(const char* filepath);
+
+		/// Indexes a world at the start of a buffer, whose memory must outlive this
+		bool open(util::Buffer& stream);
+
+		/// Deletes every decoded section and forgets the stream
+		void close();
+
+		/// A section, decoding it first if needed, or nullptr if it could not be read
+		AtomicSectionChunk* acquire(uint32_t section);
+
+		/// Deletes a decoded section, so pointers to it become invalid
+		void evict(uint32_t section);
+
+		/// Decodes each section whose box overlaps a region, and evicts every other section.
+		/// Returns the number of sections decoded by this call.
+		uint32_t setRegion(const geom::AABB& region);
+
+		/// As above, for a sphere (such as the area around a player)
+		uint32_t setRegion(const geom::Sphere& region);
+
+		/// Number of sections currently decoded
+		uint32_t decodedCount() const;
+
+	private:
+		FILE* file; // (null) when reading from memory
+		util::Buffer memory;
+		uint32_t streamSize;
+		uint32_t decoded;
+		std::vector<uint32_t> query;
+		std::vector<bool> wanted;
+
+		bool readBytes(uint32_t offset, uint32_t length, util::Buffer& out);
+		bool index();
+		uint32_t applyQuery();
+	};
+}
\ No newline at end of file
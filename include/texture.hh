@@ -113,6 +113,8 @@ namespace rw {
 
 		virtual void dump(util::DumpWriter out);
 
+		virtual void dumpJson(util::JsonWriter& out);
+
 		/// sub-classes may override this to implement custom functionality
 		virtual void postReadHook();
 
@@ -131,6 +133,8 @@ namespace rw {
 
 		virtual void dump(util::DumpWriter out);
 
+		virtual void dumpJson(util::JsonWriter& out);
+
 		/// sub-classes may override this to implement custom functionality
 		virtual void postReadHook();
 
@@ -0,0 +1,62 @@
+/*
+ * File: transform.hh
+ * Author: DeadlyFugu
+ * License: zlib
+ * Description: Affine transforms in the layout RenderWare uses for frames, and frame hierarchies
+ */
+
+#pragma once
+#include "geometry.hh"
+
+namespace rw {
+	namespace geom {
+		/// Transform of row vectors, as frames store it: p' = p * rotation + translation
+		struct Transform {
+			Matrix3x3f rotation;
+			Vector3f translation;
+		};
+
+		Transform identityTransform();
+
+		/// Transform applying first, then second (first * second in row vector order)
+		Transform combineTransforms(const Transform& first, const Transform& second);
+
+		Vector3f transformPoint(const Transform& transform, const Vector3f& point);
+
+		/// Largest length a unit axis is scaled to, which bounds the scaling of a sphere's radius
+		/// unless the transform shears (as RenderWare assumes)
+		float maxScale(const Transform& transform);
+	}
+
+	/// The frames of a frame list sorted once so parents come before their children, for
+	/// evaluating world transforms of many instances sharing the hierarchy. A frame in a cycle of
+	/// parents, or with a parent out of range, is treated as a root.
+	class FrameHierarchy {
+	public:
+		static const uint32_t NONE = 0xffffffffu;
+
+		std::vector<uint32_t> order; // frame numbers, each after its parent
+		std::vector<uint32_t> parents; // for each position in order, its parent's position or NONE
+
+		/// Returns false (leaving this empty) if there are no frames
+		bool build(FrameListChunk* frameList);
+
+		void clear();
+
+		uint32_t frameCount() const;
+
+		/// Combines frames with their parents for each instance. locals and out hold frameCount()
+		/// transforms per instance, by frame number, one instance after another. Root frames are
+		/// placed by roots (one per instance), or left as they are if roots is nullptr. Instances
+		/// are evaluated four at a time, each frame with four SIMD lanes.
+		void evaluate(const geom::Transform* locals, const geom::Transform* roots, size_t instanceCount,
+					  geom::Transform* out) const;
+	};
+
+	/// Transform of each frame relative to its parent, as stored
+	void getLocalTransforms(FrameListChunk* frameList, std::vector<geom::Transform>& out);
+
+	/// Transform of each frame relative to the clump, combining frames with their parents (root
+	/// frames included) as FrameHierarchy does. Returns false (with out empty) without frames.
+	bool computeFrameTransforms(FrameListChunk* frameList, std::vector<geom::Transform>& out);
+}
\ No newline at end of file
@@ -10,6 +10,10 @@
 #include <cstddef>
 #include <cstdint>
 #include <cstdarg>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <functional>
 #include "buffer.hh"
 
 namespace rw {
@@ -110,23 +114,175 @@ namespace rw {
 		bool readFile(const char* filepath, Buffer& buffer);
 		bool writeFile(const char* filepath, Buffer& buffer);
 
+		/// Splits [0, count) into contiguous ranges of at least minRange items and calls fn(begin, end)
+		/// for each, on up to threads threads including the caller (0 uses the hardware thread count).
+		/// Returns once every range is done.
+		void parallelFor(size_t count, unsigned threads, size_t minRange,
+						 const std::function<void(size_t begin, size_t end)>& fn);
+
+		/// Destination for text produced by a DumpWriter
+		class DumpSink {
+		public:
+			virtual ~DumpSink() {}
+
+			/// Append len bytes of text (may contain several lines)
+			virtual void write(const char* text, size_t len) = 0;
+			/// Push any buffered text through to its destination
+			virtual void flush() {}
+		};
+
+		/// Collects text into a large block and passes it to fwrite once full
+		class FileDumpSink : public DumpSink {
+		private:
+			FILE* file;
+			char* block;
+			size_t used;
+			size_t capacity;
+		public:
+			FileDumpSink(FILE* file, size_t blockSize = 1 << 20);
+			FileDumpSink(const FileDumpSink&) = delete;
+			virtual ~FileDumpSink();
+
+			virtual void write(const char* text, size_t len);
+			virtual void flush();
+		};
+
+		/// Collects text in memory
+		class StringDumpSink : public DumpSink {
+		public:
+			std::string text;
+
+			virtual void write(const char* text, size_t len) {
+				this->text.append(text, len);
+			}
+		};
+
+		struct DumpSegment;
+		class DumpScheduler;
+
 		class DumpWriter {
 		private:
 			int indent;
 			bool verbose;
 			void (*fnPrintCallback)(const char*);
+			DumpSink* sink;
+			DumpSegment* segment;
+			DumpScheduler* scheduler;
+
+			friend class DumpScheduler;
+
+			/// Pass a complete line (including trailing newline) to the output
+			void emit(char* line, size_t len);
 		public:
 			DumpWriter(bool verbose = true);
 			DumpWriter(const DumpWriter& parent);
 			DumpWriter(void (*fnPrint)(const char*), bool verbose = true);
+			/// Writes to sink; if scheduler is given, spawned sections are dumped on its
+			/// worker threads and written to sink in order by its writer thread
+			DumpWriter(DumpSink* sink, bool verbose = true, DumpScheduler* scheduler = nullptr);
 
 			const void print(const char* format, ...);
 
+			/// Print a line of len preformatted characters (no newline)
+			void printLine(const char* text, size_t len);
+
+			/// Runs fn with a writer equivalent to this one. When a scheduler is in use the
+			/// call may instead be queued for a worker, with its output spliced in at this point.
+			/// fn must only touch data which is not modified while dumping.
+			void spawn(const std::function<void(DumpWriter&)>& fn);
+
 			bool isVerbose();
 		};
 
+		/// Worker pool used to dump independent sections in parallel. A writer thread passes
+		/// each writer's text to its sink in order as soon as everything before it is complete,
+		/// so formatting overlaps output and written text is freed straight away.
+		class DumpScheduler {
+		private:
+			struct Impl;
+			Impl* impl;
+
+			friend class DumpWriter;
+
+			/// Registers the top-level segment of a new writer, returns it
+			DumpSegment* addRoot(DumpSink* sink);
+			/// Hands a segment's pending text to the writer thread, then waits while too much text
+			/// is waiting to be written, unless the writer thread is itself waiting on a producer
+			void publish(DumpSegment* segment);
+			/// Queues fn to be run into child, which follows the text segment has so far. Returns
+			/// false if the pool is saturated or too much text is waiting to be written.
+			bool submit(DumpSegment* segment, DumpSegment* child, const DumpWriter& writer,
+						const std::function<void(DumpWriter&)>& fn);
+		public:
+			/// threads of 0 uses the hardware thread count
+			explicit DumpScheduler(unsigned threads = 0);
+			DumpScheduler(const DumpScheduler&) = delete;
+			~DumpScheduler();
+
+			/// Ends every writer made so far, which must no longer be printed to, and waits until
+			/// their output has all been written to their sinks
+			void finish();
+		};
+
 		void dumpBuffer(Buffer& buf, DumpWriter out);
 
+		/// Streams compact JSON text to a DumpSink
+		class JsonWriter {
+		public:
+			/// How large arrays passed to blob() are written
+			enum BlobMode {
+				/// {"offset": <stream offset>, "size": <bytes>}
+				BLOB_REFERENCE,
+				/// base64 string of the bytes as stored in the stream
+				BLOB_BASE64,
+			};
+		private:
+			DumpSink* sink;
+			BlobMode blobMode;
+			/// one entry per open object/array, true until its first member is written
+			std::vector<bool> firstStack;
+			/// set between a key and its value
+			bool afterKey;
+
+			void separate();
+			void writeString(const char* str, size_t len);
+		public:
+			JsonWriter(DumpSink* sink, BlobMode blobMode = BLOB_REFERENCE);
+
+			BlobMode getBlobMode();
+
+			void beginObject();
+			void beginObject(const char* key);
+			void endObject();
+			void beginArray();
+			void beginArray(const char* key);
+			void endArray();
+
+			/// Writes the key of the next member; follow with a value or begin call
+			void key(const char* key);
+
+			void value(int32_t v);
+			void value(uint32_t v);
+			void value(uint64_t v);
+			void value(double v);
+			void value(bool v);
+			void value(const char* v);
+			void value(const std::string& v);
+			void null();
+
+			template<typename T>
+			void field(const char* name, T v) {
+				key(name);
+				value(v);
+			}
+
+			/// Writes bytes [start, start + size) of body, which begins at bodyOffset in the stream
+			void blob(const char* name, Buffer& body, uint32_t bodyOffset, uint32_t start, uint32_t size);
+
+			/// Ends the current top-level value with a newline (for NDJSON)
+			void endLine();
+		};
+
 		uint32_t unpackVersionNumber(uint32_t packedVersion);
 		uint32_t unpackBuild(uint32_t packedVersion);
 		uint32_t packVersion(uint32_t version, uint32_t build);
@@ -0,0 +1,114 @@
+/*
+ * File: vertex.hh
+ * Author: DeadlyFugu
+ * License: zlib
+ * Description: Builds interleaved GPU vertex and index buffers from geometry data
+ */
+
+#pragma once
+#include "mesh.hh"
+
+namespace rw {
+	namespace vertex {
+		enum Attribute {
+			ATTRIB_POSITION,
+			ATTRIB_NORMAL,
+			ATTRIB_COLOR,
+			ATTRIB_TEXCOORD
+		};
+
+		enum Format {
+			FORMAT_FLOAT2,
+			FORMAT_FLOAT3,
+			FORMAT_FLOAT4,
+			FORMAT_HALF2,
+			FORMAT_HALF4,
+			FORMAT_SNORM16x4,
+			FORMAT_UNORM16x2,
+			FORMAT_UNORM8x4,
+			FORMAT_OCT16x2 // unit vector as two snorm16 octahedral coordinates
+		};
+
+		/// Size in bytes of one value in the given format
+		uint32_t formatSize(Format format);
+
+		/// Number of components in the given format
+		uint32_t formatComponents(Format format);
+
+		struct Element {
+			Attribute attribute;
+			Format format;
+			uint32_t layer; // UV layer for ATTRIB_TEXCOORD
+			uint32_t offset;
+		};
+
+		class Layout {
+		public:
+			std::vector<Element> elements;
+			uint32_t stride;
+
+			Layout() : stride(0) {}
+
+			/// Appends an attribute after the previous one, at a 4 byte aligned offset
+			Layout& add(Attribute attribute, Format format, uint32_t layer = 0);
+
+			/// Places an attribute at an explicit offset
+			Layout& add(Attribute attribute, Format format, uint32_t layer, uint32_t offset);
+
+			/// Rounds the stride up to a multiple of alignment
+			Layout& align(uint32_t alignment);
+
+			/// Checks every element fits within the stride without overlapping another
+			bool validate() const;
+		};
+
+		enum IndexSource {
+			INDICES_AUTO, // BinMesh if present, otherwise faces
+			INDICES_FACES,
+			INDICES_BINMESH
+		};
+
+		enum IndexWidth {
+			INDEX_AUTO, // 16-bit whenever every index fits
+			INDEX_16,
+			INDEX_32
+		};
+
+		/// Range of the index buffer drawn with one material
+		struct Submesh {
+			uint32_t material;
+			uint32_t firstIndex;
+			uint32_t indexCount;
+		};
+
+		struct VertexBuffer {
+			Layout layout;
+			uint32_t vertexCount;
+			std::vector<uint8_t> vertices;
+
+			uint32_t indexSize; // 2 or 4
+			uint32_t indexCount;
+			std::vector<uint8_t> indices;
+			bool isStrip; // each submesh is a separate triangle strip
+			std::vector<Submesh> submeshes;
+		};
+
+		/// Interleaves the streams of mesh as described by layout, and builds an index buffer from
+		/// its faces or BinMesh. Attributes the mesh lacks are filled with defaults (normal 0,0,1,
+		/// white colour, zero UVs). Returns false if layout is invalid or an index is out of range.
+		bool buildVertexBuffer(const geom::MeshView& mesh, const Layout& layout, VertexBuffer& out,
+							   IndexSource source = INDICES_AUTO, IndexWidth width = INDEX_AUTO);
+
+		/// Converts floats to IEEE half floats (round to nearest even)
+		void encodeHalf(const float* in, uint16_t* out, size_t count);
+
+		/// Converts floats in [-1, 1] to signed normalized 16-bit values
+		void encodeSnorm16(const float* in, int16_t* out, size_t count);
+
+		/// Converts floats in [0, 1] to unsigned normalized 16-bit values
+		void encodeUnorm16(const float* in, uint16_t* out, size_t count);
+
+		/// Converts floats in [0, 1] to unsigned normalized 8-bit values
+		void encodeUnorm8(const float* in, uint8_t* out, size_t count);
+	}
+}
\ No newline at end of file
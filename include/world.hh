@@ -9,8 +9,11 @@
 #include "chunk.hh"
 #include "material.hh"
 #include "geometry.hh"
+#include "indices.hh"
 
 namespace rw {
+	class MeshletPLGChunk;
+
 	class BinMeshPLGChunk : public StructChunk {
 	public:
 		uint32_t flags; // 0 is trilist; 1 is tristrip
@@ -20,7 +23,7 @@ namespace rw {
 		struct BinMeshObject {
 			uint32_t meshIndexCount;
 			uint32_t material;
-			std::vector<uint32_t> indices;
+			geom::IndexArray indices; // 16-bit when every index fits, u32 on disk
 		};
 
 		std::vector<BinMeshObject> objects;
@@ -29,6 +32,8 @@ namespace rw {
 
 		virtual void dump(util::DumpWriter out);
 
+		virtual void dumpJson(util::JsonWriter& out);
+
 		/// sub-classes may override this to implement custom functionality
 		virtual void postReadHook();
 
@@ -59,11 +64,14 @@ namespace rw {
 		std::vector<geom::Face> faces;
 
 		BinMeshPLGChunk* binMeshPLG; // (null) if extension not present
+		MeshletPLGChunk* meshletPLG; // (null) if extension not present
 
 		AtomicSectionChunk(ChunkType type, uint32_t version) : AbstractSectionChunk(type, version) {}
 
 		virtual void dump(util::DumpWriter out);
 
+		virtual void dumpJson(util::JsonWriter& out);
+
 		/// sub-classes may override this to implement custom functionality
 		virtual void postReadHook();
 
@@ -89,6 +97,8 @@ namespace rw {
 
 		virtual void dump(util::DumpWriter out);
 
+		virtual void dumpJson(util::JsonWriter& out);
+
 		/// sub-classes may override this to implement custom functionality
 		virtual void postReadHook();
 
@@ -98,6 +108,10 @@ namespace rw {
 		virtual bool isAtomic() override;
 	};
 
+	/// Calls fn for a section and each section below it in pre-order, left before right, with its
+	/// depth (the root being 0), using an explicit stack. Missing children are skipped.
+	void visitSections(AbstractSectionChunk* root, const std::function<void(AbstractSectionChunk*, uint32_t)>& fn);
+
 	class WorldChunk : public ListChunk {
 	public:
 		uint32_t unknownA[4];
@@ -114,6 +128,8 @@ namespace rw {
 
 		virtual void dump(util::DumpWriter out);
 
+		virtual void dumpJson(util::JsonWriter& out);
+
 		/// sub-classes may override this to implement custom functionality
 		virtual void postReadHook();
 
@@ -31,6 +31,16 @@ namespace rw {
 		}
 	}
 
+	void AnimAnimationChunk::dumpJson(util::JsonWriter& out) {
+		out.field("animationVersion", animationVersion);
+		out.field("interpolationType", interpolationType);
+		out.field("frameCount", frameCount);
+		out.field("flags", flags);
+		out.field("duration", duration);
+		// each stored as time, rotation quat, translation, previous offset
+		dumpJsonBlob(out, "frames", 20, frames.size() * 36);
+	}
+
 	void AnimAnimationChunk::postReadHook() {
 		data.seek(0);
 		data.read(&animationVersion);
@@ -80,6 +90,28 @@ namespace rw {
 		}
 	}
 
+	void DMorphAnimationChunk::dumpJson(util::JsonWriter& out) {
+		out.field("animationVersion", animationVersion);
+		out.field("interpolationType", interpolationType);
+		out.field("targetCount", targetCount);
+		out.field("totalFrameCount", totalFrameCount);
+
+		out.beginArray("targets");
+		for (auto& target : targets) {
+			out.beginArray();
+			for (auto& frame : target.frames) {
+				out.beginObject();
+				out.field("startValue", frame.startValue);
+				out.field("endValue", frame.endValue);
+				out.field("duration", frame.duration);
+				out.field("nextId", frame.nextId);
+				out.endObject();
+			}
+			out.endArray();
+		}
+		out.endArray();
+	}
+
 	void DMorphAnimationChunk::postReadHook() {
 		data.seek(12); // skip struct header
 		data.read(&animationVersion);
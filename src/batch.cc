@@ -0,0 +1,212 @@
+/*
+ * File: batch.cc
+ * Author: DeadlyFugu
+ * License: zlib
+ * Description: Flattens a world and placed clumps into one vertex and index buffer per material
+ */
+
+#include "batch.hh"
+#include "bsp.hh"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+
+namespace rw {
+	namespace vertex {
+		/// State shared by every source of a batch
+		struct Batcher {
+			const Layout& layout;
+			StaticBatch& out;
+			std::unordered_map<uint64_t, uint32_t> batchOf; // material hash to batch
+			std::vector<std::vector<uint32_t>> indices; // of each batch, narrowed once finished
+			VertexBuffer interleaved;
+			std::vector<uint32_t> order;
+			std::vector<uint32_t> remap; // batch vertex of each source vertex stamped this run
+			std::vector<uint32_t> stamps;
+			uint32_t stamp;
+
+			Batcher(const Layout& layout, StaticBatch& out) : layout(layout), out(out), stamp(0) {}
+		};
+
+		static void addSource(Batcher& batcher, const geom::MeshView& mesh, MaterialListChunk* materials, bool rewind) {
+			uint32_t source = batcher.out.sourceCount++;
+			auto& faces = *mesh.faces;
+			if (faces.empty()) return;
+			if (!mesh.positions) {
+				util::logger.warn("Source %d has faces but no positions", source);
+				return;
+			}
+			if (!buildVertexBuffer(mesh, batcher.layout, batcher.interleaved, INDICES_FACES, INDEX_32)) {
+				util::logger.warn("Skipping source %d", source);
+				return;
+			}
+
+			const uint32_t stride = batcher.layout.stride;
+			const uint8_t* vertices = batcher.interleaved.vertices.data();
+			if (batcher.stamps.size() < mesh.vertexCount) {
+				batcher.remap.resize(mesh.vertexCount);
+				batcher.stamps.resize(mesh.vertexCount, 0);
+			}
+
+			auto& order = batcher.order;
+			geom::sortFacesByMaterial(faces, order);
+			for (size_t i = 0; i < order.size();) {
+				uint16_t material = faces[order[i]].material;
+				size_t runEnd = i;
+				while (runEnd < order.size() && faces[order[runEnd]].material == material) runEnd++;
+				if (!materials || material >= materials->materials.size()) {
+					util::logger.warn("Source %d uses material %d out of range", source, material);
+					i = runEnd;
+					continue;
+				}
+
+				MaterialChunk* chunk = materials->materials[material];
+				auto found = batcher.batchOf.emplace(chunk->hash(), (uint32_t) batcher.out.batches.size());
+				if (found.second) {
+					MaterialBatch batch;
+					batch.material = chunk;
+					batch.buffer.layout = batcher.layout;
+					batch.buffer.vertexCount = 0;
+					batcher.out.batches.push_back(std::move(batch));
+					batcher.indices.emplace_back();
+				}
+				MaterialBatch& batch = batcher.out.batches[found.first->second];
+				std::vector<uint32_t>& indices = batcher.indices[found.first->second];
+				BatchRange range = {source, batch.buffer.vertexCount, 0, (uint32_t) indices.size(), 0};
+
+				// a new stamp forgets the vertices copied for the previous material
+				if (++batcher.stamp == 0) {
+					std::fill(batcher.stamps.begin(), batcher.stamps.end(), 0);
+					batcher.stamp = 1;
+				}
+				for (; i < runEnd; i++) {
+					auto& face = faces[order[i]];
+					uint32_t corners[3] = {face.vertex1, rewind ? face.vertex3 : face.vertex2,
+										   rewind ? face.vertex2 : face.vertex3};
+					for (uint32_t v : corners) {
+						if (batcher.stamps[v] != batcher.stamp) {
+							batcher.stamps[v] = batcher.stamp;
+							batcher.remap[v] = batch.buffer.vertexCount++;
+							const uint8_t* vertex = vertices + (size_t) v * stride;
+							batch.buffer.vertices.insert(batch.buffer.vertices.end(), vertex, vertex + stride);
+						}
+						indices.push_back(batcher.remap[v]);
+					}
+				}
+				range.vertexCount = batch.buffer.vertexCount - range.firstVertex;
+				range.indexCount = (uint32_t) indices.size() - range.firstIndex;
+				batch.ranges.push_back(range);
+			}
+		}
+
+		static inline geom::Vector3f cross(const geom::Vector3f& a, const geom::Vector3f& b) {
+			geom::Vector3f result = {a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x};
+			return result;
+		}
+
+		/// Adds an atomic's geometry moved by transform. Normals go through the cofactor matrix
+		/// (the inverse transpose up to scale) so they stay perpendicular under uneven scaling.
+		static void addPlacedGeometry(Batcher& batcher, GeometryChunk* geometry, const geom::Transform& transform) {
+			geom::MeshView mesh(geometry);
+			const geom::Matrix3x3f& m = transform.rotation;
+			geom::Matrix3x3f cofactor = {cross(m.row2, m.row3), cross(m.row3, m.row1), cross(m.row1, m.row2)};
+			float determinant = m.row1.x * cofactor.row1.x + m.row1.y * cofactor.row1.y + m.row1.z * cofactor.row1.z;
+
+			std::vector<geom::VertexPosition> positions;
+			if (mesh.positions) {
+				positions.resize(mesh.vertexCount);
+				for (uint32_t i = 0; i < mesh.vertexCount; i++) {
+					auto& p = mesh.positions[i];
+					geom::Vector3f moved = geom::transformPoint(transform, {p.x, p.y, p.z});
+					positions[i] = {moved.x, moved.y, moved.z};
+				}
+				mesh.positions = positions.data();
+			}
+
+			std::vector<geom::VertexNormal> normals;
+			if (mesh.normals) {
+				normals.resize(mesh.vertexCount);
+				geom::Transform normalTransform = {cofactor, {0, 0, 0}};
+				for (uint32_t i = 0; i < mesh.vertexCount; i++) {
+					auto& n = mesh.normals[i];
+					geom::Vector3f moved = geom::transformPoint(normalTransform, {n.x, n.y, n.z});
+					float length = std::sqrt(moved.x * moved.x + moved.y * moved.y + moved.z * moved.z);
+					float scale = length > 0 ? (determinant < 0 ? -1 : 1) / length : 0;
+					normals[i] = {moved.x * scale, moved.y * scale, moved.z * scale};
+				}
+				mesh.normals = normals.data();
+			}
+
+			addSource(batcher, mesh, geometry->materialList, determinant < 0);
+		}
+
+		bool buildStaticBatch(WorldChunk* world, const std::vector<ClumpPlacement>& clumps, const Layout& layout,
+							  StaticBatch& out, IndexWidth width) {
+			out.batches.clear();
+			out.sectionCount = 0;
+			out.sourceCount = 0;
+			if (!layout.validate()) {
+				return false;
+			}
+
+			Batcher batcher(layout, out);
+			if (world) {
+				WorldBsp bsp;
+				if (!bsp.build(world)) {
+					return false;
+				}
+				out.sectionCount = (uint32_t) bsp.sections.size();
+				for (auto section : bsp.sections) {
+					addSource(batcher, geom::MeshView(section), world->materialList, false);
+				}
+			}
+
+			std::vector<geom::Transform> frames;
+			for (auto& placement : clumps) {
+				ClumpChunk* clump = placement.clump;
+				if (!clump->frameList || !clump->geometryList) {
+					util::logger.warn("Cannot batch a clump without frames and geometry");
+					out.sourceCount += (uint32_t) clump->atomics.size();
+					continue;
+				}
+				computeFrameTransforms(clump->frameList, frames);
+				auto& geometries = clump->geometryList->geometries;
+				for (auto atomic : clump->atomics) {
+					if (atomic->frameIndex >= frames.size() || atomic->geometryIndex >= geometries.size()) {
+						util::logger.warn("Atomic has no frame or geometry to batch");
+						out.sourceCount++;
+						continue;
+					}
+					geom::Transform transform = geom::combineTransforms(frames[atomic->frameIndex], placement.transform);
+					addPlacedGeometry(batcher, geometries[atomic->geometryIndex], transform);
+				}
+			}
+
+			for (size_t b = 0; b < out.batches.size(); b++) {
+				VertexBuffer& buffer = out.batches[b].buffer;
+				const std::vector<uint32_t>& indices = batcher.indices[b];
+
+				bool wide = buffer.vertexCount > 0x10000;
+				if (width == INDEX_32) {
+					wide = true;
+				} else if (width == INDEX_16 && wide) {
+					util::logger.warn("Batch has %d vertices, using 32-bit indices", buffer.vertexCount);
+				}
+				buffer.indexSize = wide ? 4 : 2;
+				buffer.indexCount = (uint32_t) indices.size();
+				buffer.indices.resize((size_t) buffer.indexCount * buffer.indexSize);
+				if (wide) {
+					memcpy(buffer.indices.data(), indices.data(), indices.size() * sizeof(uint32_t));
+				} else {
+					geom::narrowIndices(indices.data(), (uint16_t*) buffer.indices.data(), indices.size());
+				}
+				buffer.isStrip = false;
+				Submesh submesh = {(uint32_t) b, 0, buffer.indexCount};
+				buffer.submeshes.assign(1, submesh);
+			}
+			return true;
+		}
+	}
+}
\ No newline at end of file
@@ -0,0 +1,368 @@
+/*
+ * File: bounds.cc
+ * Author: DeadlyFugu
+ * License: zlib
+ * Description: Computes bounding boxes and spheres of geometry and world sections
+ */
+
+#include "bounds.hh"
+
+#include <algorithm>
+#include <cmath>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace rw {
+	namespace geom {
+#ifdef __SSE2__
+		/// Loads four packed xyz positions and transposes them to one register per axis
+		static inline void loadPositions(const VertexPosition* positions, __m128& x, __m128& y, __m128& z) {
+			const float* p = &positions->x;
+			__m128 v0 = _mm_loadu_ps(p);     // x0 y0 z0 x1
+			__m128 v1 = _mm_loadu_ps(p + 4); // y1 z1 x2 y2
+			__m128 v2 = _mm_loadu_ps(p + 8); // z2 x3 y3 z3
+
+			__m128 x23 = _mm_shuffle_ps(v1, v2, _MM_SHUFFLE(1, 1, 2, 2));
+			x = _mm_shuffle_ps(v0, x23, _MM_SHUFFLE(2, 0, 3, 0));
+			__m128 y01 = _mm_shuffle_ps(v0, v1, _MM_SHUFFLE(0, 0, 1, 1));
+			__m128 y23 = _mm_shuffle_ps(v1, v2, _MM_SHUFFLE(2, 2, 3, 3));
+			y = _mm_shuffle_ps(y01, y23, _MM_SHUFFLE(2, 0, 2, 0));
+			__m128 z01 = _mm_shuffle_ps(v0, v1, _MM_SHUFFLE(1, 1, 2, 2));
+			z = _mm_shuffle_ps(z01, v2, _MM_SHUFFLE(3, 0, 2, 0));
+		}
+
+		static inline float horizontalMin(__m128 v) {
+			v = _mm_min_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+			v = _mm_min_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+			return _mm_cvtss_f32(v);
+		}
+
+		static inline float horizontalMax(__m128 v) {
+			v = _mm_max_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+			v = _mm_max_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+			return _mm_cvtss_f32(v);
+		}
+#endif
+
+		static inline float distanceSquared(const VertexPosition& p, const float centre[3]) {
+			float dx = p.x - centre[0];
+			float dy = p.y - centre[1];
+			float dz = p.z - centre[2];
+			return dx * dx + dy * dy + dz * dz;
+		}
+
+		bool computeAABB(const VertexPosition* positions, size_t count, AABB& box) {
+			if (!count) return false;
+
+			float min[3] = {positions[0].x, positions[0].y, positions[0].z};
+			float max[3] = {min[0], min[1], min[2]};
+			size_t i = 0;
+#ifdef __SSE2__
+			if (count >= 4) {
+				__m128 minX = _mm_set1_ps(min[0]), minY = _mm_set1_ps(min[1]), minZ = _mm_set1_ps(min[2]);
+				__m128 maxX = minX, maxY = minY, maxZ = minZ;
+				for (; i + 4 <= count; i += 4) {
+					__m128 x, y, z;
+					loadPositions(positions + i, x, y, z);
+					minX = _mm_min_ps(minX, x);
+					minY = _mm_min_ps(minY, y);
+					minZ = _mm_min_ps(minZ, z);
+					maxX = _mm_max_ps(maxX, x);
+					maxY = _mm_max_ps(maxY, y);
+					maxZ = _mm_max_ps(maxZ, z);
+				}
+				min[0] = horizontalMin(minX);
+				min[1] = horizontalMin(minY);
+				min[2] = horizontalMin(minZ);
+				max[0] = horizontalMax(maxX);
+				max[1] = horizontalMax(maxY);
+				max[2] = horizontalMax(maxZ);
+			}
+#endif
+			for (; i < count; i++) {
+				const float* p = &positions[i].x;
+				for (int axis = 0; axis < 3; axis++) {
+					min[axis] = std::min(min[axis], p[axis]);
+					max[axis] = std::max(max[axis], p[axis]);
+				}
+			}
+
+			box.min = {min[0], min[1], min[2]};
+			box.max = {max[0], max[1], max[2]};
+			return true;
+		}
+
+		/// Largest squared distance from centre to a position, and which position is that far
+		static float farthestPosition(const VertexPosition* positions, size_t count, const float centre[3],
+									  size_t& farthest) {
+			float best = -1.0f;
+			farthest = 0;
+			size_t i = 0;
+#ifdef __SSE2__
+			if (count >= 4) {
+				const __m128 cx = _mm_set1_ps(centre[0]), cy = _mm_set1_ps(centre[1]), cz = _mm_set1_ps(centre[2]);
+				__m128 bestDistance = _mm_set1_ps(-1.0f);
+				__m128i bestIndex = _mm_setzero_si128();
+				__m128i index = _mm_setr_epi32(0, 1, 2, 3);
+				const __m128i step = _mm_set1_epi32(4);
+				for (; i + 4 <= count; i += 4) {
+					__m128 x, y, z;
+					loadPositions(positions + i, x, y, z);
+					x = _mm_sub_ps(x, cx);
+					y = _mm_sub_ps(y, cy);
+					z = _mm_sub_ps(z, cz);
+					__m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z));
+
+					__m128 greater = _mm_cmpgt_ps(d, bestDistance);
+					bestDistance = _mm_or_ps(_mm_and_ps(greater, d), _mm_andnot_ps(greater, bestDistance));
+					__m128i mask = _mm_castps_si128(greater);
+					bestIndex = _mm_or_si128(_mm_and_si128(mask, index), _mm_andnot_si128(mask, bestIndex));
+					index = _mm_add_epi32(index, step);
+				}
+
+				float distances[4];
+				int32_t indices[4];
+				_mm_storeu_ps(distances, bestDistance);
+				_mm_storeu_si128((__m128i*) indices, bestIndex);
+				for (int lane = 0; lane < 4; lane++) {
+					if (distances[lane] > best) {
+						best = distances[lane];
+						farthest = (uint32_t) indices[lane];
+					}
+				}
+			}
+#endif
+			for (; i < count; i++) {
+				float d = distanceSquared(positions[i], centre);
+				if (d > best) {
+					best = d;
+					farthest = i;
+				}
+			}
+			return best;
+		}
+
+		/// Grows sphere just enough to take in a position outside it
+		static inline void growSphere(Sphere& sphere, const VertexPosition& p) {
+			float centre[3] = {sphere.x, sphere.y, sphere.z};
+			float d2 = distanceSquared(p, centre);
+			if (d2 <= sphere.radius * sphere.radius) return;
+			float d = std::sqrt(d2);
+			float radius = (sphere.radius + d) * 0.5f;
+			float shift = (d - radius) / d;
+			sphere.x += (p.x - sphere.x) * shift;
+			sphere.y += (p.y - sphere.y) * shift;
+			sphere.z += (p.z - sphere.z) * shift;
+			sphere.radius = radius;
+		}
+
+		/// Grows sphere over positions [first, last), testing four at a time and only growing
+		/// (in order) for groups with a position outside
+		static void growSphere(Sphere& sphere, const VertexPosition* positions, size_t first, size_t last) {
+			size_t i = first;
+#ifdef __SSE2__
+			for (; i + 4 <= last; i += 4) {
+				__m128 x, y, z;
+				loadPositions(positions + i, x, y, z);
+				x = _mm_sub_ps(x, _mm_set1_ps(sphere.x));
+				y = _mm_sub_ps(y, _mm_set1_ps(sphere.y));
+				z = _mm_sub_ps(z, _mm_set1_ps(sphere.z));
+				__m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z));
+				if (_mm_movemask_ps(_mm_cmpgt_ps(d, _mm_set1_ps(sphere.radius * sphere.radius)))) {
+					for (size_t j = i; j < i + 4; j++) {
+						growSphere(sphere, positions[j]);
+					}
+				}
+			}
+#endif
+			for (; i < last; i++) {
+				growSphere(sphere, positions[i]);
+			}
+		}
+
+		/// Iterations of shrinking and regrowing the sphere
+		static const int REFINE_ITERATIONS = 4;
+
+		bool computeBoundingSphere(const VertexPosition* positions, size_t count, Sphere& sphere) {
+			if (!count) return false;
+
+			// Ritter: sphere on the diameter between two far apart positions, grown over the rest
+			size_t a, b;
+			float origin[3] = {positions[0].x, positions[0].y, positions[0].z};
+			farthestPosition(positions, count, origin, a);
+			float pointA[3] = {positions[a].x, positions[a].y, positions[a].z};
+			float diameter = std::sqrt(farthestPosition(positions, count, pointA, b));
+			Sphere best = {(pointA[0] + positions[b].x) * 0.5f, (pointA[1] + positions[b].y) * 0.5f,
+						   (pointA[2] + positions[b].z) * 0.5f, diameter * 0.5f};
+			growSphere(best, positions, 0, count);
+
+			// refinement (Ericson, Real-Time Collision Detection 4.3.4): shrink, then grow back over
+			// the positions starting at a different place each time, keeping the smallest sphere
+			Sphere candidate = best;
+			for (int k = 0; k < REFINE_ITERATIONS; k++) {
+				candidate.radius *= 0.95f;
+				size_t start = count * k / REFINE_ITERATIONS;
+				growSphere(candidate, positions, start, count);
+				growSphere(candidate, positions, 0, start);
+				if (candidate.radius < best.radius) best = candidate;
+			}
+
+			// the sphere around the box centre is sometimes tighter, for near box-like shapes
+			AABB box;
+			computeAABB(positions, count, box);
+			float boxCentre[3] = {(box.min.x + box.max.x) * 0.5f, (box.min.y + box.max.y) * 0.5f,
+								  (box.min.z + box.max.z) * 0.5f};
+			size_t farthest;
+			float boxRadius = std::sqrt(farthestPosition(positions, count, boxCentre, farthest));
+			if (boxRadius < best.radius) {
+				best = {boxCentre[0], boxCentre[1], boxCentre[2], boxRadius};
+			}
+
+			// exact radius about the chosen centre, rounded up so every position is inside
+			float centre[3] = {best.x, best.y, best.z};
+			float radius = std::sqrt(farthestPosition(positions, count, centre, farthest));
+			best.radius = std::nextafter(radius, INFINITY);
+			sphere = best;
+			return true;
+		}
+	}
+
+	static DeltaMorphPLGChunk* findDeltaMorph(GeometryChunk* geometry) {
+		for (auto extension : geometry->extensions) {
+			if (!extension->isList()) continue;
+			for (auto child : ((ListChunk*) extension)->children) {
+				if (child->type == RW_DELTA_MORPH_PLG) {
+					return (DeltaMorphPLGChunk*) child;
+				}
+			}
+		}
+		return nullptr;
+	}
+
+	/// Applies a Delta Morph target's deltas to base positions. The mapping is run-length coded:
+	/// a byte with the top bit set covers that many morphed vertices, otherwise it skips vertices.
+	static bool applyDeltaMorph(const DeltaMorphPLGChunk::DMorphTarget& target,
+								std::vector<geom::VertexPosition>& positions) {
+		size_t vertex = 0, delta = 0;
+		for (uint8_t run : target.mapping) {
+			size_t length = run & 0x7f;
+			if (run & 0x80) {
+				if (vertex + length > positions.size() || delta + length > target.vertices.size()) {
+					util::logger.warn("Delta Morph target %s maps past the end of its geometry", target.name.c_str());
+					return false;
+				}
+				for (size_t i = 0; i < length; i++, vertex++, delta++) {
+					positions[vertex].x += target.vertices[delta].x;
+					positions[vertex].y += target.vertices[delta].y;
+					positions[vertex].z += target.vertices[delta].z;
+				}
+			} else {
+				vertex += length;
+			}
+		}
+		return true;
+	}
+
+	void updateBounds(GeometryChunk* geometry) {
+		bool changed = false;
+		for (auto& morphTarget : geometry->morphTargets) {
+			auto& positions = morphTarget.vertexPositions;
+			geom::Sphere sphere;
+			if (positions.size() == geometry->vertexCount
+				&& geom::computeBoundingSphere(positions.data(), positions.size(), sphere)) {
+				morphTarget.boundingSphere = {sphere.x, sphere.y, sphere.z, sphere.radius};
+				changed = true;
+			}
+		}
+		if (changed) geometry->preWriteHook();
+
+		DeltaMorphPLGChunk* deltaMorph = findDeltaMorph(geometry);
+		if (!deltaMorph || geometry->morphTargets.empty()) return;
+		auto& base = geometry->morphTargets[0].vertexPositions;
+		if (base.size() != geometry->vertexCount) return;
+
+		std::vector<geom::VertexPosition> positions;
+		for (auto& target : deltaMorph->targets) {
+			positions = base;
+			geom::Sphere sphere;
+			if (applyDeltaMorph(target, positions)
+				&& geom::computeBoundingSphere(positions.data(), positions.size(), sphere)) {
+				target.boundX = sphere.x;
+				target.boundY = sphere.y;
+				target.boundZ = sphere.z;
+				target.boundRadius = sphere.radius;
+			}
+		}
+		deltaMorph->preWriteHook();
+		for (auto extension : geometry->extensions) {
+			extension->invalidateHash();
+		}
+		geometry->invalidateHash();
+	}
+
+	void updateBounds(AtomicSectionChunk* section) {
+		geom::AABB box;
+		if (section->vertexPositions.size() != section->vertexCount
+			|| !geom::computeAABB(section->vertexPositions.data(), section->vertexCount, box)) {
+			return;
+		}
+		section->bboxMin[0] = box.min.x;
+		section->bboxMin[1] = box.min.y;
+		section->bboxMin[2] = box.min.z;
+		section->bboxMax[0] = box.max.x;
+		section->bboxMax[1] = box.max.y;
+		section->bboxMax[2] = box.max.z;
+		section->preWriteHook();
+	}
+
+	void updateBounds(WorldChunk* world) {
+		if (!world->rootSection) return;
+
+		bool empty = true;
+		float min[3], max[3];
+		std::vector<AbstractSectionChunk*> stack(1, world->rootSection);
+		while (!stack.empty()) {
+			AbstractSectionChunk* section = stack.back();
+			stack.pop_back();
+			if (!section) continue;
+			if (!section->isAtomic()) {
+				auto plane = (PlaneSectionChunk*) section;
+				stack.push_back(plane->right);
+				stack.push_back(plane->left);
+				plane->invalidateHash();
+				continue;
+			}
+
+			auto atomic = (AtomicSectionChunk*) section;
+			updateBounds(atomic);
+			if (!atomic->vertexCount) continue;
+			for (int axis = 0; axis < 3; axis++) {
+				min[axis] = empty ? atomic->bboxMin[axis] : std::min(min[axis], atomic->bboxMin[axis]);
+				max[axis] = empty ? atomic->bboxMax[axis] : std::max(max[axis], atomic->bboxMax[axis]);
+			}
+			empty = false;
+		}
+
+		if (!empty) {
+			std::copy(min, min + 3, world->bboxMin);
+			std::copy(max, max + 3, world->bboxMax);
+		}
+		world->preWriteHook();
+	}
+
+	void updateBounds(Chunk* root) {
+		if (auto geometry = dynamic_cast<GeometryChunk*>(root)) {
+			updateBounds(geometry);
+		} else if (auto world = dynamic_cast<WorldChunk*>(root)) {
+			updateBounds(world);
+		} else if (auto section = dynamic_cast<AtomicSectionChunk*>(root)) {
+			updateBounds(section);
+		} else if (root->isList()) {
+			for (auto child : ((ListChunk*) root)->children) {
+				updateBounds(child);
+			}
+			root->invalidateHash();
+		}
+	}
+}
\ No newline at end of file
@@ -0,0 +1,238 @@
+/*
+ * File: bsp.cc
+ * Author: DeadlyFugu
+ * License: zlib
+ * Description: Flattened copy of a world's section tree for fast spatial queries
+ */
+
+#include "bsp.hh"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace rw {
+	void WorldBsp::clear() {
+		nodes.clear();
+		planes.clear();
+		sections.clear();
+	}
+
+	bool WorldBsp::build(WorldChunk* world) {
+		clear();
+		if (!world->rootSection) return true;
+
+		// pre-order, left before right, so the left child follows its parent
+		std::vector<AbstractSectionChunk*> stack(1, world->rootSection);
+		while (!stack.empty()) {
+			AbstractSectionChunk* section = stack.back();
+			stack.pop_back();
+
+			BspNode node = {};
+			BspPlane plane = {0, 0};
+			if (section->isAtomic()) {
+				auto atomic = (AtomicSectionChunk*) section;
+				node.section = (uint32_t) sections.size();
+				sections.push_back(atomic);
+				for (int axis = 0; axis < 3; axis++) {
+					// an empty section overlaps nothing
+					node.min[axis] = atomic->vertexCount ? atomic->bboxMin[axis] : std::numeric_limits<float>::infinity();
+					node.max[axis] = atomic->vertexCount ? atomic->bboxMax[axis] : -std::numeric_limits<float>::infinity();
+				}
+			} else {
+				auto planeSection = (PlaneSectionChunk*) section;
+				if (!planeSection->left || !planeSection->right) {
+					util::logger.warn("Plane Section is missing a child");
+					clear();
+					return false;
+				}
+				if (planeSection->type != 0 && planeSection->type != 4 && planeSection->type != 8) {
+					util::logger.warn("Plane Section has unknown plane type %d", planeSection->type);
+					clear();
+					return false;
+				}
+				node.section = NONE;
+				plane.axis = planeSection->type / 4;
+				plane.value = planeSection->value;
+				stack.push_back(planeSection->right);
+				stack.push_back(planeSection->left);
+			}
+			nodes.push_back(node);
+			planes.push_back(plane);
+		}
+		finishNodes();
+		return true;
+	}
+
+	void WorldBsp::finishNodes() {
+		// children come after their parent, so finish nodes in reverse
+		for (size_t i = nodes.size(); i-- > 0;) {
+			BspNode& node = nodes[i];
+			if (node.section != NONE) {
+				node.skip = (uint32_t) i + 1;
+				continue;
+			}
+			const BspNode& left = nodes[i + 1];
+			const BspNode& right = nodes[left.skip];
+			for (int axis = 0; axis < 3; axis++) {
+				node.min[axis] = std::min(left.min[axis], right.min[axis]);
+				node.max[axis] = std::max(left.max[axis], right.max[axis]);
+			}
+			node.skip = right.skip;
+		}
+	}
+
+	uint32_t WorldBsp::locatePoint(const geom::Vector3f& point) const {
+		if (nodes.empty()) return NONE;
+		const float coordinates[3] = {point.x, point.y, point.z};
+		uint32_t i = 0;
+		while (nodes[i].section == NONE) {
+			const BspPlane& plane = planes[i];
+			i = coordinates[plane.axis] < plane.value ? i + 1 : nodes[i + 1].skip;
+		}
+		return nodes[i].section;
+	}
+
+	void WorldBsp::queryAABB(const geom::AABB& box, std::vector<uint32_t>& out) const {
+		const uint32_t count = (uint32_t) nodes.size();
+#ifdef __SSE2__
+		const __m128 queryMin = _mm_setr_ps(box.min.x, box.min.y, box.min.z, 0);
+		const __m128 queryMax = _mm_setr_ps(box.max.x, box.max.y, box.max.z, 0);
+#endif
+		uint32_t i = 0;
+		while (i < count) {
+			const BspNode& node = nodes[i];
+#ifdef __SSE2__
+			__m128 separated = _mm_or_ps(_mm_cmpgt_ps(_mm_loadu_ps(node.min), queryMax),
+										 _mm_cmplt_ps(_mm_loadu_ps(node.max), queryMin));
+			bool overlaps = (_mm_movemask_ps(separated) & 7) == 0;
+#else
+			bool overlaps = node.min[0] <= box.max.x && node.min[1] <= box.max.y && node.min[2] <= box.max.z
+							&& node.max[0] >= box.min.x && node.max[1] >= box.min.y && node.max[2] >= box.min.z;
+#endif
+			if (!overlaps) {
+				i = node.skip;
+				continue;
+			}
+			if (node.section != NONE) out.push_back(node.section);
+			i++;
+		}
+	}
+
+	void WorldBsp::querySphere(const geom::Sphere& sphere, std::vector<uint32_t>& out) const {
+		const uint32_t count = (uint32_t) nodes.size();
+		const float radiusSquared = sphere.radius * sphere.radius;
+#ifdef __SSE2__
+		const __m128 centre = _mm_setr_ps(sphere.x, sphere.y, sphere.z, 0);
+		const __m128 xyz = _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0));
+#endif
+		uint32_t i = 0;
+		while (i < count) {
+			const BspNode& node = nodes[i];
+			// squared distance from the centre to the box
+#ifdef __SSE2__
+			__m128 outside = _mm_max_ps(_mm_sub_ps(_mm_loadu_ps(node.min), centre),
+										_mm_sub_ps(centre, _mm_loadu_ps(node.max)));
+			outside = _mm_and_ps(_mm_max_ps(outside, _mm_setzero_ps()), xyz);
+			outside = _mm_mul_ps(outside, outside);
+			outside = _mm_add_ps(outside, _mm_movehl_ps(outside, outside));
+			outside = _mm_add_ss(outside, _mm_shuffle_ps(outside, outside, _MM_SHUFFLE(1, 1, 1, 1)));
+			float distanceSquared = _mm_cvtss_f32(outside);
+#else
+			const float centre[3] = {sphere.x, sphere.y, sphere.z};
+			float distanceSquared = 0;
+			for (int axis = 0; axis < 3; axis++) {
+				float d = std::max(std::max(node.min[axis] - centre[axis], centre[axis] - node.max[axis]), 0.0f);
+				distanceSquared += d * d;
+			}
+#endif
+			if (!(distanceSquared <= radiusSquared)) {
+				i = node.skip;
+				continue;
+			}
+			if (node.section != NONE) out.push_back(node.section);
+			i++;
+		}
+	}
+
+	void WorldBsp::appendSubtree(uint32_t node, std::vector<uint32_t>& out) const {
+		for (uint32_t i = node; i < nodes[node].skip; i++) {
+			if (nodes[i].section != NONE && nodes[i].min[0] <= nodes[i].max[0]) {
+				out.push_back(nodes[i].section);
+			}
+		}
+	}
+
+	void WorldBsp::queryFrustum(const geom::Frustum& frustum, std::vector<uint32_t>& out) const {
+		const uint32_t count = (uint32_t) nodes.size();
+
+		// planes as structure of arrays, padded with planes everything is inside
+		alignas(16) float normalX[8] = {}, normalY[8] = {}, normalZ[8] = {}, distance[8] = {};
+		for (int k = 0; k < 6; k++) {
+			normalX[k] = frustum.planes[k].normal.x;
+			normalY[k] = frustum.planes[k].normal.y;
+			normalZ[k] = frustum.planes[k].normal.z;
+			distance[k] = frustum.planes[k].distance;
+		}
+
+		uint32_t i = 0;
+		while (i < count) {
+			const BspNode& node = nodes[i];
+			if (!(node.min[0] <= node.max[0])) {
+				i = node.skip;
+				continue;
+			}
+
+			// each plane against the box's centre, compared with the box's extent along its normal
+			bool outside = false, inside = true;
+#ifdef __SSE2__
+			const __m128 half = _mm_set1_ps(0.5f);
+			const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+			__m128 min = _mm_loadu_ps(node.min), max = _mm_loadu_ps(node.max);
+			__m128 centre = _mm_mul_ps(_mm_add_ps(min, max), half);
+			__m128 extent = _mm_mul_ps(_mm_sub_ps(max, min), half);
+			__m128 cx = _mm_shuffle_ps(centre, centre, _MM_SHUFFLE(0, 0, 0, 0));
+			__m128 cy = _mm_shuffle_ps(centre, centre, _MM_SHUFFLE(1, 1, 1, 1));
+			__m128 cz = _mm_shuffle_ps(centre, centre, _MM_SHUFFLE(2, 2, 2, 2));
+			__m128 ex = _mm_shuffle_ps(extent, extent, _MM_SHUFFLE(0, 0, 0, 0));
+			__m128 ey = _mm_shuffle_ps(extent, extent, _MM_SHUFFLE(1, 1, 1, 1));
+			__m128 ez = _mm_shuffle_ps(extent, extent, _MM_SHUFFLE(2, 2, 2, 2));
+			for (int k = 0; k < 8; k += 4) {
+				__m128 nx = _mm_load_ps(normalX + k), ny = _mm_load_ps(normalY + k), nz = _mm_load_ps(normalZ + k);
+				__m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, cx), _mm_mul_ps(ny, cy)),
+									  _mm_add_ps(_mm_mul_ps(nz, cz), _mm_load_ps(distance + k)));
+				__m128 r = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_and_ps(nx, absMask), ex),
+												 _mm_mul_ps(_mm_and_ps(ny, absMask), ey)),
+									  _mm_mul_ps(_mm_and_ps(nz, absMask), ez));
+				outside |= _mm_movemask_ps(_mm_cmplt_ps(_mm_add_ps(d, r), _mm_setzero_ps())) != 0;
+				inside &= _mm_movemask_ps(_mm_cmpge_ps(d, r)) == 0xf;
+			}
+#else
+			float centre[3], extent[3];
+			for (int axis = 0; axis < 3; axis++) {
+				centre[axis] = (node.min[axis] + node.max[axis]) * 0.5f;
+				extent[axis] = (node.max[axis] - node.min[axis]) * 0.5f;
+			}
+			for (int k = 0; k < 6; k++) {
+				float d = normalX[k] * centre[0] + normalY[k] * centre[1] + normalZ[k] * centre[2] + distance[k];
+				float r = std::fabs(normalX[k]) * extent[0] + std::fabs(normalY[k]) * extent[1]
+						  + std::fabs(normalZ[k]) * extent[2];
+				outside |= d + r < 0;
+				inside &= d >= r;
+			}
+#endif
+			if (outside) {
+				i = node.skip;
+			} else if (inside) {
+				appendSubtree(i, out);
+				i = node.skip;
+			} else {
+				if (node.section != NONE) out.push_back(node.section);
+				i++;
+			}
+		}
+	}
+}
\ No newline at end of file
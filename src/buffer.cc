@@ -14,7 +14,7 @@ using rw::util::logger;
 
 namespace sk {
 
-	Buffer::Buffer(unsigned len, bool zeroed) : stretchy(false), owned(true) {
+	Buffer::Buffer(unsigned len, bool zeroed) : origin_offs(0), stretchy(false), owned(true) {
 		if (zeroed) {
 			base = (u8*) calloc(1, len);
 		} else {
@@ -25,7 +25,7 @@ namespace sk {
 		end = base + len;
 	}
 
-	Buffer::Buffer(void* src, unsigned len, bool owned) : stretchy(false), owned(owned) {
+	Buffer::Buffer(void* src, unsigned len, bool owned) : origin_offs(0), stretchy(false), owned(owned) {
 		base = (u8*) src;
 		head = base;
 		end = base + len;
@@ -38,7 +38,9 @@ namespace sk {
 	}
 
 	Buffer Buffer::view() {
-		return Buffer(base, size(), false);
+		Buffer result(base, size(), false);
+		result.origin_offs = origin_offs;
+		return result;
 	}
 
 	Buffer Buffer::view(unsigned start, unsigned len) {
@@ -46,7 +48,9 @@ namespace sk {
 			logger.error("view out of bounds");
 			exit(-1);
 		}
-		return Buffer(base + start, len, false);
+		Buffer result(base + start, len, false);
+		result.origin_offs = origin_offs + start;
+		return result;
 	}
 
 	Buffer Buffer::copy() {
@@ -90,6 +94,10 @@ namespace sk {
 		return (unsigned) (end - base);
 	}
 
+	unsigned Buffer::origin() {
+		return origin_offs;
+	}
+
 	unsigned Buffer::remaining() {
 		return (unsigned) (end - head);
 	}
@@ -12,8 +12,12 @@
 #include "texture.hh"
 #include "animation.hh"
 #include "geometry.hh"
+#include "meshlet.hh"
+#include "hash.hh"
 
+#include <deque>
 #include <unordered_map>
+#include <typeinfo>
 
 namespace std {
 	template<> struct hash<ChunkType> {
@@ -98,6 +102,9 @@ namespace rw {
 			case 0xF21E:
 				return "ZModeler Lock";
 				break;
+			case RW_MESHLET_PLG:
+				return "Meshlet PLG";
+				break;
 			default:
 				break;
 		}
@@ -144,16 +151,47 @@ namespace rw {
 		chunkTypeLoaders[RW_ATOMIC] = [](ChunkType type, uint32_t version){return (Chunk*) new AtomicChunk(type, version);};
 		chunkTypeLoaders[RW_CLUMP] = [](ChunkType type, uint32_t version){return (Chunk*) new ClumpChunk(type, version);};
 		chunkTypeLoaders[RW_DELTA_MORPH_PLG] = [](ChunkType type, uint32_t version){return (Chunk*) new DeltaMorphPLGChunk(type, version);};
+		chunkTypeLoaders[RW_MESHLET_PLG] = [](ChunkType type, uint32_t version){return (Chunk*) new MeshletPLGChunk(type, version);};
 
 		loadersWereInit = true;
 	}
 
-	Chunk* readChunk(util::Buffer& buf) {
+	Chunk* createChunk(ChunkType type, uint32_t version, util::Buffer& content) {
 		using namespace sk::types;
-		using util::logger;
 
 		if (!loadersWereInit) initLoaders();
 
+		auto itLoader = chunkTypeLoaders.find(type);
+		ChunkLoadFn loader;
+
+		if (itLoader == chunkTypeLoaders.end()) {
+			// try and guess whether struct or list type
+			if (content.size() >= 12) {
+				u32 childVersion;
+				content.seek(8);
+				content.read(&childVersion);
+				content.seek(0);
+				if (childVersion == version) {
+					loader = chunkTypeLoaders[(ChunkType) -1];
+				} else {
+					loader = chunkTypeLoaders[RW_STRUCT];
+				}
+			} else {
+				loader = chunkTypeLoaders[RW_STRUCT];
+			}
+		} else {
+			loader = itLoader->second;
+		}
+
+		return loader(type, version);
+	}
+
+	/// Reads a chunk header from buf and creates the chunk, leaving its body in content. Returns
+	/// nullptr (past the end of buf) if there is no valid chunk.
+	static Chunk* beginChunk(util::Buffer& buf, util::Buffer& content) {
+		using namespace sk::types;
+		using util::logger;
+
 		struct {
 			u32 type;
 			u32 size;
@@ -162,50 +200,189 @@ namespace rw {
 
 		if (buf.remaining() < 12) {
 			logger.warn("No chunk found");
+			buf.seek(buf.size());
 			return nullptr;
 		}
+		uint32_t offset = buf.origin() + buf.tell();
 		buf.read(&header);
 
 		if (buf.remaining() < header.size) {
-			logger.warn("Invalid chunk (size too large)");
-			// todo: somehow report offset of chunk in file (store file offs as extra param on buffer?)
+			logger.warn("Invalid chunk at 0x%x (size too large)", offset);
 			buf.seek(buf.size());
 			return nullptr;
 		}
 
-		util::Buffer content = buf.view(buf.tell(), header.size);
+		content = buf.view(buf.tell(), header.size);
 		buf.seek(buf.tell() + header.size);
 
-		auto itLoader = chunkTypeLoaders.find((ChunkType)header.type);
-		ChunkLoadFn loader;
+		Chunk* chunk = createChunk((ChunkType) header.type, header.version, content);
+		chunk->offset = offset;
+		return chunk;
+	}
 
-		if (itLoader == chunkTypeLoaders.end()) {
-			// try and guess whether struct or list type
-			if (content.size() >= 12) {
-				u32 version;
-				content.seek(8);
-				content.read(&version);
-				content.seek(0);
-				if (version == header.version) {
-					loader = chunkTypeLoaders[(ChunkType) -1];
-				} else {
-					loader = chunkTypeLoaders[RW_STRUCT];
-				}
+	/// Reads the children of list from in, and theirs in turn, from an explicit stack of lists
+	/// being read. Each list's postReadHook runs once all of its children are read, as it would
+	/// when recursing. Chunks deeper than maxDepth below list are skipped.
+	static void readChildren(ListChunk* list, util::Buffer& in, uint32_t maxDepth) {
+		struct Pending {
+			ListChunk* list;
+			util::Buffer content;
+		};
+		std::vector<Pending> stack;
+		stack.push_back({list, in.view(in.tell(), in.remaining())});
+		in.seek(in.size());
+
+		util::Buffer content(0);
+		while (!stack.empty()) {
+			Pending& top = stack.back();
+			if (!top.content.remaining()) {
+				ListChunk* finished = top.list;
+				stack.pop_back();
+				finished->postReadHook();
+				continue;
+			}
+
+			Chunk* chunk = beginChunk(top.content, content);
+			if (!chunk) continue;
+			if (stack.size() > maxDepth) {
+				util::logger.warn("Chunk at 0x%x is nested deeper than %d, skipping it", chunk->offset, maxDepth);
+				delete chunk;
+				continue;
+			}
+			top.list->addChild(chunk);
+			if (chunk->isList()) {
+				stack.push_back({(ListChunk*) chunk, std::move(content)});
 			} else {
-				loader = chunkTypeLoaders[RW_STRUCT];
+				chunk->read(content);
 			}
-		} else {
-			loader = itLoader->second;
 		}
+	}
 
-		Chunk* chunk = loader((ChunkType) header.type, header.version);
-		chunk->read(content);
+	Chunk* readChunk(util::Buffer& buf, uint32_t maxDepth) {
+		util::Buffer content(0);
+		Chunk* chunk = beginChunk(buf, content);
+		if (!chunk) return nullptr;
 
+		if (chunk->isList()) {
+			readChildren((ListChunk*) chunk, content, maxDepth);
+		} else {
+			chunk->read(content);
+		}
 		return chunk;
 	}
 
+	void visitChunks(Chunk* root, const std::function<bool(Chunk*, uint32_t)>& fn) {
+		std::vector<std::pair<Chunk*, uint32_t>> stack(1, std::make_pair(root, 0u));
+		while (!stack.empty()) {
+			auto entry = stack.back();
+			stack.pop_back();
+			if (!fn(entry.first, entry.second) || !entry.first->isList()) continue;
+
+			// pushed in reverse so the first child is visited first
+			auto& children = ((ListChunk*) entry.first)->children;
+			for (size_t i = children.size(); i-- > 0;) {
+				stack.push_back(std::make_pair(children[i], entry.second + 1));
+			}
+		}
+	}
+
+	Chunk* cloneChunk(Chunk* chunk) {
+		using namespace sk::types;
+
+		if (chunk->isList()) {
+			auto list = (ListChunk*) chunk;
+			// the first child's header is all createChunk needs to pick a class
+			u32 first[3] = {0, 0, 0};
+			if (!list->children.empty()) {
+				first[0] = list->children[0]->type;
+				first[2] = list->children[0]->version;
+			}
+			util::Buffer content(first, list->children.empty() ? 0 : sizeof(first), false);
+			auto clone = (ListChunk*) createChunk(chunk->type, chunk->version, content);
+			clone->offset = chunk->offset;
+			for (auto child : list->children) {
+				clone->addChild(cloneChunk(child));
+			}
+			clone->postReadHook();
+			return clone;
+		}
+
+		util::Buffer content = ((StructChunk*) chunk)->getBuffer().view();
+		Chunk* clone = createChunk(chunk->type, chunk->version, content);
+		clone->offset = chunk->offset;
+		// read copies the data, so the clone owns it
+		clone->read(content);
+		return clone;
+	}
+
+	uint64_t Chunk::hash() {
+		if (!hashValid) {
+			hashValue = computeHash();
+			hashValid = true;
+		}
+		return hashValue;
+	}
+
+	void Chunk::invalidateHash() {
+		hashValid = false;
+	}
+
+	/// seed shared by list and struct hashes, so chunk headers take part in the hash
+	static uint64_t headerSeed(ChunkType type, uint32_t version, bool isList) {
+		return ((uint64_t) type << 32 | version) ^ (isList ? 0x4c495354ULL << 32 : 0);
+	}
+
+	uint64_t hashStructChunk(ChunkType type, uint32_t version, const void* data, size_t size) {
+		return util::hash64(data, size, headerSeed(type, version, false));
+	}
+
+	uint64_t hashListChunk(ChunkType type, uint32_t version, const uint64_t* childHashes, size_t count) {
+		// merkle node: hash of the children's hashes
+		return util::hash64(childHashes, count * sizeof(uint64_t), headerSeed(type, version, true));
+	}
+
+	uint64_t ListChunk::computeHash() {
+		// hash uncached descendant lists bottom-up from an explicit stack first, so the hash()
+		// calls below only combine cached values however deep the tree is
+		std::vector<std::pair<ListChunk*, size_t>> stack(1, std::make_pair(this, (size_t) 0));
+		while (!stack.empty()) {
+			auto& top = stack.back();
+			if (top.second == top.first->children.size()) {
+				ListChunk* list = top.first;
+				stack.pop_back();
+				if (list != this) list->hash();
+				continue;
+			}
+			Chunk* child = top.first->children[top.second++];
+			if (child->isList() && !child->isHashCached()) {
+				stack.push_back(std::make_pair((ListChunk*) child, (size_t) 0));
+			}
+		}
+
+		std::vector<uint64_t> childHashes;
+		childHashes.reserve(children.size());
+		for (auto child : children) {
+			childHashes.push_back(child->hash());
+		}
+		return hashListChunk(type, version, childHashes.data(), childHashes.size());
+	}
+
+	uint64_t StructChunk::computeHash() {
+		return hashStructChunk(type, version, data.base_ptr(), data.size());
+	}
+
 	ListChunk::~ListChunk() {
-		for (auto chunk : children) {
+		// take each list's children before deleting it, so deep trees are freed without recursion
+		std::vector<Chunk*> pending;
+		pending.swap(children);
+		while (!pending.empty()) {
+			Chunk* chunk = pending.back();
+			pending.pop_back();
+			if (chunk->isList()) {
+				auto& grandchildren = ((ListChunk*) chunk)->children;
+				pending.insert(pending.end(), grandchildren.begin(), grandchildren.end());
+				grandchildren.clear();
+			}
 			delete chunk;
 		}
 	}
@@ -224,6 +401,15 @@ namespace rw {
 		return filtered;
 	}
 
+	StructChunk* ListChunk::getStruct() {
+		for (auto chunk : children) {
+			if (chunk->type == RW_STRUCT) {
+				return (StructChunk*) chunk;
+			}
+		}
+		return nullptr;
+	}
+
 	Chunk* ListChunk::getChild(int idx) {
 		return children[idx];
 	}
@@ -233,13 +419,7 @@ namespace rw {
 	}
 
 	void ListChunk::read(util::Buffer& in) {
-		while (in.remaining()) {
-			Chunk* chunk = readChunk(in);
-			if (chunk) {
-				addChild(chunk);
-			}
-		}
-		postReadHook();
+		readChildren(this, in, DEFAULT_MAX_CHUNK_DEPTH);
 	}
 
 	void ListChunk::write(util::Buffer& out) {
@@ -248,14 +428,35 @@ namespace rw {
 	}
 
 	void ListChunk::dump(util::DumpWriter out) {
+		// untyped lists below this one are expanded here from an explicit stack instead of through
+		// their own dump, so deeply nested unknown chunks do not recurse. Their writers live in a
+		// deque, as copying a writer indents it (just as passing one to dump does).
+		struct Pending {
+			ListChunk* list;
+			size_t next;
+			util::DumpWriter* writer;
+		};
+		std::deque<util::DumpWriter> writers;
+		std::vector<Pending> stack(1, Pending{this, 0, &out});
 		out.print("%s: (%d children)", getChunkName(type), children.size());
-
-		bool isFirstChild = true;
-		for (auto child : children) {
-			if (isFirstChild) isFirstChild = false;
-			else out.print("");
-
-			child->dump(out);
+		while (!stack.empty()) {
+			Pending& top = stack.back();
+			if (top.next == top.list->children.size()) {
+				stack.pop_back();
+				continue;
+			}
+			Chunk* child = top.list->children[top.next++];
+			util::DumpWriter* writer = top.writer;
+			if (top.next > 1) writer->print("");
+
+			if (typeid(*child) == typeid(ListChunk)) {
+				auto list = (ListChunk*) child;
+				writers.emplace_back(*writer);
+				writers.back().print("%s: (%d children)", getChunkName(list->type), list->children.size());
+				stack.push_back(Pending{list, 0, &writers.back()});
+			} else {
+				writer->spawn([child](util::DumpWriter& w) { child->dump(w); });
+			}
 		}
 	}
 
@@ -268,6 +469,16 @@ namespace rw {
 		postReadHook();
 	}
 
+	void StructChunk::readView(util::Buffer& in) {
+		data = in.view();
+		postReadHook();
+	}
+
+	void StructChunk::setData(util::Buffer&& content) {
+		data = std::move(content);
+		invalidateHash();
+	}
+
 	void StructChunk::write(util::Buffer& out) {
 		preWriteHook();
 		// todo: impl
@@ -285,4 +496,119 @@ namespace rw {
 	void StringChunk::dump(util::DumpWriter out) {
 		out.print("%s: \"%s\"", getChunkName(type), data.base_ptr());
 	}
+
+	void StructChunk::dumpJson(util::JsonWriter& out) {
+		dumpJsonBlob(out, "data", 0, data.size());
+	}
+
+	void StructChunk::dumpJsonBlob(util::JsonWriter& out, const char* name, uint32_t start, uint32_t size) {
+		out.blob(name, data, offset + 12, start, size);
+	}
+
+	void StringChunk::dumpJson(util::JsonWriter& out) {
+		out.field("value", (const char*) data.base_ptr());
+	}
+
+	/// Writes the members common to every chunk record. A typed list chunk decodes its Struct
+	/// child itself, so that child's raw data is left out to keep output proportional to metadata.
+	static void exportJsonHeader(Chunk* chunk, bool decodedByParent, util::JsonWriter& out) {
+		out.field("type", (uint32_t) chunk->type);
+		out.field("name", getChunkName(chunk->type));
+		out.field("version", util::unpackVersionNumber(chunk->version));
+		out.field("offset", chunk->offset);
+		char hash[17];
+		snprintf(hash, sizeof(hash), "%016llx", (unsigned long long) chunk->hash());
+		out.field("hash", (const char*) hash);
+		out.beginObject("fields");
+		if (!decodedByParent) {
+			chunk->dumpJson(out);
+		}
+		out.endObject();
+	}
+
+	static bool isTypedList(Chunk* chunk) {
+		return chunk->isList() && typeid(*chunk) != typeid(ListChunk);
+	}
+
+	void exportJson(Chunk* chunk, util::JsonWriter& out) {
+		// lists whose children are being written, kept on an explicit stack rather than recursing
+		struct Pending {
+			ListChunk* list;
+			size_t next;
+			bool typed;
+		};
+		std::vector<Pending> stack;
+		auto begin = [&](Chunk* chunk, bool decodedByParent) {
+			out.beginObject();
+			exportJsonHeader(chunk, decodedByParent, out);
+			if (chunk->isList()) {
+				out.beginArray("children");
+				stack.push_back(Pending{(ListChunk*) chunk, 0, isTypedList(chunk)});
+			} else {
+				out.endObject();
+			}
+		};
+
+		begin(chunk, false);
+		while (!stack.empty()) {
+			Pending& top = stack.back();
+			if (top.next == top.list->children.size()) {
+				stack.pop_back();
+				out.endArray();
+				out.endObject();
+				continue;
+			}
+			Chunk* child = top.list->children[top.next++];
+			begin(child, top.typed && child->type == RW_STRUCT);
+		}
+		out.endLine();
+	}
+
+	static void exportNdjsonChunk(Chunk* chunk, bool decodedByParent, const std::vector<uint32_t>& path, util::JsonWriter& out) {
+		out.beginObject();
+		out.beginArray("path");
+		for (auto idx : path) {
+			out.value(idx);
+		}
+		out.endArray();
+		exportJsonHeader(chunk, decodedByParent, out);
+		if (chunk->isList()) {
+			out.field("children", (uint32_t) ((ListChunk*) chunk)->children.size());
+		}
+		out.endObject();
+		out.endLine();
+	}
+
+	void exportNdjson(Chunk* chunk, util::JsonWriter& out) {
+		// path holds the index of each list below the root on the stack
+		struct Pending {
+			ListChunk* list;
+			uint32_t next;
+			bool typed;
+		};
+		std::vector<Pending> stack;
+		std::vector<uint32_t> path;
+
+		exportNdjsonChunk(chunk, false, path, out);
+		if (chunk->isList()) {
+			stack.push_back(Pending{(ListChunk*) chunk, 0, isTypedList(chunk)});
+		}
+		while (!stack.empty()) {
+			Pending& top = stack.back();
+			if (top.next == top.list->children.size()) {
+				stack.pop_back();
+				if (!stack.empty()) path.pop_back();
+				continue;
+			}
+			uint32_t idx = top.next++;
+			Chunk* child = top.list->children[idx];
+			path.push_back(idx);
+			exportNdjsonChunk(child, top.typed && child->type == RW_STRUCT, path, out);
+			if (child->isList()) {
+				stack.push_back(Pending{(ListChunk*) child, 0, isTypedList(child)});
+			} else {
+				path.pop_back();
+			}
+		}
+	}
 }
\ No newline at end of file
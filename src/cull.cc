@@ -0,0 +1,188 @@
+/*
+ * File: cull.cc
+ * Author: DeadlyFugu
+ * License: zlib
+ * Description: Culls the atomics of many clump instances against a frustum or sphere in batches
+ */
+
+#include "cull.hh"
+
+#include <algorithm>
+#include <cmath>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace rw {
+	bool computeClumpBounds(ClumpChunk* clump, ClumpBounds& bounds) {
+		bounds.spheres.clear();
+		if (!clump->frameList || !clump->geometryList) {
+			util::logger.warn("Cannot compute bounds of a clump without frames and geometry");
+			return false;
+		}
+
+		std::vector<geom::Transform> frames;
+		computeFrameTransforms(clump->frameList, frames);
+		auto& geometries = clump->geometryList->geometries;
+		for (auto atomic : clump->atomics) {
+			geom::Sphere sphere = {0, 0, 0, -1};
+			if (atomic->frameIndex >= frames.size() || atomic->geometryIndex >= geometries.size()
+				|| geometries[atomic->geometryIndex]->morphTargets.empty()) {
+				util::logger.warn("Atomic has no frame or geometry to place its bounds");
+				bounds.spheres.push_back(sphere);
+				continue;
+			}
+
+			auto& local = geometries[atomic->geometryIndex]->morphTargets[0].boundingSphere;
+			const geom::Transform& frame = frames[atomic->frameIndex];
+			geom::Vector3f centre = geom::transformPoint(frame, {local.x, local.y, local.z});
+			sphere.x = centre.x;
+			sphere.y = centre.y;
+			sphere.z = centre.z;
+			sphere.radius = local.radius * geom::maxScale(frame);
+			bounds.spheres.push_back(sphere);
+		}
+		return true;
+	}
+
+#ifdef __SSE2__
+	// tests take one sphere per lane and return the mask of lanes which pass
+	struct FrustumTest {
+		__m128 normalX[6], normalY[6], normalZ[6], distance[6];
+
+		explicit FrustumTest(const geom::Frustum& frustum) {
+			for (int k = 0; k < 6; k++) {
+				normalX[k] = _mm_set1_ps(frustum.planes[k].normal.x);
+				normalY[k] = _mm_set1_ps(frustum.planes[k].normal.y);
+				normalZ[k] = _mm_set1_ps(frustum.planes[k].normal.z);
+				distance[k] = _mm_set1_ps(frustum.planes[k].distance);
+			}
+		}
+
+		inline int operator()(__m128 x, __m128 y, __m128 z, __m128 r) const {
+			__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+			__m128 negativeR = _mm_sub_ps(_mm_setzero_ps(), r);
+			for (int k = 0; k < 6; k++) {
+				__m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(normalX[k], x), _mm_mul_ps(normalY[k], y)),
+									  _mm_add_ps(_mm_mul_ps(normalZ[k], z), distance[k]));
+				inside = _mm_and_ps(inside, _mm_cmpge_ps(d, negativeR));
+			}
+			return _mm_movemask_ps(inside);
+		}
+	};
+
+	struct SphereTest {
+		__m128 x, y, z, radius;
+
+		explicit SphereTest(const geom::Sphere& range)
+			: x(_mm_set1_ps(range.x)), y(_mm_set1_ps(range.y)), z(_mm_set1_ps(range.z)),
+			  radius(_mm_set1_ps(range.radius)) {}
+
+		inline int operator()(__m128 cx, __m128 cy, __m128 cz, __m128 r) const {
+			__m128 dx = _mm_sub_ps(cx, x), dy = _mm_sub_ps(cy, y), dz = _mm_sub_ps(cz, z);
+			__m128 distanceSquared = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+			__m128 reach = _mm_add_ps(r, radius);
+			return _mm_movemask_ps(_mm_cmple_ps(distanceSquared, _mm_mul_ps(reach, reach)));
+		}
+	};
+#else
+	struct FrustumTest {
+		const geom::Frustum& frustum;
+
+		explicit FrustumTest(const geom::Frustum& frustum) : frustum(frustum) {}
+
+		inline bool operator()(float x, float y, float z, float r) const {
+			for (auto& plane : frustum.planes) {
+				if (plane.normal.x * x + plane.normal.y * y + plane.normal.z * z + plane.distance < -r) return false;
+			}
+			return true;
+		}
+	};
+
+	struct SphereTest {
+		const geom::Sphere& range;
+
+		explicit SphereTest(const geom::Sphere& range) : range(range) {}
+
+		inline bool operator()(float x, float y, float z, float r) const {
+			float dx = x - range.x, dy = y - range.y, dz = z - range.z;
+			float reach = r + range.radius;
+			return dx * dx + dy * dy + dz * dz <= reach * reach;
+		}
+	};
+#endif
+
+	static_assert(sizeof(geom::Transform) == 12 * sizeof(float), "Transform is read as 12 floats");
+
+	template<typename Test>
+	static void cullBatches(const ClumpBounds& bounds, const geom::Transform* instances, size_t instanceCount,
+							const Test& test, std::vector<uint32_t>& visible) {
+		const auto& spheres = bounds.spheres;
+		const uint32_t atomicCount = (uint32_t) spheres.size();
+		if (!atomicCount) return;
+
+		// visible lanes of each atomic, so results can be written in instance order
+		std::vector<uint8_t> masks(atomicCount);
+		for (size_t first = 0; first < instanceCount; first += 4) {
+			size_t lanes = std::min<size_t>(4, instanceCount - first);
+#ifdef __SSE2__
+			// transpose four transforms into one register per element, repeating the last instance
+			alignas(16) float elements[12][4];
+			for (size_t lane = 0; lane < 4; lane++) {
+				const geom::Transform& t = instances[first + std::min(lane, lanes - 1)];
+				const float* source = &t.rotation.row1.x;
+				for (int e = 0; e < 12; e++) elements[e][lane] = source[e];
+			}
+			__m128 m[12];
+			for (int e = 0; e < 12; e++) m[e] = _mm_load_ps(elements[e]);
+			__m128 scale = _mm_max_ps(_mm_max_ps(
+				_mm_add_ps(_mm_add_ps(_mm_mul_ps(m[0], m[0]), _mm_mul_ps(m[1], m[1])), _mm_mul_ps(m[2], m[2])),
+				_mm_add_ps(_mm_add_ps(_mm_mul_ps(m[3], m[3]), _mm_mul_ps(m[4], m[4])), _mm_mul_ps(m[5], m[5]))),
+				_mm_add_ps(_mm_add_ps(_mm_mul_ps(m[6], m[6]), _mm_mul_ps(m[7], m[7])), _mm_mul_ps(m[8], m[8])));
+			scale = _mm_sqrt_ps(scale);
+
+			const int laneMask = (1 << lanes) - 1;
+			for (uint32_t a = 0; a < atomicCount; a++) {
+				const geom::Sphere& sphere = spheres[a];
+				if (sphere.radius < 0) {
+					masks[a] = 0;
+					continue;
+				}
+				__m128 sx = _mm_set1_ps(sphere.x), sy = _mm_set1_ps(sphere.y), sz = _mm_set1_ps(sphere.z);
+				__m128 x = _mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, m[0]), _mm_mul_ps(sy, m[3])), _mm_add_ps(_mm_mul_ps(sz, m[6]), m[9]));
+				__m128 y = _mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, m[1]), _mm_mul_ps(sy, m[4])), _mm_add_ps(_mm_mul_ps(sz, m[7]), m[10]));
+				__m128 z = _mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, m[2]), _mm_mul_ps(sy, m[5])), _mm_add_ps(_mm_mul_ps(sz, m[8]), m[11]));
+				__m128 r = _mm_mul_ps(_mm_set1_ps(sphere.radius), scale);
+				masks[a] = (uint8_t) (test(x, y, z, r) & laneMask);
+			}
+#else
+			for (uint32_t a = 0; a < atomicCount; a++) {
+				const geom::Sphere& sphere = spheres[a];
+				masks[a] = 0;
+				if (sphere.radius < 0) continue;
+				for (size_t lane = 0; lane < lanes; lane++) {
+					const geom::Transform& t = instances[first + lane];
+					geom::Vector3f centre = geom::transformPoint(t, {sphere.x, sphere.y, sphere.z});
+					if (test(centre.x, centre.y, centre.z, sphere.radius * geom::maxScale(t))) masks[a] |= 1 << lane;
+				}
+			}
+#endif
+			for (size_t lane = 0; lane < lanes; lane++) {
+				uint32_t base = (uint32_t) (first + lane) * atomicCount;
+				for (uint32_t a = 0; a < atomicCount; a++) {
+					if (masks[a] >> lane & 1) visible.push_back(base + a);
+				}
+			}
+		}
+	}
+
+	void cullInstances(const ClumpBounds& bounds, const geom::Transform* instances, size_t instanceCount,
+					   const geom::Frustum& frustum, std::vector<uint32_t>& visible) {
+		cullBatches(bounds, instances, instanceCount, FrustumTest(frustum), visible);
+	}
+
+	void cullInstances(const ClumpBounds& bounds, const geom::Transform* instances, size_t instanceCount,
+					   const geom::Sphere& range, std::vector<uint32_t>& visible) {
+		cullBatches(bounds, instances, instanceCount, SphereTest(range), visible);
+	}
+}
\ No newline at end of file
@@ -0,0 +1,484 @@
+/*
+ * File: diff.cc
+ * Author: DeadlyFugu
+ * License: zlib
+ * Description: Structural comparison of two chunk trees
+ */
+
+#include "diff.hh"
+#include "material.hh"
+#include "world.hh"
+#include "texture.hh"
+#include "animation.hh"
+#include "geometry.hh"
+
+#include <cstring>
+#include <deque>
+#include <typeinfo>
+#include <unordered_map>
+
+namespace rw {
+	/// Collects descriptions of differing fields
+	class FieldDiffs {
+	public:
+		std::vector<std::string>& out;
+
+		FieldDiffs(std::vector<std::string>& out) : out(out) {}
+
+		void add(const char* format, ...) {
+			char buffer[512];
+			va_list args;
+			va_start(args, format);
+			vsnprintf(buffer, sizeof(buffer), format, args);
+			va_end(args);
+			out.push_back(buffer);
+		}
+
+		void compare(const char* name, uint32_t a, uint32_t b) {
+			if (a != b) add("%s: %u -> %u", name, a, b);
+		}
+
+		void compareHex(const char* name, uint32_t a, uint32_t b) {
+			if (a != b) add("%s: 0x%08x -> 0x%08x", name, a, b);
+		}
+
+		void compareFloat(const char* name, float a, float b) {
+			if (memcmp(&a, &b, sizeof(float))) add("%s: %g -> %g", name, a, b);
+		}
+
+		void compareFloat(const char* name, const float* a, const float* b, int count) {
+			for (int i = 0; i < count; i++) {
+				if (memcmp(&a[i], &b[i], sizeof(float))) {
+					char label[128];
+					snprintf(label, sizeof(label), "%s[%d]", name, i);
+					compareFloat(label, a[i], b[i]);
+				}
+			}
+		}
+
+		void compare(const char* name, const std::string& a, const std::string& b) {
+			if (a != b) add("%s: \"%s\" -> \"%s\"", name, a.c_str(), b.c_str());
+		}
+
+		/// Reports which element ranges differ between two arrays of fixed-size elements
+		void compareArray(const char* name, const void* a, size_t countA, const void* b, size_t countB, size_t stride) {
+			size_t common = countA < countB ? countA : countB;
+			auto pa = (const uint8_t*) a;
+			auto pb = (const uint8_t*) b;
+			if (countA == countB && (!common || !memcmp(pa, pb, common * stride))) return;
+
+			std::string ranges;
+			size_t differing = 0;
+			int rangesShown = 0;
+			size_t i = 0;
+			while (i < common) {
+				// skip equal runs in large blocks before going element by element
+				size_t block = 64;
+				while (i + block <= common && !memcmp(pa + i * stride, pb + i * stride, block * stride)) i += block;
+				if (i >= common) break;
+				if (!memcmp(pa + i * stride, pb + i * stride, stride)) {
+					i++;
+					continue;
+				}
+
+				size_t start = i;
+				while (i < common && memcmp(pa + i * stride, pb + i * stride, stride)) i++;
+				differing += i - start;
+				if (rangesShown < 8) {
+					char range[48];
+					if (i - start == 1) snprintf(range, sizeof(range), "%s%zu", rangesShown ? ", " : "", start);
+					else snprintf(range, sizeof(range), "%s%zu-%zu", rangesShown ? ", " : "", start, i - 1);
+					ranges += range;
+				} else if (rangesShown == 8) {
+					ranges += ", ...";
+				}
+				rangesShown++;
+			}
+
+			if (countA != countB) {
+				add("%s: %zu -> %zu entries, %zu of first %zu differ%s%s%s", name, countA, countB, differing, common,
+					differing ? " (" : "", ranges.c_str(), differing ? ")" : "");
+			} else {
+				add("%s: %zu of %zu differ (%s)", name, differing, common, ranges.c_str());
+			}
+		}
+
+		template<typename T>
+		void compareArray(const char* name, const std::vector<T>& a, const std::vector<T>& b) {
+			compareArray(name, a.data(), a.size(), b.data(), b.size(), sizeof(T));
+		}
+
+		/// Compares index arrays by value, whichever width each is stored at
+		void compareArray(const char* name, const geom::IndexArray& a, const geom::IndexArray& b) {
+			std::vector<uint32_t> wideA, wideB;
+			a.toVector(wideA);
+			b.toVector(wideB);
+			compareArray(name, wideA, wideB);
+		}
+
+		/// Reports the size change and count of differing bytes in two raw buffers
+		void compareBytes(const char* name, util::Buffer& a, util::Buffer& b) {
+			compareArray(name, a.base_ptr(), a.size(), b.base_ptr(), b.size(), 1);
+		}
+	};
+
+	static void diffGeometry(GeometryChunk* a, GeometryChunk* b, FieldDiffs& out) {
+		out.compareHex("format", a->format, b->format);
+		out.compare("triangle count", a->triangleCount, b->triangleCount);
+		out.compare("vertex count", a->vertexCount, b->vertexCount);
+		out.compare("target count", a->morphTargetCount, b->morphTargetCount);
+		if (a->hasSurfaceProperties && b->hasSurfaceProperties) {
+			out.compareFloat("ambient", a->ambient, b->ambient);
+			out.compareFloat("specular", a->specular, b->specular);
+			out.compareFloat("diffuse", a->diffuse, b->diffuse);
+		}
+
+		out.compareArray("vertex colors", a->vertexColors, b->vertexColors);
+		out.compare("vertex uv layer count", (uint32_t) a->vertexUVLayers.size(), (uint32_t) b->vertexUVLayers.size());
+		for (size_t i = 0; i < a->vertexUVLayers.size() && i < b->vertexUVLayers.size(); i++) {
+			char label[48];
+			snprintf(label, sizeof(label), "vertex uv layer %zu", i);
+			out.compareArray(label, a->vertexUVLayers[i], b->vertexUVLayers[i]);
+		}
+		out.compareArray("faces", a->faces, b->faces);
+
+		for (size_t i = 0; i < a->morphTargets.size() && i < b->morphTargets.size(); i++) {
+			auto& targetA = a->morphTargets[i];
+			auto& targetB = b->morphTargets[i];
+			char label[64];
+			snprintf(label, sizeof(label), "morph target %zu bounding sphere", i);
+			out.compareFloat(label, &targetA.boundingSphere.x, &targetB.boundingSphere.x, 4);
+			snprintf(label, sizeof(label), "morph target %zu vertex positions", i);
+			out.compareArray(label, targetA.vertexPositions, targetB.vertexPositions);
+			snprintf(label, sizeof(label), "morph target %zu vertex normals", i);
+			out.compareArray(label, targetA.vertexNormals, targetB.vertexNormals);
+		}
+	}
+
+	static void diffTextureNative(TextureNative* a, TextureNative* b, FieldDiffs& out) {
+		out.compare("name", a->name, b->name);
+		out.compare("mask", a->maskName, b->maskName);
+		out.compare("platform", a->platformId, b->platformId);
+		out.compare("filter mode", (uint32_t) a->filterMode, (uint32_t) b->filterMode);
+		out.compare("address U mode", (uint32_t) a->addressUMode, (uint32_t) b->addressUMode);
+		out.compare("address V mode", (uint32_t) a->addressVMode, (uint32_t) b->addressVMode);
+		out.compareHex("format", a->format, b->format);
+		out.compare("has alpha", a->hasAlpha, b->hasAlpha);
+		out.compare("width", a->width, b->width);
+		out.compare("height", a->height, b->height);
+		out.compare("depth", a->depth, b->depth);
+		out.compare("mip levels", a->mipLevels, b->mipLevels);
+		out.compare("compression", a->compression, b->compression);
+
+		if (a->palette && b->palette) {
+			size_t sizeA = (a->format & RASTER_PAL4) ? 32 : 256;
+			size_t sizeB = (b->format & RASTER_PAL4) ? 32 : 256;
+			out.compareArray("palette", a->palette, sizeA, b->palette, sizeB, 4);
+		} else if (a->palette || b->palette) {
+			out.add("palette: %s -> %s", a->palette ? "present" : "none", b->palette ? "present" : "none");
+		}
+
+		for (size_t i = 0; i < a->mipmaps.size() && i < b->mipmaps.size(); i++) {
+			auto& mipA = a->mipmaps[i];
+			auto& mipB = b->mipmaps[i];
+			if (mipA.size != mipB.size) {
+				out.add("mip level %zu: %u -> %u bytes", i, mipA.size, mipB.size);
+			} else if (memcmp(mipA.data, mipB.data, mipA.size)) {
+				size_t differing = 0;
+				for (uint32_t j = 0; j < mipA.size; j++) {
+					if (mipA.data[j] != mipB.data[j]) differing++;
+				}
+				out.add("mip level %zu: %zu of %u bytes differ", i, differing, mipA.size);
+			}
+		}
+		if (a->mipmaps.size() != b->mipmaps.size()) {
+			out.add("stored mip levels: %zu -> %zu", a->mipmaps.size(), b->mipmaps.size());
+		}
+	}
+
+	static void diffAtomicSection(AtomicSectionChunk* a, AtomicSectionChunk* b, FieldDiffs& out) {
+		out.compareHex("model flags", a->modelFlags, b->modelFlags);
+		out.compare("triangle count", a->faceCount, b->faceCount);
+		out.compare("vertex count", a->vertexCount, b->vertexCount);
+		out.compareFloat("bbox max", a->bboxMax, b->bboxMax, 3);
+		out.compareFloat("bbox min", a->bboxMin, b->bboxMin, 3);
+		out.compareArray("vertex positions", a->vertexPositions, b->vertexPositions);
+		out.compareArray("vertex colors", a->vertexColors, b->vertexColors);
+		out.compareArray("vertex uvs", a->vertexUVs, b->vertexUVs);
+		out.compareArray("faces", a->faces, b->faces);
+	}
+
+	static void diffBinMesh(BinMeshPLGChunk* a, BinMeshPLGChunk* b, FieldDiffs& out) {
+		out.compare("flags", a->flags, b->flags);
+		out.compare("object count", a->objectCount, b->objectCount);
+		out.compare("total index count", a->indexCount, b->indexCount);
+		for (size_t i = 0; i < a->objects.size() && i < b->objects.size(); i++) {
+			char label[48];
+			snprintf(label, sizeof(label), "mesh %zu material", i);
+			out.compare(label, a->objects[i].material, b->objects[i].material);
+			snprintf(label, sizeof(label), "mesh %zu indices", i);
+			out.compareArray(label, a->objects[i].indices, b->objects[i].indices);
+		}
+	}
+
+	static void diffFrameList(FrameListChunk* a, FrameListChunk* b, FieldDiffs& out) {
+		out.compareArray("frames", a->frames, b->frames);
+	}
+
+	static void diffMaterial(MaterialChunk* a, MaterialChunk* b, FieldDiffs& out) {
+		out.compareHex("flags", a->flags, b->flags);
+		out.compareHex("color", a->color, b->color);
+		out.compare("is textured", a->isTextured, b->isTextured);
+		if (a->hasSurfaceProperties && b->hasSurfaceProperties) {
+			out.compareFloat("ambient", a->ambient, b->ambient);
+			out.compareFloat("specular", a->specular, b->specular);
+			out.compareFloat("diffuse", a->diffuse, b->diffuse);
+		}
+	}
+
+	static void diffTexture(TextureChunk* a, TextureChunk* b, FieldDiffs& out) {
+		out.compare("filter mode", (uint32_t) a->filterMode, (uint32_t) b->filterMode);
+		out.compare("address U mode", (uint32_t) a->addressUMode, (uint32_t) b->addressUMode);
+		out.compare("address V mode", (uint32_t) a->addressVMode, (uint32_t) b->addressVMode);
+		out.compare("use mip levels", a->useMipLevels, b->useMipLevels);
+		out.compare("texture name", a->textureName, b->textureName);
+		out.compare("mask name", a->maskName, b->maskName);
+	}
+
+	static void diffAtomic(AtomicChunk* a, AtomicChunk* b, FieldDiffs& out) {
+		out.compare("frame", a->frameIndex, b->frameIndex);
+		out.compare("geometry", a->geometryIndex, b->geometryIndex);
+		out.compareHex("flags", a->flags, b->flags);
+	}
+
+	static void diffClump(ClumpChunk* a, ClumpChunk* b, FieldDiffs& out) {
+		out.compare("atomic count", a->atomicCount, b->atomicCount);
+	}
+
+	static void diffGeometryList(GeometryListChunk* a, GeometryListChunk* b, FieldDiffs& out) {
+		out.compare("geometry count", (uint32_t) a->geometries.size(), (uint32_t) b->geometries.size());
+	}
+
+	static void diffMaterialList(MaterialListChunk* a, MaterialListChunk* b, FieldDiffs& out) {
+		out.compare("material count", (uint32_t) a->materials.size(), (uint32_t) b->materials.size());
+	}
+
+	static void diffTextureDictionary(TextureDictionary* a, TextureDictionary* b, FieldDiffs& out) {
+		out.compare("texture count", a->textureCount, b->textureCount);
+		out.compare("device id", a->deviceId, b->deviceId);
+	}
+
+	static void diffPlaneSection(PlaneSectionChunk* a, PlaneSectionChunk* b, FieldDiffs& out) {
+		out.compare("type", a->type, b->type);
+		out.compareFloat("value", a->value, b->value);
+		out.compareFloat("leftValue", a->leftValue, b->leftValue);
+		out.compareFloat("rightValue", a->rightValue, b->rightValue);
+	}
+
+	static void diffWorld(WorldChunk* a, WorldChunk* b, FieldDiffs& out) {
+		out.compare("face count", a->faceCount, b->faceCount);
+		out.compare("vertex count", a->vertexCount, b->vertexCount);
+		out.compareFloat("bbox max", a->bboxMax, b->bboxMax, 3);
+		out.compareFloat("bbox min", a->bboxMin, b->bboxMin, 3);
+	}
+
+	static void diffAnimation(AnimAnimationChunk* a, AnimAnimationChunk* b, FieldDiffs& out) {
+		out.compare("interpolation type", a->interpolationType, b->interpolationType);
+		out.compare("frame count", a->frameCount, b->frameCount);
+		out.compareHex("flags", a->flags, b->flags);
+		out.compareFloat("duration", a->duration, b->duration);
+		out.compareArray("frames", a->frames, b->frames);
+	}
+
+	static void diffDeltaMorph(DeltaMorphPLGChunk* a, DeltaMorphPLGChunk* b, FieldDiffs& out) {
+		out.compare("target count", (uint32_t) a->targets.size(), (uint32_t) b->targets.size());
+		for (size_t i = 0; i < a->targets.size() && i < b->targets.size(); i++) {
+			auto& targetA = a->targets[i];
+			auto& targetB = b->targets[i];
+			char label[64];
+			snprintf(label, sizeof(label), "target %zu name", i);
+			out.compare(label, targetA.name, targetB.name);
+			snprintf(label, sizeof(label), "target %zu mapping", i);
+			out.compareArray(label, targetA.mapping, targetB.mapping);
+			snprintf(label, sizeof(label), "target %zu vertices", i);
+			out.compareArray(label, targetA.vertices, targetB.vertices);
+			snprintf(label, sizeof(label), "target %zu normals", i);
+			out.compareArray(label, targetA.normals, targetB.normals);
+		}
+	}
+
+	/// Compares the decoded fields of two chunks of the same type
+	static void diffFields(Chunk* a, Chunk* b, FieldDiffs& out) {
+		switch (a->type) {
+			case RW_GEOMETRY:
+				diffGeometry((GeometryChunk*) a, (GeometryChunk*) b, out);
+				break;
+			case RW_TEXTURE_NATIVE:
+				diffTextureNative((TextureNative*) a, (TextureNative*) b, out);
+				break;
+			case RW_ATOMIC_SECTION:
+				diffAtomicSection((AtomicSectionChunk*) a, (AtomicSectionChunk*) b, out);
+				break;
+			case RW_BINMESH_PLG:
+				diffBinMesh((BinMeshPLGChunk*) a, (BinMeshPLGChunk*) b, out);
+				break;
+			case RW_FRAME_LIST:
+				diffFrameList((FrameListChunk*) a, (FrameListChunk*) b, out);
+				break;
+			case RW_MATERIAL:
+				diffMaterial((MaterialChunk*) a, (MaterialChunk*) b, out);
+				break;
+			case RW_TEXTURE:
+				diffTexture((TextureChunk*) a, (TextureChunk*) b, out);
+				break;
+			case RW_ATOMIC:
+				diffAtomic((AtomicChunk*) a, (AtomicChunk*) b, out);
+				break;
+			case RW_CLUMP:
+				diffClump((ClumpChunk*) a, (ClumpChunk*) b, out);
+				break;
+			case RW_GEOMETRY_LIST:
+				diffGeometryList((GeometryListChunk*) a, (GeometryListChunk*) b, out);
+				break;
+			case RW_MATERIAL_LIST:
+				diffMaterialList((MaterialListChunk*) a, (MaterialListChunk*) b, out);
+				break;
+			case RW_TEXTURE_DICT:
+				diffTextureDictionary((TextureDictionary*) a, (TextureDictionary*) b, out);
+				break;
+			case RW_PLANE_SECTION:
+				diffPlaneSection((PlaneSectionChunk*) a, (PlaneSectionChunk*) b, out);
+				break;
+			case RW_WORLD:
+				diffWorld((WorldChunk*) a, (WorldChunk*) b, out);
+				break;
+			case RW_ANIM_ANIMATION:
+				diffAnimation((AnimAnimationChunk*) a, (AnimAnimationChunk*) b, out);
+				break;
+			case RW_DELTA_MORPH_PLG:
+				diffDeltaMorph((DeltaMorphPLGChunk*) a, (DeltaMorphPLGChunk*) b, out);
+				break;
+			default:
+				break;
+		}
+	}
+
+	static bool isTypedList(Chunk* chunk) {
+		return chunk->isList() && typeid(*chunk) != typeid(ListChunk);
+	}
+
+	static void diffTree(Chunk* a, Chunk* b, const std::string& path, bool decodedByParent, std::vector<ChunkDiff>& diffs) {
+		if (a->hash() == b->hash()) return;
+		// a typed parent already reported the decoded contents of its struct
+		if (decodedByParent && a->type == b->type) return;
+
+		ChunkDiff diff;
+		diff.kind = ChunkDiff::CHANGED;
+		diff.path = path;
+		diff.a = a;
+		diff.b = b;
+		FieldDiffs fields(diff.fields);
+
+		if (a->type != b->type || a->isList() != b->isList()) {
+			fields.add("type: %s -> %s", getChunkName(a->type), getChunkName(b->type));
+			diffs.push_back(diff);
+			return;
+		}
+
+		fields.compareHex("version", a->version, b->version);
+		diffFields(a, b, fields);
+
+		if (!a->isList()) {
+			if (diff.fields.empty()) {
+				fields.compareBytes("bytes", ((StructChunk*) a)->getBuffer(), ((StructChunk*) b)->getBuffer());
+			}
+			diffs.push_back(diff);
+			return;
+		}
+
+		bool typed = isTypedList(a);
+		if (typed && diff.fields.empty()) {
+			// catch changes to struct bytes which are not decoded
+			StructChunk* structA = ((ListChunk*) a)->getStruct();
+			StructChunk* structB = ((ListChunk*) b)->getStruct();
+			if (structA && structB && structA->hash() != structB->hash()) {
+				fields.compareBytes("struct bytes", structA->getBuffer(), structB->getBuffer());
+			}
+		}
+		if (!diff.fields.empty()) {
+			diffs.push_back(diff);
+		}
+
+		// pair children with equal subtrees first, so an insertion does not shift every later
+		// sibling, then pair the rest by type and position among unpaired siblings of that type
+		auto& childrenA = ((ListChunk*) a)->children;
+		auto& childrenB = ((ListChunk*) b)->children;
+		const size_t NONE = (size_t) -1;
+		std::vector<size_t> partnerA(childrenA.size(), NONE);
+		std::vector<size_t> partnerB(childrenB.size(), NONE);
+		std::unordered_map<uint64_t, std::deque<size_t>> byHashB;
+		for (size_t j = 0; j < childrenB.size(); j++) {
+			byHashB[childrenB[j]->hash()].push_back(j);
+		}
+		for (size_t i = 0; i < childrenA.size(); i++) {
+			auto found = byHashB.find(childrenA[i]->hash());
+			if (found == byHashB.end() || found->second.empty()) continue;
+			partnerA[i] = found->second.front();
+			partnerB[partnerA[i]] = i;
+			found->second.pop_front();
+		}
+
+		std::unordered_map<uint32_t, std::deque<size_t>> unpairedB;
+		for (size_t j = 0; j < childrenB.size(); j++) {
+			if (partnerB[j] == NONE) unpairedB[childrenB[j]->type].push_back(j);
+		}
+		for (size_t i = 0; i < childrenA.size(); i++) {
+			if (partnerA[i] != NONE) continue;
+			auto& candidates = unpairedB[childrenA[i]->type];
+			if (candidates.empty()) continue;
+			partnerA[i] = candidates.front();
+			partnerB[partnerA[i]] = i;
+			candidates.pop_front();
+		}
+
+		// paths index children among siblings of the same type in their own tree
+		std::unordered_map<uint32_t, size_t> countA, countB;
+		for (auto child : childrenA) {
+			countA[child->type]++;
+		}
+		for (auto child : childrenB) {
+			countB[child->type]++;
+		}
+		auto childPath = [&](Chunk* child, size_t idx) {
+			std::string result = path + "/" + getChunkName(child->type);
+			if (countA[child->type] > 1 || countB[child->type] > 1) {
+				result += "[" + std::to_string(idx) + "]";
+			}
+			return result;
+		};
+
+		std::unordered_map<uint32_t, size_t> seenA;
+		for (size_t i = 0; i < childrenA.size(); i++) {
+			Chunk* child = childrenA[i];
+			size_t idx = seenA[child->type]++;
+			if (partnerA[i] != NONE) {
+				diffTree(child, childrenB[partnerA[i]], childPath(child, idx), typed && child->type == RW_STRUCT, diffs);
+			} else {
+				diffs.push_back({ChunkDiff::REMOVED, childPath(child, idx), child, nullptr, {}});
+			}
+		}
+
+		std::unordered_map<uint32_t, size_t> seenB;
+		for (size_t j = 0; j < childrenB.size(); j++) {
+			Chunk* child = childrenB[j];
+			size_t idx = seenB[child->type]++;
+			if (partnerB[j] == NONE) {
+				diffs.push_back({ChunkDiff::ADDED, childPath(child, idx), nullptr, child, {}});
+			}
+		}
+	}
+
+	void diffChunks(Chunk* a, Chunk* b, std::vector<ChunkDiff>& diffs) {
+		diffTree(a, b, getChunkName(a->type), false, diffs);
+	}
+}
\ No newline at end of file
@@ -81,6 +81,61 @@ void rw::GeometryChunk::dump(rw::util::DumpWriter out) {
 	}
 }
 
+void rw::GeometryChunk::dumpJson(rw::util::JsonWriter& out) {
+	out.field("format", format);
+	out.field("triangleCount", triangleCount);
+	out.field("vertexCount", vertexCount);
+	out.field("morphTargetCount", morphTargetCount);
+	if (hasSurfaceProperties) {
+		out.field("ambient", ambient);
+		out.field("specular", specular);
+		out.field("diffuse", diffuse);
+	}
+
+	StructChunk* content = getStruct();
+	if (!content) return;
+
+	// walk the same struct layout as postReadHook
+	uint32_t cursor = hasSurfaceProperties ? 28 : 16;
+	if (!vertexColors.empty()) {
+		content->dumpJsonBlob(out, "vertexColors", cursor, vertexColors.size() * sizeof(geom::VertexColor));
+		cursor += vertexColors.size() * sizeof(geom::VertexColor);
+	}
+	out.beginArray("vertexUVLayers");
+	for (auto& vertexUVs : vertexUVLayers) {
+		out.beginObject();
+		content->dumpJsonBlob(out, "uvs", cursor, vertexUVs.size() * sizeof(geom::VertexUVs));
+		out.endObject();
+		cursor += vertexUVs.size() * sizeof(geom::VertexUVs);
+	}
+	out.endArray();
+	// stored as (vertex2, vertex1, material, vertex3)
+	content->dumpJsonBlob(out, "faces", cursor, faces.size() * sizeof(geom::Face));
+	cursor += faces.size() * sizeof(geom::Face);
+
+	out.beginArray("morphTargets");
+	for (auto& morphTarget : morphTargets) {
+		out.beginObject();
+		out.beginArray("boundingSphere");
+		out.value(morphTarget.boundingSphere.x);
+		out.value(morphTarget.boundingSphere.y);
+		out.value(morphTarget.boundingSphere.z);
+		out.value(morphTarget.boundingSphere.radius);
+		out.endArray();
+		cursor += 24;
+		if (morphTarget.hasVertices) {
+			content->dumpJsonBlob(out, "vertexPositions", cursor, morphTarget.vertexPositions.size() * sizeof(geom::VertexPosition));
+			cursor += morphTarget.vertexPositions.size() * sizeof(geom::VertexPosition);
+		}
+		if (morphTarget.hasNormals) {
+			content->dumpJsonBlob(out, "vertexNormals", cursor, morphTarget.vertexNormals.size() * sizeof(geom::VertexNormal));
+			cursor += morphTarget.vertexNormals.size() * sizeof(geom::VertexNormal);
+		}
+		out.endObject();
+	}
+	out.endArray();
+}
+
 void rw::GeometryChunk::postReadHook() {
 	bool structWasSeen = false;
 	bool materialListWasSeen = false;
@@ -192,16 +247,80 @@ void rw::GeometryChunk::postReadHook() {
 }
 
 void rw::GeometryChunk::preWriteHook() {
+	morphTargetCount = morphTargets.size();
+	if (!(format & RW_GEOMETRY_NATIVE)) {
+		triangleCount = faces.size();
+	}
+
+	uint32_t size = 16 + (hasSurfaceProperties ? 12 : 0);
+	if (!(format & RW_GEOMETRY_NATIVE)) {
+		size += vertexColors.size() * sizeof(geom::VertexColor);
+		for (auto& layer : vertexUVLayers) {
+			size += layer.size() * sizeof(geom::VertexUVs);
+		}
+		size += faces.size() * sizeof(geom::Face);
+	}
+	for (auto& morphTarget : morphTargets) {
+		size += 24 + morphTarget.vertexPositions.size() * sizeof(geom::VertexPosition)
+				+ morphTarget.vertexNormals.size() * sizeof(geom::VertexNormal);
+	}
+
+	// serialize into a new buffer, as the struct may view memory shared with others
+	util::Buffer content(size);
+	content.write(format);
+	content.write(triangleCount);
+	content.write(vertexCount);
+	content.write(morphTargetCount);
+	if (hasSurfaceProperties) {
+		content.write(ambient);
+		content.write(specular);
+		content.write(diffuse);
+	}
+
+	if (!(format & RW_GEOMETRY_NATIVE)) {
+		content.write(vertexColors.data(), vertexColors.size() * sizeof(geom::VertexColor));
+		for (auto& layer : vertexUVLayers) {
+			content.write(layer.data(), layer.size() * sizeof(geom::VertexUVs));
+		}
+		for (auto face : faces) {
+			// swap vertex 2 and material indices back
+			auto v2 = face.material;
+			face.material = face.vertex2;
+			face.vertex2 = v2;
+			content.write(face);
+		}
+	}
+
+	for (auto& morphTarget : morphTargets) {
+		morphTarget.hasVertices = !morphTarget.vertexPositions.empty();
+		morphTarget.hasNormals = !morphTarget.vertexNormals.empty();
+		content.write(morphTarget.boundingSphere);
+		content.write(morphTarget.hasVertices);
+		content.write(morphTarget.hasNormals);
+		content.write(morphTarget.vertexPositions.data(), morphTarget.vertexPositions.size() * sizeof(geom::VertexPosition));
+		content.write(morphTarget.vertexNormals.data(), morphTarget.vertexNormals.size() * sizeof(geom::VertexNormal));
+	}
+
+	StructChunk* structChunk = getStruct();
+	if (structChunk) {
+		structChunk->setData(std::move(content));
+	}
+	invalidateHash();
+
 	ListChunk::preWriteHook();
 }
 
 void rw::GeometryListChunk::dump(rw::util::DumpWriter out) {
 	out.print("Geometry List: (%d geometries)", geometries.size());
 	for (auto geometry : geometries) {
-		geometry->dump(out);
+		out.spawn([geometry](util::DumpWriter& w) { geometry->dump(w); });
 	}
 }
 
+void rw::GeometryListChunk::dumpJson(rw::util::JsonWriter& out) {
+	out.field("geometryCount", (uint32_t) geometries.size());
+}
+
 void rw::GeometryListChunk::postReadHook() {
 	bool structWasSeen = false;
 	uint32_t geometryCount = 0;
@@ -251,6 +370,28 @@ void rw::FrameListChunk::dump(rw::util::DumpWriter out) {
 	}
 }
 
+void rw::FrameListChunk::dumpJson(rw::util::JsonWriter& out) {
+	out.beginArray("frames");
+	for (auto& frame : frames) {
+		out.beginObject();
+		out.beginArray("rotation");
+		const float* rotation = &frame.rotation.row1.x;
+		for (int i = 0; i < 9; i++) {
+			out.value(rotation[i]);
+		}
+		out.endArray();
+		out.beginArray("translation");
+		out.value(frame.translation.x);
+		out.value(frame.translation.y);
+		out.value(frame.translation.z);
+		out.endArray();
+		out.field("previous", (int32_t) frame.previous);
+		out.field("matrixFlags", frame.matrixFlags);
+		out.endObject();
+	}
+	out.endArray();
+}
+
 void rw::FrameListChunk::postReadHook() {
 	bool structWasSeen = false;
 	for (auto child : children) {
@@ -293,6 +434,13 @@ void rw::AtomicChunk::dump(rw::util::DumpWriter out) {
 	if (unused != 0) out.print("  unused: %08x (unusual)");
 }
 
+void rw::AtomicChunk::dumpJson(rw::util::JsonWriter& out) {
+	out.field("frameIndex", frameIndex);
+	out.field("geometryIndex", geometryIndex);
+	out.field("flags", flags);
+	out.field("unused", unused);
+}
+
 void rw::AtomicChunk::postReadHook() {
 	bool structWasSeen = false;
 	for (auto child : children) {
@@ -326,7 +474,8 @@ void rw::ClumpChunk::dump(rw::util::DumpWriter out) {
 	out.print("Clump: (%d atomics)", atomics.size());
 	frameList->dump(out);
 	out.print("");
-	geometryList->dump(out);
+	GeometryListChunk* geometryList = this->geometryList;
+	out.spawn([geometryList](util::DumpWriter& w) { geometryList->dump(w); });
 	for (auto atomic : atomics) {
 		out.print("");
 		atomic->dump(out);
@@ -337,10 +486,20 @@ void rw::ClumpChunk::dump(rw::util::DumpWriter out) {
 	}
 }
 
+void rw::ClumpChunk::dumpJson(rw::util::JsonWriter& out) {
+	out.field("atomicCount", atomicCount);
+	if (util::unpackVersionNumber(this->version) < 0x33000) {
+		out.field("lightCount", lightCount);
+		out.field("cameraCount", cameraCount);
+	}
+}
+
 void rw::ClumpChunk::postReadHook() {
 	bool structWasSeen = false;
 	bool frameListSeen = false;
 	bool geometryListSeen = false;
+	frameList = nullptr;
+	geometryList = nullptr;
 	for (auto child : children) {
 		if (child->type == RW_STRUCT) {
 			if (structWasSeen) {
@@ -445,6 +604,40 @@ void rw::DeltaMorphPLGChunk::dump(util::DumpWriter out) {
 	}
 }
 
+void rw::DeltaMorphPLGChunk::dumpJson(util::JsonWriter& out) {
+	// walk the same layout as postReadHook
+	uint32_t cursor = 4;
+	out.beginArray("targets");
+	for (auto& target : targets) {
+		uint32_t nameLength;
+		data.seek(cursor);
+		data.read(&nameLength);
+		cursor += 4 + nameLength + 16;
+
+		out.beginObject();
+		out.field("name", target.name);
+		out.field("flags", target.flags);
+		out.field("num2", target.num2);
+		dumpJsonBlob(out, "mapping", cursor, target.mapping.size());
+		cursor += target.mapping.size();
+		dumpJsonBlob(out, "vertices", cursor, target.vertices.size() * sizeof(DMorphPoint));
+		cursor += target.vertices.size() * sizeof(DMorphPoint);
+		if (!target.normals.empty()) {
+			dumpJsonBlob(out, "normals", cursor, target.normals.size() * sizeof(DMorphPoint));
+			cursor += target.normals.size() * sizeof(DMorphPoint);
+		}
+		out.beginArray("bound");
+		out.value(target.boundX);
+		out.value(target.boundY);
+		out.value(target.boundZ);
+		out.value(target.boundRadius);
+		out.endArray();
+		cursor += 16;
+		out.endObject();
+	}
+	out.endArray();
+}
+
 void rw::DeltaMorphPLGChunk::postReadHook() {
 	data.seek(0);
 
@@ -500,5 +693,26 @@ void rw::DeltaMorphPLGChunk::postReadHook() {
 }
 
 void rw::DeltaMorphPLGChunk::preWriteHook() {
+	// walk the same layout as postReadHook, writing back the bounds into a copy
+	util::Buffer content = data.copy();
+	uint32_t cursor = 4;
+	for (auto& target : targets) {
+		uint32_t nameLength;
+		content.seek(cursor);
+		content.read(&nameLength);
+		cursor += 4 + nameLength + 16;
+		cursor += target.mapping.size();
+		cursor += target.vertices.size() * sizeof(DMorphPoint);
+		cursor += target.normals.size() * sizeof(DMorphPoint);
+
+		content.seek(cursor);
+		content.write(target.boundX);
+		content.write(target.boundY);
+		content.write(target.boundZ);
+		content.write(target.boundRadius);
+		cursor += 16;
+	}
+	setData(std::move(content));
+
 	StructChunk::preWriteHook();
 }
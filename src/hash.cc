@@ -0,0 +1,104 @@
+/*
+ * File: hash.cc
+ * Author: DeadlyFugu
+ * License: zlib
+ * Description: Fast non-cryptographic hashing used to identify chunk contents
+ */
+
+#include "hash.hh"
+
+#include <cstring>
+
+namespace rw {
+	namespace util {
+		// XXH64 as specified at https://github.com/Cyan4973/xxHash/blob/dev/doc/xxhash_spec.md
+
+		static const uint64_t PRIME64_1 = 0x9E3779B185EBCA87ULL;
+		static const uint64_t PRIME64_2 = 0xC2B2AE3D27D4EB4FULL;
+		static const uint64_t PRIME64_3 = 0x165667B19E3779F9ULL;
+		static const uint64_t PRIME64_4 = 0x85EBCA77C2B2AE63ULL;
+		static const uint64_t PRIME64_5 = 0x27D4EB2F165667C5ULL;
+
+		static inline uint64_t rotl(uint64_t x, int r) {
+			return (x << r) | (x >> (64 - r));
+		}
+
+		static inline uint64_t read64(const uint8_t* p) {
+			uint64_t v;
+			memcpy(&v, p, 8);
+			return v;
+		}
+
+		static inline uint32_t read32(const uint8_t* p) {
+			uint32_t v;
+			memcpy(&v, p, 4);
+			return v;
+		}
+
+		static inline uint64_t round(uint64_t acc, uint64_t input) {
+			acc += input * PRIME64_2;
+			acc = rotl(acc, 31);
+			return acc * PRIME64_1;
+		}
+
+		static inline uint64_t mergeRound(uint64_t acc, uint64_t val) {
+			acc ^= round(0, val);
+			return acc * PRIME64_1 + PRIME64_4;
+		}
+
+		uint64_t hash64(const void* data, size_t len, uint64_t seed) {
+			auto p = (const uint8_t*) data;
+			auto end = p + len;
+			uint64_t h;
+
+			if (len >= 32) {
+				// four independent lanes over 32 byte stripes
+				uint64_t v1 = seed + PRIME64_1 + PRIME64_2;
+				uint64_t v2 = seed + PRIME64_2;
+				uint64_t v3 = seed;
+				uint64_t v4 = seed - PRIME64_1;
+				auto limit = end - 32;
+				do {
+					v1 = round(v1, read64(p));
+					v2 = round(v2, read64(p + 8));
+					v3 = round(v3, read64(p + 16));
+					v4 = round(v4, read64(p + 24));
+					p += 32;
+				} while (p <= limit);
+
+				h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+				h = mergeRound(h, v1);
+				h = mergeRound(h, v2);
+				h = mergeRound(h, v3);
+				h = mergeRound(h, v4);
+			} else {
+				h = seed + PRIME64_5;
+			}
+
+			h += (uint64_t) len;
+
+			while (end - p >= 8) {
+				h ^= round(0, read64(p));
+				h = rotl(h, 27) * PRIME64_1 + PRIME64_4;
+				p += 8;
+			}
+			if (end - p >= 4) {
+				h ^= (uint64_t) read32(p) * PRIME64_1;
+				h = rotl(h, 23) * PRIME64_2 + PRIME64_3;
+				p += 4;
+			}
+			while (p < end) {
+				h ^= (*p) * PRIME64_5;
+				h = rotl(h, 11) * PRIME64_1;
+				p++;
+			}
+
+			h ^= h >> 33;
+			h *= PRIME64_2;
+			h ^= h >> 29;
+			h *= PRIME64_3;
+			h ^= h >> 32;
+			return h;
+		}
+	}
+}
\ No newline at end of file
@@ -0,0 +1,173 @@
+/*
+ * File: indices.cc
+ * Author: DeadlyFugu
+ * License: zlib
+ * Description: Compact vertex index storage, using 16-bit indices whenever they fit
+ */
+
+#include "indices.hh"
+
+#include <algorithm>
+#include <cstring>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace rw {
+	namespace geom {
+		void narrowIndices(const uint32_t* in, uint16_t* out, size_t count) {
+			size_t i = 0;
+#ifdef __SSE2__
+			// bias into signed range so the saturating pack keeps values up to 0xffff
+			const __m128i bias = _mm_set1_epi32(0x8000);
+			const __m128i unbias = _mm_set1_epi16((short) 0x8000);
+			for (; i + 8 <= count; i += 8) {
+				__m128i a = _mm_sub_epi32(_mm_loadu_si128((const __m128i*) (in + i)), bias);
+				__m128i b = _mm_sub_epi32(_mm_loadu_si128((const __m128i*) (in + i + 4)), bias);
+				_mm_storeu_si128((__m128i*) (out + i), _mm_xor_si128(_mm_packs_epi32(a, b), unbias));
+			}
+#endif
+			for (; i < count; i++) {
+				out[i] = (uint16_t) in[i];
+			}
+		}
+
+		void widenIndices(const uint16_t* in, uint32_t* out, size_t count) {
+			size_t i = 0;
+#ifdef __SSE2__
+			const __m128i zero = _mm_setzero_si128();
+			for (; i + 8 <= count; i += 8) {
+				__m128i v = _mm_loadu_si128((const __m128i*) (in + i));
+				_mm_storeu_si128((__m128i*) (out + i), _mm_unpacklo_epi16(v, zero));
+				_mm_storeu_si128((__m128i*) (out + i + 4), _mm_unpackhi_epi16(v, zero));
+			}
+#endif
+			for (; i < count; i++) {
+				out[i] = in[i];
+			}
+		}
+
+		uint32_t combineIndices(const uint32_t* in, size_t count) {
+			size_t i = 0;
+			uint32_t result = 0;
+#ifdef __SSE2__
+			__m128i acc = _mm_setzero_si128();
+			for (; i + 4 <= count; i += 4) {
+				acc = _mm_or_si128(acc, _mm_loadu_si128((const __m128i*) (in + i)));
+			}
+			acc = _mm_or_si128(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(1, 0, 3, 2)));
+			acc = _mm_or_si128(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(2, 3, 0, 1)));
+			result = (uint32_t) _mm_cvtsi128_si32(acc);
+#endif
+			for (; i < count; i++) {
+				result |= in[i];
+			}
+			return result;
+		}
+
+		void IndexArray::set(size_t i, uint32_t index) {
+			if (!isWide && index > 0xffff) widen();
+			if (isWide) {
+				wide[i] = index;
+			} else {
+				narrow[i] = (uint16_t) index;
+			}
+		}
+
+		void IndexArray::push_back(uint32_t index) {
+			if (!isWide && index > 0xffff) widen();
+			if (isWide) {
+				wide.push_back(index);
+			} else {
+				narrow.push_back((uint16_t) index);
+			}
+		}
+
+		void IndexArray::clear() {
+			isWide = false;
+			narrow.clear();
+			wide.clear();
+		}
+
+		void IndexArray::assign(const uint32_t* indices, size_t count) {
+			isWide = combineIndices(indices, count) > 0xffff;
+			if (isWide) {
+				narrow.clear();
+				wide.assign(indices, indices + count);
+			} else {
+				wide.clear();
+				narrow.resize(count);
+				narrowIndices(indices, narrow.data(), count);
+			}
+		}
+
+		void IndexArray::copyTo(uint32_t* out) const {
+			if (isWide) {
+				if (!wide.empty()) memcpy(out, wide.data(), wide.size() * 4);
+			} else {
+				widenIndices(narrow.data(), out, narrow.size());
+			}
+		}
+
+		void IndexArray::toVector(std::vector<uint32_t>& out) const {
+			out.resize(size());
+			copyTo(out.data());
+		}
+
+		uint32_t IndexArray::maxIndex() const {
+			if (isWide) {
+				return wide.empty() ? 0 : *std::max_element(wide.begin(), wide.end());
+			}
+			return narrow.empty() ? 0 : *std::max_element(narrow.begin(), narrow.end());
+		}
+
+		void IndexArray::compact() {
+			if (!isWide || combineIndices(wide.data(), wide.size()) > 0xffff) return;
+			narrow.resize(wide.size());
+			narrowIndices(wide.data(), narrow.data(), wide.size());
+			std::vector<uint32_t>().swap(wide);
+			isWide = false;
+		}
+
+		void IndexArray::widen() {
+			if (isWide) return;
+			wide.resize(narrow.size());
+			widenIndices(narrow.data(), wide.data(), narrow.size());
+			std::vector<uint16_t>().swap(narrow);
+			isWide = true;
+		}
+
+		void IndexArray::write(util::Buffer& out, uint32_t indexSize) const {
+			if (indexSize == this->indexSize()) {
+				if (!empty()) out.write(isWide ? (const void*) wide.data() : (const void*) narrow.data(), bytes());
+				return;
+			}
+
+			// convert through a small staging block
+			const size_t BLOCK = 256;
+			uint32_t wideBlock[BLOCK];
+			uint16_t narrowBlock[BLOCK];
+			for (size_t first = 0; first < size(); first += BLOCK) {
+				size_t count = std::min(BLOCK, size() - first);
+				if (isWide) {
+					narrowIndices(wide.data() + first, narrowBlock, count);
+					out.write(narrowBlock, count * 2);
+				} else {
+					widenIndices(narrow.data() + first, wideBlock, count);
+					out.write(wideBlock, count * 4);
+				}
+			}
+		}
+
+		bool IndexArray::operator==(const IndexArray& other) const {
+			if (size() != other.size()) return false;
+			if (isWide == other.isWide) {
+				return isWide ? wide == other.wide : narrow == other.narrow;
+			}
+			for (size_t i = 0; i < size(); i++) {
+				if ((*this)[i] != other[i]) return false;
+			}
+			return true;
+		}
+	}
+}
\ No newline at end of file
@@ -0,0 +1,190 @@
+/*
+ * File: instance.cc
+ * Author: DeadlyFugu
+ * License: zlib
+ * Description: Many lightweight instances of one clump sharing its geometry, materials and textures
+ */
+
+#include "instance.hh"
+
+#include <algorithm>
+
+namespace rw {
+	ClumpModel::ClumpModel(ClumpChunk* clump) : clump(clump) {}
+
+	ClumpModel::~ClumpModel() {
+		delete clump;
+	}
+
+	std::shared_ptr<const ClumpModel> ClumpModel::create(ClumpChunk* clump) {
+		if (!clump->frameList || !clump->geometryList) {
+			util::logger.warn("Cannot share a clump without frames and geometry");
+			delete clump;
+			return nullptr;
+		}
+		std::shared_ptr<ClumpModel> model(new ClumpModel(clump));
+		if (!model->hierarchy.build(clump->frameList)) {
+			util::logger.warn("Cannot share a clump without frames");
+			return nullptr;
+		}
+		getLocalTransforms(clump->frameList, model->restPose);
+		computeClumpBounds(clump, model->bounds);
+
+		uint32_t weights = 0;
+		for (uint32_t a = 0; a < clump->atomics.size(); a++) {
+			model->morphOffsets.push_back(weights);
+			const GeometryChunk* geometry = model->findGeometry(a);
+			if (geometry) weights += (uint32_t) geometry->morphTargets.size();
+		}
+		model->morphOffsets.push_back(weights);
+		return model;
+	}
+
+	const GeometryChunk* ClumpModel::findGeometry(uint32_t atomic) const {
+		if (atomic >= clump->atomics.size()) return nullptr;
+		auto& geometries = clump->geometryList->geometries;
+		uint32_t index = clump->atomics[atomic]->geometryIndex;
+		return index < geometries.size() ? geometries[index] : nullptr;
+	}
+
+	const MaterialChunk* ClumpModel::findMaterial(uint32_t atomic, uint32_t material) const {
+		const GeometryChunk* geometry = findGeometry(atomic);
+		if (!geometry || !geometry->materialList || material >= geometry->materialList->materials.size()) {
+			return nullptr;
+		}
+		return geometry->materialList->materials[material];
+	}
+
+	// the aliasing constructor shares the model's count while pointing inside it
+	std::shared_ptr<const GeometryChunk> ClumpModel::geometry(uint32_t atomic) const {
+		const GeometryChunk* found = findGeometry(atomic);
+		if (!found) return nullptr;
+		return std::shared_ptr<const GeometryChunk>(shared_from_this(), found);
+	}
+
+	std::shared_ptr<const MaterialChunk> ClumpModel::material(uint32_t atomic, uint32_t material) const {
+		const MaterialChunk* found = findMaterial(atomic, material);
+		if (!found) return nullptr;
+		return std::shared_ptr<const MaterialChunk>(shared_from_this(), found);
+	}
+
+	std::shared_ptr<const TextureChunk> ClumpModel::texture(uint32_t atomic, uint32_t material) const {
+		const MaterialChunk* found = findMaterial(atomic, material);
+		if (!found || !found->texture) return nullptr;
+		return std::shared_ptr<const TextureChunk>(shared_from_this(), found->texture);
+	}
+
+	ClumpInstance::ClumpInstance(std::shared_ptr<const ClumpModel> model)
+		: model(std::move(model)), root(geom::identityTransform()) {}
+
+	const geom::Transform& ClumpInstance::local(uint32_t frame) const {
+		return pose.empty() ? model->restPose[frame] : pose[frame];
+	}
+
+	void ClumpInstance::setLocal(uint32_t frame, const geom::Transform& transform) {
+		if (frame >= model->restPose.size()) {
+			util::logger.warn("Frame %u out of range", frame);
+			return;
+		}
+		if (pose.empty()) pose = model->restPose;
+		pose[frame] = transform;
+	}
+
+	void ClumpInstance::resetPose() {
+		std::vector<geom::Transform>().swap(pose);
+	}
+
+	float ClumpInstance::morphWeight(uint32_t atomic, uint32_t target) const {
+		auto& offsets = model->morphOffsets;
+		if (atomic + 1 >= offsets.size() || target >= offsets[atomic + 1] - offsets[atomic]) return 0;
+		if (morphWeights.empty()) return target == 0 ? 1 : 0;
+		return morphWeights[offsets[atomic] + target];
+	}
+
+	void ClumpInstance::setMorphWeight(uint32_t atomic, uint32_t target, float weight) {
+		auto& offsets = model->morphOffsets;
+		if (atomic + 1 >= offsets.size() || target >= offsets[atomic + 1] - offsets[atomic]) {
+			util::logger.warn("Morph target %u of atomic %u out of range", target, atomic);
+			return;
+		}
+		if (morphWeights.empty()) {
+			// the first target of each atomic is shown fully
+			morphWeights.assign(offsets.back(), 0);
+			for (size_t a = 0; a + 1 < offsets.size(); a++) {
+				if (offsets[a] < offsets[a + 1]) morphWeights[offsets[a]] = 1;
+			}
+		}
+		morphWeights[offsets[atomic] + target] = weight;
+	}
+
+	bool ClumpInstance::morphPositions(uint32_t atomic, std::vector<geom::VertexPosition>& out) const {
+		out.clear();
+		const GeometryChunk* geometry = model->findGeometry(atomic);
+		if (!geometry) return false;
+		const uint32_t vertexCount = geometry->vertexCount;
+
+		bool hasPositions = false;
+		out.assign(vertexCount, {0, 0, 0});
+		for (uint32_t t = 0; t < geometry->morphTargets.size(); t++) {
+			auto& positions = geometry->morphTargets[t].vertexPositions;
+			if (positions.size() < vertexCount) continue;
+			hasPositions = true;
+			float weight = morphWeight(atomic, t);
+			if (weight == 0) continue;
+			for (uint32_t v = 0; v < vertexCount; v++) {
+				out[v].x += positions[v].x * weight;
+				out[v].y += positions[v].y * weight;
+				out[v].z += positions[v].z * weight;
+			}
+		}
+		if (!hasPositions) out.clear();
+		return hasPositions;
+	}
+
+	const MaterialChunk* ClumpInstance::material(uint32_t atomic, uint32_t material) const {
+		for (auto& entry : overrides) {
+			if (entry.atomic == atomic && entry.material == material) return entry.replacement.get();
+		}
+		return model->findMaterial(atomic, material);
+	}
+
+	void ClumpInstance::setMaterial(uint32_t atomic, uint32_t material,
+									std::shared_ptr<const MaterialChunk> replacement) {
+		auto entry = std::find_if(overrides.begin(), overrides.end(), [&](const MaterialOverride& entry) {
+			return entry.atomic == atomic && entry.material == material;
+		});
+		if (!replacement) {
+			if (entry != overrides.end()) overrides.erase(entry);
+		} else if (entry != overrides.end()) {
+			entry->replacement = std::move(replacement);
+		} else {
+			MaterialOverride added = {atomic, material, std::move(replacement)};
+			overrides.push_back(std::move(added));
+		}
+	}
+
+	bool computeInstanceTransforms(const ClumpInstance* instances, size_t instanceCount,
+								   std::vector<geom::Transform>& out) {
+		out.clear();
+		if (!instanceCount) return true;
+		const ClumpModel* model = instances[0].model.get();
+		for (size_t i = 1; i < instanceCount; i++) {
+			if (instances[i].model.get() != model) {
+				util::logger.warn("Instances %u and 0 have different models", (uint32_t) i);
+				return false;
+			}
+		}
+
+		const size_t count = model->restPose.size();
+		std::vector<geom::Transform> locals(instanceCount * count);
+		std::vector<geom::Transform> roots(instanceCount);
+		for (size_t i = 0; i < instanceCount; i++) {
+			auto& pose = instances[i].pose.empty() ? model->restPose : instances[i].pose;
+			std::copy(pose.begin(), pose.end(), locals.begin() + i * count);
+			roots[i] = instances[i].root;
+		}
+		out.resize(locals.size());
+		model->hierarchy.evaluate(locals.data(), roots.data(), instanceCount, out.data());
+		return true;
+	}
+}
\ No newline at end of file
@@ -21,6 +21,15 @@ namespace rw {
 		out.print("  mask name: %s", this->maskName.c_str());
 	}
 
+	void TextureChunk::dumpJson(util::JsonWriter& out) {
+		out.field("filterMode", (uint32_t) this->filterMode);
+		out.field("addressUMode", (uint32_t) this->addressUMode);
+		out.field("addressVMode", (uint32_t) this->addressVMode);
+		out.field("useMipLevels", (bool) this->useMipLevels);
+		out.field("textureName", this->textureName);
+		out.field("maskName", this->maskName);
+	}
+
 	void TextureChunk::postReadHook() {
 		bool structWasSeen = false;
 		bool texNameSeen = false;
@@ -91,6 +100,18 @@ namespace rw {
 		}
 	}
 
+	void MaterialChunk::dumpJson(util::JsonWriter& out) {
+		out.field("flags", this->flags);
+		out.field("color", this->color);
+		out.field("unused", this->unused);
+		out.field("isTextured", (bool) this->isTextured);
+		if (this->hasSurfaceProperties) {
+			out.field("ambient", this->ambient);
+			out.field("specular", this->specular);
+			out.field("diffuse", this->diffuse);
+		}
+	}
+
 	void MaterialChunk::postReadHook() {
 		bool structWasSeen = false;
 		bool textureWasSeen = false;
@@ -153,6 +174,18 @@ namespace rw {
 		ListChunk::dump(out);
 	}*/
 
+	void MaterialListChunk::dumpJson(util::JsonWriter& out) {
+		// materials as indices into the Material children of this list
+		std::vector<Chunk*> materialChunks = this->filterChildren(RW_MATERIAL);
+		out.beginArray("materials");
+		for (auto material : this->materials) {
+			uint32_t idx = 0;
+			while (idx < materialChunks.size() && materialChunks[idx] != material) idx++;
+			out.value(idx);
+		}
+		out.endArray();
+	}
+
 	void MaterialListChunk::postReadHook() {
 		bool structWasSeen = false;
 		std::vector<Chunk*> materialChunks = this->filterChildren(RW_MATERIAL);
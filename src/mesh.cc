@@ -0,0 +1,1306 @@
+/*
+ * File: mesh.cc
+ * Author: DeadlyFugu
+ * License: zlib
+ * Description: Uniform access to the vertex and index data of Geometry and Atomic Section chunks
+ */
+
+#include "mesh.hh"
+#include "hash.hh"
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <cstring>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace rw {
+	BinMeshPLGChunk* findBinMesh(GeometryChunk* geometry) {
+		for (auto extension : geometry->extensions) {
+			if (!extension->isList()) continue;
+			for (auto child : ((ListChunk*) extension)->children) {
+				if (child->type == RW_BINMESH_PLG) {
+					return (BinMeshPLGChunk*) child;
+				}
+			}
+		}
+		return nullptr;
+	}
+
+	void convertBinMesh(BinMeshPLGChunk* binMesh, bool strip) {
+		bool isStrip = binMesh->flags == 1;
+		std::vector<uint32_t> list, indices;
+		for (auto& object : binMesh->objects) {
+			object.indices.toVector(indices);
+			list.clear();
+			if (isStrip) {
+				geom::stripToList(indices.data(), indices.size(), list);
+			} else {
+				list.assign(indices.begin(), indices.end() - indices.size() % 3);
+			}
+
+			indices.clear();
+			if (strip) {
+				geom::listToStrip(list.data(), list.size(), indices);
+			} else if (isStrip) {
+				indices.swap(list);
+			} else {
+				// drop degenerate triangles
+				for (size_t i = 0; i < list.size(); i += 3) {
+					if (list[i] != list[i + 1] && list[i + 1] != list[i + 2] && list[i] != list[i + 2]) {
+						indices.insert(indices.end(), &list[i], &list[i] + 3);
+					}
+				}
+			}
+			object.indices.assign(indices);
+		}
+		binMesh->flags = strip ? 1 : 0;
+		binMesh->preWriteHook();
+	}
+
+	static const uint32_t NO_VERTEX = 0xffffffffu;
+
+	static void facesToList(const std::vector<geom::Face>& faces, std::vector<uint32_t>& list) {
+		list.resize(faces.size() * 3);
+		for (size_t i = 0; i < faces.size(); i++) {
+			list[i * 3 + 0] = faces[i].vertex1;
+			list[i * 3 + 1] = faces[i].vertex2;
+			list[i * 3 + 2] = faces[i].vertex3;
+		}
+	}
+
+	static bool indicesInRange(const std::vector<uint32_t>& indices, uint32_t vertexCount) {
+		for (uint32_t index : indices) {
+			if (index >= vertexCount) {
+				util::logger.warn("Vertex index %d out of range (%d vertices)", index, vertexCount);
+				return false;
+			}
+		}
+		return true;
+	}
+
+	static bool indicesInRange(const geom::IndexArray& indices, uint32_t vertexCount) {
+		uint32_t maxIndex = indices.maxIndex();
+		if (!indices.empty() && maxIndex >= vertexCount) {
+			util::logger.warn("Vertex index %d out of range (%d vertices)", maxIndex, vertexCount);
+			return false;
+		}
+		return true;
+	}
+
+	static bool indicesInRange(const std::vector<geom::Face>& faces, BinMeshPLGChunk* binMesh, uint32_t vertexCount) {
+		std::vector<uint32_t> list;
+		facesToList(faces, list);
+		if (!indicesInRange(list, vertexCount)) return false;
+		if (binMesh) {
+			for (auto& object : binMesh->objects) {
+				if (!indicesInRange(object.indices, vertexCount)) return false;
+			}
+		}
+		return true;
+	}
+
+	static inline bool isDegenerate(uint32_t a, uint32_t b, uint32_t c) {
+		return a == b || b == c || a == c;
+	}
+
+	/// Returns the first extension of a geometry other than BinMesh, which may hold per-vertex data
+	static Chunk* findPerVertexExtension(GeometryChunk* geometry) {
+		for (auto extension : geometry->extensions) {
+			if (!extension->isList()) continue;
+			for (auto child : ((ListChunk*) extension)->children) {
+				if (child->type != RW_BINMESH_PLG) return child;
+			}
+		}
+		return nullptr;
+	}
+
+	static Chunk* findPerVertexExtension(AtomicSectionChunk* section) {
+		for (auto extension : section->children) {
+			if (extension->type != RW_EXTENSION || !extension->isList()) continue;
+			for (auto child : ((ListChunk*) extension)->children) {
+				if (child->type != RW_BINMESH_PLG) return child;
+			}
+		}
+		return nullptr;
+	}
+
+	/// Reorders faces and trilist BinMesh objects, then fills remap with the fetch order of the
+	/// mesh as drawn (from the BinMesh if there is one). Returns false if an index is out of range.
+	static bool optimizeTriangles(std::vector<geom::Face>& faces, BinMeshPLGChunk* binMesh, uint32_t vertexCount,
+								  uint32_t cacheSize, VertexCacheStats& stats, std::vector<uint32_t>& remap) {
+		if (!indicesInRange(faces, binMesh, vertexCount)) return false;
+		std::vector<uint32_t> list, order;
+		facesToList(faces, list);
+
+		stats.facesBefore = geom::computeACMR(list.data(), list.size(), vertexCount, cacheSize);
+		geom::tipsify(list.data(), list.size(), vertexCount, cacheSize, order);
+		std::vector<geom::Face> ordered;
+		ordered.reserve(faces.size());
+		for (uint32_t triangle : order) {
+			ordered.push_back(faces[triangle]);
+		}
+		faces.swap(ordered);
+		facesToList(faces, list);
+		stats.facesAfter = geom::computeACMR(list.data(), list.size(), vertexCount, cacheSize);
+
+		if (binMesh && binMesh->flags == 0) {
+			// average over objects, weighted by triangle count
+			double before = 0, after = 0;
+			size_t triangles = 0;
+			std::vector<uint32_t> indices;
+			for (auto& object : binMesh->objects) {
+				object.indices.toVector(indices);
+				size_t count = indices.size() / 3;
+				before += geom::computeACMR(indices.data(), count * 3, vertexCount, cacheSize) * count;
+				geom::optimizeTriangleOrder(indices.data(), count * 3, vertexCount, cacheSize);
+				after += geom::computeACMR(indices.data(), count * 3, vertexCount, cacheSize) * count;
+				object.indices.assign(indices);
+				triangles += count;
+			}
+			if (triangles) {
+				stats.binMeshBefore = before / triangles;
+				stats.binMeshAfter = after / triangles;
+			}
+		}
+
+		if (binMesh) {
+			list.clear();
+			for (auto& object : binMesh->objects) {
+				list.insert(list.end(), object.indices.begin(), object.indices.end());
+			}
+		}
+		geom::buildFetchRemap(list.data(), list.size(), vertexCount, remap);
+		return true;
+	}
+
+	/// Moves each value to remap[i], dropping those mapped past count. When several vertices map
+	/// to one, the first of them is kept.
+	template<typename T>
+	static void remapVertices(std::vector<T>& values, const std::vector<uint32_t>& remap, size_t count) {
+		if (values.size() != remap.size()) return;
+		std::vector<T> result(count);
+		for (size_t i = values.size(); i-- > 0;) {
+			if (remap[i] < count) result[remap[i]] = values[i];
+		}
+		values.swap(result);
+	}
+
+	template<typename T>
+	static void remapVertices(std::vector<T>& values, const std::vector<uint32_t>& remap) {
+		remapVertices(values, remap, remap.size());
+	}
+
+	static void remapIndices(std::vector<geom::Face>& faces, BinMeshPLGChunk* binMesh, const std::vector<uint32_t>& remap) {
+		for (auto& face : faces) {
+			face.vertex1 = remap[face.vertex1];
+			face.vertex2 = remap[face.vertex2];
+			face.vertex3 = remap[face.vertex3];
+		}
+		if (binMesh) {
+			for (auto& object : binMesh->objects) {
+				auto& indices = object.indices;
+				for (size_t i = 0; i < indices.size(); i++) {
+					indices.set(i, remap[indices[i]]);
+				}
+				indices.compact();
+			}
+		}
+	}
+
+	VertexCacheStats optimizeVertexCache(GeometryChunk* geometry, uint32_t cacheSize) {
+		VertexCacheStats stats = {0, 0, 0, 0};
+		if (geometry->format & RW_GEOMETRY_NATIVE) {
+			util::logger.warn("Cannot optimize native geometry");
+			return stats;
+		}
+
+		BinMeshPLGChunk* binMesh = findBinMesh(geometry);
+		std::vector<uint32_t> remap;
+		if (!optimizeTriangles(geometry->faces, binMesh, geometry->vertexCount, cacheSize, stats, remap)) {
+			return stats;
+		}
+
+		if (Chunk* extension = findPerVertexExtension(geometry)) {
+			util::logger.warn("Not renumbering vertices, %s may hold per-vertex data", getChunkName(extension->type));
+		} else {
+			remapIndices(geometry->faces, binMesh, remap);
+			for (auto& morphTarget : geometry->morphTargets) {
+				remapVertices(morphTarget.vertexPositions, remap);
+				remapVertices(morphTarget.vertexNormals, remap);
+			}
+			remapVertices(geometry->vertexColors, remap);
+			for (auto& layer : geometry->vertexUVLayers) {
+				remapVertices(layer, remap);
+			}
+		}
+
+		geometry->preWriteHook();
+		if (binMesh) binMesh->preWriteHook();
+		return stats;
+	}
+
+	VertexCacheStats optimizeVertexCache(AtomicSectionChunk* section, uint32_t cacheSize) {
+		VertexCacheStats stats = {0, 0, 0, 0};
+		std::vector<uint32_t> remap;
+		if (!optimizeTriangles(section->faces, section->binMeshPLG, section->vertexCount, cacheSize, stats, remap)) {
+			return stats;
+		}
+
+		if (Chunk* extension = findPerVertexExtension(section)) {
+			util::logger.warn("Not renumbering vertices, %s may hold per-vertex data", getChunkName(extension->type));
+		} else {
+			remapIndices(section->faces, section->binMeshPLG, remap);
+			remapVertices(section->vertexPositions, remap);
+			remapVertices(section->vertexColors, remap);
+			remapVertices(section->vertexUVs, remap);
+		}
+
+		section->preWriteHook();
+		if (section->binMeshPLG) section->binMeshPLG->preWriteHook();
+		return stats;
+	}
+
+	/// One float stream contributing to the welding key of each vertex
+	struct WeldStream {
+		const float* values;
+		uint32_t components;
+	};
+
+	template<typename T>
+	static void addWeldStream(std::vector<WeldStream>& streams, const std::vector<T>& values, uint32_t vertexCount) {
+		if (values.size() == vertexCount && vertexCount) {
+			streams.push_back({(const float*) values.data(), (uint32_t) (sizeof(T) / sizeof(float))});
+		}
+	}
+
+	/// Interleaves streams into one key per vertex and welds them, returning the new vertex count
+	static uint32_t weldStreams(const std::vector<WeldStream>& streams, const std::vector<geom::VertexColor>& colors,
+								uint32_t vertexCount, float epsilon, std::vector<uint32_t>& remap) {
+		uint32_t width = 0;
+		for (auto& stream : streams) width += stream.components;
+
+		std::vector<float> attributes((size_t) vertexCount * width);
+		uint32_t offset = 0;
+		for (auto& stream : streams) {
+			for (uint32_t i = 0; i < vertexCount; i++) {
+				for (uint32_t c = 0; c < stream.components; c++) {
+					// + 0 turns -0 into 0, so the bitwise compare treats them as equal
+					attributes[(size_t) i * width + offset + c] = stream.values[(size_t) i * stream.components + c] + 0.0f;
+				}
+			}
+			offset += stream.components;
+		}
+
+		const uint32_t* colorValues = colors.size() == vertexCount ? &colors[0].as_int : nullptr;
+		return geom::buildWeldRemap(attributes.data(), width, colorValues, vertexCount, epsilon, remap);
+	}
+
+	/// Applies a weld remap to faces and BinMesh indices, dropping faces and trilist BinMesh
+	/// triangles which become degenerate. Strips keep theirs, as they may join strip segments.
+	static void weldIndices(std::vector<geom::Face>& faces, BinMeshPLGChunk* binMesh, const std::vector<uint32_t>& remap) {
+		remapIndices(faces, binMesh, remap);
+		faces.erase(std::remove_if(faces.begin(), faces.end(), [](const geom::Face& face) {
+			return isDegenerate(face.vertex1, face.vertex2, face.vertex3);
+		}), faces.end());
+
+		if (binMesh && binMesh->flags == 0) {
+			std::vector<uint32_t> indices;
+			for (auto& object : binMesh->objects) {
+				object.indices.toVector(indices);
+				size_t count = 0;
+				for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+					if (isDegenerate(indices[i], indices[i + 1], indices[i + 2])) continue;
+					indices[count++] = indices[i];
+					indices[count++] = indices[i + 1];
+					indices[count++] = indices[i + 2];
+				}
+				indices.resize(count);
+				object.indices.assign(indices);
+				object.meshIndexCount = count;
+			}
+		}
+	}
+
+	uint32_t weldVertices(GeometryChunk* geometry, float epsilon) {
+		if (geometry->format & RW_GEOMETRY_NATIVE) {
+			util::logger.warn("Cannot weld native geometry");
+			return 0;
+		}
+		if (Chunk* extension = findPerVertexExtension(geometry)) {
+			util::logger.warn("Not welding vertices, %s may hold per-vertex data", getChunkName(extension->type));
+			return 0;
+		}
+
+		uint32_t vertexCount = geometry->vertexCount;
+		BinMeshPLGChunk* binMesh = findBinMesh(geometry);
+		if (!indicesInRange(geometry->faces, binMesh, vertexCount)) return 0;
+
+		// the first stream keys the spatial grid, so positions of the base morph target go first
+		std::vector<WeldStream> streams;
+		for (auto& morphTarget : geometry->morphTargets) {
+			addWeldStream(streams, morphTarget.vertexPositions, vertexCount);
+			addWeldStream(streams, morphTarget.vertexNormals, vertexCount);
+		}
+		for (auto& layer : geometry->vertexUVLayers) {
+			addWeldStream(streams, layer, vertexCount);
+		}
+
+		std::vector<uint32_t> remap;
+		uint32_t welded = weldStreams(streams, geometry->vertexColors, vertexCount, epsilon, remap);
+		if (welded == vertexCount) return 0;
+
+		weldIndices(geometry->faces, binMesh, remap);
+		for (auto& morphTarget : geometry->morphTargets) {
+			remapVertices(morphTarget.vertexPositions, remap, welded);
+			remapVertices(morphTarget.vertexNormals, remap, welded);
+		}
+		remapVertices(geometry->vertexColors, remap, welded);
+		for (auto& layer : geometry->vertexUVLayers) {
+			remapVertices(layer, remap, welded);
+		}
+		geometry->vertexCount = welded;
+
+		geometry->preWriteHook();
+		if (binMesh) binMesh->preWriteHook();
+		return vertexCount - welded;
+	}
+
+	uint32_t weldVertices(AtomicSectionChunk* section, float epsilon) {
+		if (Chunk* extension = findPerVertexExtension(section)) {
+			util::logger.warn("Not welding vertices, %s may hold per-vertex data", getChunkName(extension->type));
+			return 0;
+		}
+		uint32_t vertexCount = section->vertexCount;
+		BinMeshPLGChunk* binMesh = section->binMeshPLG;
+		if (!indicesInRange(section->faces, binMesh, vertexCount)) return 0;
+
+		std::vector<WeldStream> streams;
+		addWeldStream(streams, section->vertexPositions, vertexCount);
+		addWeldStream(streams, section->vertexUVs, vertexCount);
+
+		std::vector<uint32_t> remap;
+		uint32_t welded = weldStreams(streams, section->vertexColors, vertexCount, epsilon, remap);
+		if (welded == vertexCount) return 0;
+
+		weldIndices(section->faces, binMesh, remap);
+		remapVertices(section->vertexPositions, remap, welded);
+		remapVertices(section->vertexColors, remap, welded);
+		remapVertices(section->vertexUVs, remap, welded);
+		section->vertexCount = welded;
+
+		section->preWriteHook();
+		if (binMesh) binMesh->preWriteHook();
+		return vertexCount - welded;
+	}
+
+	uint32_t compactVertices(GeometryChunk* geometry) {
+		if (geometry->format & RW_GEOMETRY_NATIVE) {
+			util::logger.warn("Cannot compact native geometry");
+			return 0;
+		}
+		if (Chunk* extension = findPerVertexExtension(geometry)) {
+			util::logger.warn("Not removing vertices, %s may hold per-vertex data", getChunkName(extension->type));
+			return 0;
+		}
+		uint32_t vertexCount = geometry->vertexCount;
+		BinMeshPLGChunk* binMesh = findBinMesh(geometry);
+		if (!indicesInRange(geometry->faces, binMesh, vertexCount)) return 0;
+
+		std::vector<uint32_t> remap(vertexCount, NO_VERTEX);
+		for (auto& face : geometry->faces) {
+			remap[face.vertex1] = remap[face.vertex2] = remap[face.vertex3] = 0;
+		}
+		if (binMesh) {
+			for (auto& object : binMesh->objects) {
+				for (uint32_t index : object.indices) {
+					remap[index] = 0;
+				}
+			}
+		}
+
+		// unused vertices go after the used ones, where remapVertices drops them
+		uint32_t used = 0;
+		for (auto& entry : remap) {
+			if (entry == 0) entry = used++;
+		}
+		if (used == vertexCount) return 0;
+		uint32_t next = used;
+		for (auto& entry : remap) {
+			if (entry == NO_VERTEX) entry = next++;
+		}
+
+		remapIndices(geometry->faces, binMesh, remap);
+		for (auto& morphTarget : geometry->morphTargets) {
+			remapVertices(morphTarget.vertexPositions, remap, used);
+			remapVertices(morphTarget.vertexNormals, remap, used);
+		}
+		remapVertices(geometry->vertexColors, remap, used);
+		for (auto& layer : geometry->vertexUVLayers) {
+			remapVertices(layer, remap, used);
+		}
+		geometry->vertexCount = used;
+
+		geometry->preWriteHook();
+		if (binMesh) binMesh->preWriteHook();
+		return vertexCount - used;
+	}
+
+	/// Appends a copy of vertex sources[i] for each i, if values has one value per vertex
+	template<typename T>
+	static void appendVertexCopies(std::vector<T>& values, const std::vector<uint32_t>& sources, uint32_t vertexCount) {
+		if (values.size() != vertexCount) return;
+		values.reserve(vertexCount + sources.size());
+		for (uint32_t source : sources) {
+			values.push_back(values[source]);
+		}
+	}
+
+	/// Gives each material after the first its own copy of a vertex used by several materials.
+	/// Returns false, changing nothing, if the vertex count would no longer fit 16-bit faces.
+	static bool splitVerticesByMaterial(GeometryChunk* geometry, BinMeshPLGChunk* binMesh) {
+		const uint32_t NO_MATERIAL = 0xffffffffu;
+		uint32_t vertexCount = geometry->vertexCount;
+		std::vector<uint32_t> owner(vertexCount, NO_MATERIAL);
+		std::map<uint64_t, uint32_t> copies; // (vertex << 32 | material) to copy
+		std::vector<uint32_t> sources;
+
+		auto split = [&](uint32_t vertex, uint32_t material) -> uint32_t {
+			if (owner[vertex] == NO_MATERIAL) owner[vertex] = material;
+			if (owner[vertex] == material) return vertex;
+			auto inserted = copies.insert(std::make_pair((uint64_t) vertex << 32 | material,
+														 vertexCount + (uint32_t) sources.size()));
+			if (inserted.second) sources.push_back(vertex);
+			return inserted.first->second;
+		};
+
+		std::vector<geom::Face> faces = geometry->faces;
+		for (auto& face : faces) {
+			face.vertex1 = split(face.vertex1, face.material);
+			face.vertex2 = split(face.vertex2, face.material);
+			face.vertex3 = split(face.vertex3, face.material);
+		}
+		if (sources.empty()) return true;
+		if (vertexCount + sources.size() > 0x10000) {
+			util::logger.warn("Splitting vertices by material needs %d vertices, more than faces can address",
+							  (int) (vertexCount + sources.size()));
+			return false;
+		}
+
+		geometry->faces.swap(faces);
+		if (binMesh) {
+			for (auto& object : binMesh->objects) {
+				auto& indices = object.indices;
+				for (size_t i = 0; i < indices.size(); i++) {
+					uint32_t vertex = indices[i];
+					if (owner[vertex] == object.material) continue;
+					auto it = copies.find((uint64_t) vertex << 32 | object.material);
+					if (it != copies.end()) indices.set(i, it->second);
+				}
+			}
+		}
+
+		for (auto& morphTarget : geometry->morphTargets) {
+			appendVertexCopies(morphTarget.vertexPositions, sources, vertexCount);
+			appendVertexCopies(morphTarget.vertexNormals, sources, vertexCount);
+		}
+		appendVertexCopies(geometry->vertexColors, sources, vertexCount);
+		for (auto& layer : geometry->vertexUVLayers) {
+			appendVertexCopies(layer, sources, vertexCount);
+		}
+		geometry->vertexCount = vertexCount + sources.size();
+		return true;
+	}
+
+	bool generateNormals(GeometryChunk* geometry, const NormalOptions& options) {
+		if (geometry->format & RW_GEOMETRY_NATIVE) {
+			util::logger.warn("Cannot generate normals for native geometry");
+			return false;
+		}
+		BinMeshPLGChunk* binMesh = findBinMesh(geometry);
+		if (!indicesInRange(geometry->faces, binMesh, geometry->vertexCount)) return false;
+
+		bool split = false;
+		if (options.splitByMaterial) {
+			if (Chunk* extension = findPerVertexExtension(geometry)) {
+				util::logger.warn("Not splitting vertices by material, %s may hold per-vertex data",
+								  getChunkName(extension->type));
+			} else {
+				split = splitVerticesByMaterial(geometry, binMesh);
+			}
+		}
+
+		std::vector<uint32_t> list;
+		facesToList(geometry->faces, list);
+		for (auto& morphTarget : geometry->morphTargets) {
+			if (morphTarget.vertexPositions.size() != geometry->vertexCount) continue;
+			morphTarget.vertexNormals.resize(geometry->vertexCount);
+			geom::computeNormals(morphTarget.vertexPositions.data(), geometry->vertexCount, list.data(), list.size(),
+								 options.weighting, options.threads, morphTarget.vertexNormals.data());
+		}
+		geometry->format |= RW_GEOMETRY_NORMALS;
+
+		geometry->preWriteHook();
+		if (split && binMesh) binMesh->preWriteHook();
+		return true;
+	}
+
+	static bool buildBinMeshObjects(const std::vector<geom::Face>& faces, uint32_t vertexCount,
+									const BinMeshOptions& options,
+									std::vector<BinMeshPLGChunk::BinMeshObject>& objects) {
+		if (options.indices16 && vertexCount > 0x10000) {
+			util::logger.warn("%d vertices cannot be addressed with 16-bit indices", vertexCount);
+			return false;
+		}
+
+		std::vector<uint32_t> order, list;
+		geom::sortFacesByMaterial(faces, order);
+		objects.clear();
+		for (size_t i = 0; i < order.size();) {
+			uint16_t material = faces[order[i]].material;
+			list.clear();
+			for (; i < order.size() && faces[order[i]].material == material; i++) {
+				auto& face = faces[order[i]];
+				if (face.vertex1 >= vertexCount || face.vertex2 >= vertexCount || face.vertex3 >= vertexCount) {
+					util::logger.warn("Face %d references a vertex out of range", order[i]);
+					return false;
+				}
+				list.push_back(face.vertex1);
+				list.push_back(face.vertex2);
+				list.push_back(face.vertex3);
+			}
+
+			objects.emplace_back();
+			auto& object = objects.back();
+			object.material = material;
+			if (options.strip) {
+				std::vector<uint32_t> strip;
+				geom::listToStrip(list.data(), list.size(), strip);
+				object.indices.assign(strip);
+			} else {
+				object.indices.assign(list);
+			}
+			object.meshIndexCount = object.indices.size();
+		}
+		return true;
+	}
+
+	ListChunk* getExtension(ListChunk* parent, std::vector<Chunk*>* extensions) {
+		Chunk* replaced = nullptr;
+		ListChunk* extension = nullptr;
+		for (auto& child : parent->children) {
+			if (child->type != RW_EXTENSION) continue;
+			if (child->isList()) return (ListChunk*) child;
+			// an empty extension is read as a struct, so replace it with a list
+			replaced = child;
+			extension = new ListChunk(RW_EXTENSION, parent->version);
+			child = extension;
+			break;
+		}
+		if (!extension) {
+			extension = new ListChunk(RW_EXTENSION, parent->version);
+			parent->addChild(extension);
+		}
+
+		if (extensions) {
+			// keep the geometry's list of extension chunks in step
+			auto it = std::find(extensions->begin(), extensions->end(), replaced ? replaced : extension);
+			if (it != extensions->end()) {
+				*it = extension;
+			} else {
+				extensions->push_back(extension);
+			}
+		}
+		delete replaced;
+		parent->invalidateHash();
+		return extension;
+	}
+
+	static BinMeshPLGChunk* attachBinMesh(ListChunk* parent, BinMeshPLGChunk* binMesh, bool strip,
+										  std::vector<BinMeshPLGChunk::BinMeshObject>& objects,
+										  std::vector<Chunk*>* extensions) {
+		if (!binMesh) {
+			ListChunk* extension = getExtension(parent, extensions);
+			binMesh = new BinMeshPLGChunk(RW_BINMESH_PLG, parent->version);
+			extension->addChild(binMesh);
+			extension->invalidateHash();
+		}
+
+		binMesh->flags = strip ? 1 : 0;
+		binMesh->objects.swap(objects);
+		binMesh->preWriteHook();
+		parent->invalidateHash();
+		return binMesh;
+	}
+
+	BinMeshPLGChunk* rebuildBinMesh(GeometryChunk* geometry, const BinMeshOptions& options) {
+		std::vector<BinMeshPLGChunk::BinMeshObject> objects;
+		if (!buildBinMeshObjects(geometry->faces, geometry->vertexCount, options, objects)) {
+			return nullptr;
+		}
+		return attachBinMesh(geometry, findBinMesh(geometry), options.strip, objects, &geometry->extensions);
+	}
+
+	BinMeshPLGChunk* rebuildBinMesh(AtomicSectionChunk* section, const BinMeshOptions& options) {
+		std::vector<BinMeshPLGChunk::BinMeshObject> objects;
+		if (!buildBinMeshObjects(section->faces, section->vertexCount, options, objects)) {
+			return nullptr;
+		}
+		section->binMeshPLG = attachBinMesh(section, section->binMeshPLG, options.strip, objects, nullptr);
+		return section->binMeshPLG;
+	}
+
+	bool validateBinMesh(BinMeshPLGChunk* binMesh, const std::vector<geom::Face>& faces, uint32_t vertexCount) {
+		bool valid = true;
+		if (binMesh->objectCount != binMesh->objects.size()) {
+			util::logger.warn("BinMesh object count %d, but has %d objects", binMesh->objectCount, (int) binMesh->objects.size());
+			valid = false;
+		}
+
+		// triangles per material, ignoring degenerate ones
+		std::map<uint32_t, size_t> expected, actual;
+		for (auto& face : faces) {
+			if (!isDegenerate(face.vertex1, face.vertex2, face.vertex3)) {
+				expected[face.material]++;
+			}
+		}
+
+		uint32_t total = 0;
+		std::vector<uint32_t> list, indices;
+		for (size_t i = 0; i < binMesh->objects.size(); i++) {
+			auto& object = binMesh->objects[i];
+			object.indices.toVector(indices);
+			if (object.meshIndexCount != object.indices.size()) {
+				util::logger.warn("BinMesh object %d index count %d, but has %d indices", (int) i,
+								  object.meshIndexCount, (int) object.indices.size());
+				valid = false;
+			}
+			total += indices.size();
+
+			for (uint32_t index : indices) {
+				if (index >= vertexCount) {
+					util::logger.warn("BinMesh object %d index %d out of range (%d vertices)", (int) i, index, vertexCount);
+					valid = false;
+					break;
+				}
+			}
+
+			list.clear();
+			if (binMesh->flags == 1) {
+				geom::stripToList(indices.data(), indices.size(), list);
+			} else {
+				if (indices.size() % 3) {
+					util::logger.warn("BinMesh object %d has %d indices, not a multiple of 3", (int) i,
+									  (int) indices.size());
+					valid = false;
+				}
+				list.assign(indices.begin(), indices.end() - indices.size() % 3);
+			}
+			for (size_t j = 0; j < list.size(); j += 3) {
+				if (!isDegenerate(list[j], list[j + 1], list[j + 2])) {
+					actual[object.material]++;
+				}
+			}
+		}
+
+		if (total != binMesh->indexCount) {
+			util::logger.warn("BinMesh index count %d, but objects hold %d indices", binMesh->indexCount, total);
+			valid = false;
+		}
+
+		for (auto& entry : expected) {
+			size_t count = actual.count(entry.first) ? actual[entry.first] : 0;
+			if (count != entry.second) {
+				util::logger.warn("Material %d has %d faces, but %d BinMesh triangles", entry.first,
+								  (int) entry.second, (int) count);
+				valid = false;
+			}
+		}
+		for (auto& entry : actual) {
+			if (!expected.count(entry.first)) {
+				util::logger.warn("Material %d has no faces, but %d BinMesh triangles", entry.first, (int) entry.second);
+				valid = false;
+			}
+		}
+		return valid;
+	}
+
+	namespace geom {
+		template<typename T>
+		static const T* stream(const std::vector<T>& values, uint32_t count) {
+			return values.size() >= count && count ? values.data() : nullptr;
+		}
+
+		MeshView::MeshView(GeometryChunk* geometry, uint32_t morphTarget) {
+			vertexCount = geometry->vertexCount;
+			positions = nullptr;
+			normals = nullptr;
+			if (morphTarget < geometry->morphTargets.size()) {
+				auto& target = geometry->morphTargets[morphTarget];
+				positions = stream(target.vertexPositions, vertexCount);
+				normals = stream(target.vertexNormals, vertexCount);
+			}
+			colors = stream(geometry->vertexColors, vertexCount);
+			for (auto& layer : geometry->vertexUVLayers) {
+				uvLayers.push_back(stream(layer, vertexCount));
+			}
+			faces = &geometry->faces;
+			binMesh = findBinMesh(geometry);
+		}
+
+		MeshView::MeshView(AtomicSectionChunk* section) {
+			vertexCount = section->vertexCount;
+			positions = stream(section->vertexPositions, vertexCount);
+			normals = nullptr;
+			colors = stream(section->vertexColors, vertexCount);
+			uvLayers.push_back(stream(section->vertexUVs, vertexCount));
+			faces = &section->faces;
+			binMesh = section->binMeshPLG;
+		}
+
+		size_t stripToList(const uint32_t* strip, size_t count, std::vector<uint32_t>& out) {
+			if (count < 3) return 0;
+			size_t triangles = count - 2;
+			size_t start = out.size();
+			out.resize(start + triangles * 3);
+			uint32_t* dst = out.data() + start;
+
+			size_t i = 0;
+#ifdef __SSE2__
+			// test four triangles for degeneracy at once; strips are mostly non-degenerate runs
+			for (; i + 4 <= triangles; i += 4) {
+				__m128i a = _mm_loadu_si128((const __m128i*) (strip + i));
+				__m128i b = _mm_loadu_si128((const __m128i*) (strip + i + 1));
+				__m128i c = _mm_loadu_si128((const __m128i*) (strip + i + 2));
+				__m128i degenerate = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi32(a, b), _mm_cmpeq_epi32(b, c)),
+												  _mm_cmpeq_epi32(a, c));
+				int mask = _mm_movemask_ps(_mm_castsi128_ps(degenerate));
+				for (int lane = 0; lane < 4; lane++) {
+					size_t t = i + lane;
+					// odd triangles of a strip have reversed winding
+					size_t odd = t & 1;
+					dst[0] = strip[t + odd];
+					dst[1] = strip[t + 1 - odd];
+					dst[2] = strip[t + 2];
+					dst += ((mask >> lane) & 1) ? 0 : 3;
+				}
+			}
+#endif
+			for (; i < triangles; i++) {
+				size_t odd = i & 1;
+				dst[0] = strip[i + odd];
+				dst[1] = strip[i + 1 - odd];
+				dst[2] = strip[i + 2];
+				bool degenerate = strip[i] == strip[i + 1] || strip[i + 1] == strip[i + 2] || strip[i] == strip[i + 2];
+				dst += degenerate ? 0 : 3;
+			}
+
+			size_t written = dst - (out.data() + start);
+			out.resize(start + written);
+			return written / 3;
+		}
+
+		static const uint32_t NO_TRIANGLE = 0xffffffffu;
+
+		class Stripifier {
+		public:
+			std::vector<uint32_t> triangles; // three indices each
+			/// triangle across each edge (v[e], v[e + 1]) with opposite winding, or NO_TRIANGLE
+			std::vector<uint32_t> adjacency;
+			std::vector<bool> used;
+
+			Stripifier(const uint32_t* list, size_t count) {
+				for (size_t i = 0; i + 3 <= count; i += 3) {
+					if (list[i] == list[i + 1] || list[i + 1] == list[i + 2] || list[i] == list[i + 2]) continue;
+					triangles.insert(triangles.end(), list + i, list + i + 3);
+				}
+				uint32_t triangleCount = triangles.size() / 3;
+				used.assign(triangleCount, false);
+				adjacency.assign(triangleCount * 3, NO_TRIANGLE);
+
+				// sort edges by their undirected key, so neighbours end up next to each other
+				struct Edge {
+					uint64_t key;
+					uint32_t slot; // triangle * 3 + edge
+					bool reversed;
+				};
+				std::vector<Edge> edges(triangleCount * 3);
+				for (uint32_t slot = 0; slot < triangleCount * 3; slot++) {
+					uint32_t a = triangles[slot];
+					uint32_t b = triangles[slot % 3 == 2 ? slot - 2 : slot + 1];
+					edges[slot].key = a < b ? (uint64_t) a << 32 | b : (uint64_t) b << 32 | a;
+					edges[slot].slot = slot;
+					edges[slot].reversed = a > b;
+				}
+				std::sort(edges.begin(), edges.end(), [](const Edge& x, const Edge& y) {
+					return x.key < y.key || (x.key == y.key && x.slot < y.slot);
+				});
+
+				for (size_t i = 0; i < edges.size();) {
+					size_t end = i + 1;
+					while (end < edges.size() && edges[end].key == edges[i].key) end++;
+					// pair each edge with the first edge of opposite direction (manifold meshes have one)
+					for (size_t j = i; j < end; j++) {
+						for (size_t k = i; k < end; k++) {
+							if (edges[k].reversed != edges[j].reversed) {
+								adjacency[edges[j].slot] = edges[k].slot / 3;
+								break;
+							}
+						}
+					}
+					i = end;
+				}
+			}
+
+			/// Number of unused triangles sharing an edge with t
+			int openNeighbours(uint32_t t) {
+				int count = 0;
+				for (int e = 0; e < 3; e++) {
+					uint32_t neighbour = adjacency[t * 3 + e];
+					if (neighbour != NO_TRIANGLE && !used[neighbour]) count++;
+				}
+				return count;
+			}
+
+			/// Finds the unused neighbour of triangle t containing the directed edge a -> b, and
+			/// its third vertex
+			bool findTriangle(uint32_t t, uint32_t a, uint32_t b, const std::vector<bool>& taken,
+							  uint32_t& triangle, uint32_t& third) {
+				for (int e = 0; e < 3; e++) {
+					uint32_t neighbour = adjacency[t * 3 + e];
+					if (neighbour == NO_TRIANGLE || used[neighbour] || taken[neighbour]) continue;
+					const uint32_t* v = &triangles[neighbour * 3];
+					for (int f = 0; f < 3; f++) {
+						if (v[f] == a && v[(f + 1) % 3] == b) {
+							triangle = neighbour;
+							third = v[(f + 2) % 3];
+							return true;
+						}
+					}
+				}
+				return false;
+			}
+
+			/// Grows a strip from triangle start rotated so it begins at vertex rotation
+			void grow(uint32_t start, int rotation, std::vector<uint32_t>& strip, std::vector<uint32_t>& members,
+					  std::vector<bool>& taken) {
+				const uint32_t* v = &triangles[start * 3];
+				strip.assign({v[rotation], v[(rotation + 1) % 3], v[(rotation + 2) % 3]});
+				members.assign(1, start);
+				taken[start] = true;
+
+				while (true) {
+					size_t n = strip.size();
+					uint32_t x = strip[n - 2];
+					uint32_t y = strip[n - 1];
+					// the next triangle is odd when the strip has an odd number of triangles so far
+					bool nextOdd = (n - 2) % 2 == 1;
+					uint32_t triangle, third;
+					bool found = nextOdd ? findTriangle(members.back(), y, x, taken, triangle, third)
+										 : findTriangle(members.back(), x, y, taken, triangle, third);
+					if (!found) break;
+					strip.push_back(third);
+					members.push_back(triangle);
+					taken[triangle] = true;
+				}
+
+				for (uint32_t member : members) {
+					taken[member] = false;
+				}
+			}
+
+			void build(std::vector<uint32_t>& out) {
+				uint32_t triangleCount = used.size();
+				std::vector<bool> taken(triangleCount, false);
+				std::vector<uint32_t> strip, members, best, bestMembers;
+				size_t base = out.size();
+
+				// start from triangles with few neighbours, which are otherwise left isolated
+				std::vector<std::pair<int, uint32_t>> order;
+				for (uint32_t t = 0; t < triangleCount; t++) {
+					order.push_back(std::make_pair(openNeighbours(t), t));
+				}
+				std::stable_sort(order.begin(), order.end(),
+								 [](const std::pair<int, uint32_t>& a, const std::pair<int, uint32_t>& b) {
+									 return a.first < b.first;
+								 });
+
+				for (auto& entry : order) {
+					uint32_t start = entry.second;
+					if (used[start]) continue;
+
+					best.clear();
+					for (int rotation = 0; rotation < 3; rotation++) {
+						grow(start, rotation, strip, members, taken);
+						if (strip.size() > best.size()) {
+							best.swap(strip);
+							bestMembers.swap(members);
+						}
+					}
+					for (uint32_t member : bestMembers) {
+						used[member] = true;
+					}
+
+					if (out.size() > base) {
+						// join with degenerate triangles, keeping the new strip on an even position
+						uint32_t last = out.back();
+						out.push_back(last);
+						if ((out.size() - base) % 2 == 0) out.push_back(last);
+						out.push_back(best[0]);
+					}
+					out.insert(out.end(), best.begin(), best.end());
+				}
+			}
+		};
+
+		void listToStrip(const uint32_t* list, size_t count, std::vector<uint32_t>& out) {
+			Stripifier stripifier(list, count);
+			stripifier.build(out);
+		}
+
+		void sortFacesByMaterial(const std::vector<Face>& faces, std::vector<uint32_t>& order) {
+			size_t count = faces.size();
+			order.resize(count);
+			for (size_t i = 0; i < count; i++) {
+				order[i] = i;
+			}
+			if (!count) return;
+
+			// histograms of both bytes of the material, gathered in one pass
+			uint32_t histogram[2][256] = {};
+			for (auto& face : faces) {
+				histogram[0][face.material & 0xff]++;
+				histogram[1][face.material >> 8]++;
+			}
+
+			std::vector<uint32_t> scratch(count);
+			for (int pass = 0; pass < 2; pass++) {
+				int shift = pass * 8;
+				uint32_t* digits = histogram[pass];
+				// a byte shared by every face (usually the high one) needs no pass
+				if (digits[(faces[0].material >> shift) & 0xff] == count) continue;
+
+				uint32_t offsets[256];
+				uint32_t sum = 0;
+				for (int digit = 0; digit < 256; digit++) {
+					offsets[digit] = sum;
+					sum += digits[digit];
+				}
+				for (size_t i = 0; i < count; i++) {
+					uint32_t face = order[i];
+					scratch[offsets[(faces[face].material >> shift) & 0xff]++] = face;
+				}
+				order.swap(scratch);
+			}
+		}
+
+		float computeACMR(const uint32_t* indices, size_t count, uint32_t vertexCount, uint32_t cacheSize) {
+			size_t triangles = count / 3;
+			if (!triangles) return 0;
+
+			// FIFO cache: a vertex is cached while fewer than cacheSize vertices were loaded after it
+			std::vector<uint32_t> loaded(vertexCount, 0);
+			uint32_t time = cacheSize + 1;
+			size_t misses = 0;
+			for (size_t i = 0; i < triangles * 3; i++) {
+				uint32_t v = indices[i];
+				if (time - loaded[v] > cacheSize) {
+					loaded[v] = time++;
+					misses++;
+				}
+			}
+			return (float) misses / triangles;
+		}
+
+		void tipsify(const uint32_t* indices, size_t count, uint32_t vertexCount, uint32_t cacheSize,
+					 std::vector<uint32_t>& order) {
+			uint32_t triangleCount = count / 3;
+			order.clear();
+			order.reserve(triangleCount);
+
+			// triangles using each vertex, in compressed rows
+			std::vector<uint32_t> live(vertexCount, 0);
+			for (uint32_t i = 0; i < triangleCount * 3; i++) {
+				live[indices[i]]++;
+			}
+			std::vector<uint32_t> offsets(vertexCount + 1, 0);
+			for (uint32_t v = 0; v < vertexCount; v++) {
+				offsets[v + 1] = offsets[v] + live[v];
+			}
+			std::vector<uint32_t> adjacency(triangleCount * 3);
+			std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+			for (uint32_t i = 0; i < triangleCount * 3; i++) {
+				adjacency[fill[indices[i]]++] = i / 3;
+			}
+
+			std::vector<uint32_t> cacheTime(vertexCount, 0);
+			std::vector<bool> emitted(triangleCount, false);
+			std::vector<uint32_t> deadEnd, candidates;
+			uint32_t time = cacheSize + 1;
+			uint32_t cursor = 0;
+
+			uint32_t fanning = vertexCount ? 0 : NO_VERTEX;
+			while (fanning != NO_VERTEX) {
+				// emit every remaining triangle around the fanning vertex
+				candidates.clear();
+				for (uint32_t k = offsets[fanning]; k < offsets[fanning + 1]; k++) {
+					uint32_t triangle = adjacency[k];
+					if (emitted[triangle]) continue;
+					emitted[triangle] = true;
+					order.push_back(triangle);
+					for (int corner = 0; corner < 3; corner++) {
+						uint32_t v = indices[triangle * 3 + corner];
+						deadEnd.push_back(v);
+						candidates.push_back(v);
+						live[v]--;
+						if (time - cacheTime[v] > cacheSize) {
+							cacheTime[v] = time++;
+						}
+					}
+				}
+
+				// prefer the oldest candidate that will still be cached once its triangles are emitted
+				uint32_t next = NO_VERTEX;
+				int64_t bestPriority = -1;
+				for (uint32_t v : candidates) {
+					if (!live[v]) continue;
+					int64_t priority = 0;
+					if (time - cacheTime[v] + 2 * live[v] <= cacheSize) {
+						priority = time - cacheTime[v];
+					}
+					if (priority > bestPriority) {
+						bestPriority = priority;
+						next = v;
+					}
+				}
+
+				// otherwise fall back to recently used vertices, then to any vertex with triangles left
+				while (next == NO_VERTEX && !deadEnd.empty()) {
+					uint32_t v = deadEnd.back();
+					deadEnd.pop_back();
+					if (live[v]) next = v;
+				}
+				while (next == NO_VERTEX && cursor < vertexCount) {
+					if (live[cursor]) {
+						next = cursor;
+					} else {
+						cursor++;
+					}
+				}
+				fanning = next;
+			}
+		}
+
+		void optimizeTriangleOrder(uint32_t* indices, size_t count, uint32_t vertexCount, uint32_t cacheSize) {
+			std::vector<uint32_t> order;
+			tipsify(indices, count, vertexCount, cacheSize, order);
+			std::vector<uint32_t> ordered(order.size() * 3);
+			for (size_t i = 0; i < order.size(); i++) {
+				memcpy(&ordered[i * 3], indices + order[i] * 3, 3 * sizeof(uint32_t));
+			}
+			memcpy(indices, ordered.data(), ordered.size() * sizeof(uint32_t));
+		}
+
+		void buildFetchRemap(const uint32_t* indices, size_t count, uint32_t vertexCount,
+							 std::vector<uint32_t>& remap) {
+			remap.assign(vertexCount, NO_VERTEX);
+			uint32_t next = 0;
+			for (size_t i = 0; i < count; i++) {
+				uint32_t v = indices[i];
+				if (v < vertexCount && remap[v] == NO_VERTEX) {
+					remap[v] = next++;
+				}
+			}
+			for (uint32_t v = 0; v < vertexCount; v++) {
+				if (remap[v] == NO_VERTEX) {
+					remap[v] = next++;
+				}
+			}
+		}
+
+		/// Open addressing table of representative vertices, keyed by a hash of their grid cell
+		/// (or of their whole key when welding exactly). Several vertices may share a hash.
+		class WeldTable {
+		public:
+			WeldTable(uint32_t vertexCount) {
+				size_t capacity = 16;
+				while (capacity < (size_t) vertexCount * 2) capacity <<= 1;
+				mask = capacity - 1;
+				hashes.resize(capacity);
+				vertices.assign(capacity, NO_VERTEX);
+			}
+
+			/// Returns the first representative with this hash for which match is true
+			template<typename Match>
+			uint32_t find(uint64_t hash, Match match) const {
+				for (size_t slot = hash & mask; vertices[slot] != NO_VERTEX; slot = (slot + 1) & mask) {
+					if (hashes[slot] == hash && match(vertices[slot])) return vertices[slot];
+				}
+				return NO_VERTEX;
+			}
+
+			void insert(uint64_t hash, uint32_t vertex) {
+				size_t slot = hash & mask;
+				while (vertices[slot] != NO_VERTEX) slot = (slot + 1) & mask;
+				hashes[slot] = hash;
+				vertices[slot] = vertex;
+			}
+
+		private:
+			size_t mask;
+			std::vector<uint64_t> hashes;
+			std::vector<uint32_t> vertices;
+		};
+
+		uint32_t buildWeldRemap(const float* attributes, uint32_t width, const uint32_t* colors,
+								uint32_t vertexCount, float epsilon, std::vector<uint32_t>& remap) {
+			remap.assign(vertexCount, NO_VERTEX);
+			WeldTable table(vertexCount);
+			uint32_t gridDims = std::min(width, 3u);
+			uint32_t neighbours = gridDims == 3 ? 27 : gridDims == 2 ? 9 : gridDims == 1 ? 3 : 1;
+			uint32_t next = 0;
+
+			for (uint32_t i = 0; i < vertexCount; i++) {
+				const float* key = attributes + (size_t) i * width;
+				auto matches = [&](uint32_t other) {
+					if (colors && colors[other] != colors[i]) return false;
+					const float* otherKey = attributes + (size_t) other * width;
+					if (epsilon <= 0) return std::memcmp(key, otherKey, width * sizeof(float)) == 0;
+					for (uint32_t c = 0; c < width; c++) {
+						if (!(std::fabs(key[c] - otherKey[c]) <= epsilon)) return false;
+					}
+					return true;
+				};
+
+				uint64_t hash;
+				uint32_t found;
+				if (epsilon > 0) {
+					// any match lies within one cell of this vertex's cell on each axis
+					int64_t cell[3];
+					for (uint32_t d = 0; d < gridDims; d++) {
+						double coordinate = std::floor(key[d] / (double) epsilon);
+						cell[d] = coordinate > -1e18 && coordinate < 1e18 ? (int64_t) coordinate : 0;
+					}
+					hash = util::hash64(cell, gridDims * sizeof(int64_t));
+					found = NO_VERTEX;
+					for (uint32_t n = 0; n < neighbours && found == NO_VERTEX; n++) {
+						int64_t neighbour[3];
+						for (uint32_t d = 0, m = n; d < gridDims; d++, m /= 3) {
+							neighbour[d] = cell[d] + (int64_t) (m % 3) - 1;
+						}
+						found = table.find(util::hash64(neighbour, gridDims * sizeof(int64_t)), matches);
+					}
+				} else {
+					hash = util::hash64(key, width * sizeof(float), colors ? colors[i] : 0);
+					found = table.find(hash, matches);
+				}
+
+				if (found == NO_VERTEX) {
+					table.insert(hash, i);
+					remap[i] = next++;
+				} else {
+					remap[i] = remap[found];
+				}
+			}
+			return next;
+		}
+
+		/// Triangles weighted per task, so small meshes stay on one thread
+		static const size_t NORMAL_TASK_SIZE = 4096;
+
+		/// atan2 for y >= 0 (an angle in [0, pi]) to within 1e-5, far cheaper than std::atan2
+		static inline float angleOf(float y, float x) {
+			float ax = std::fabs(x);
+			float largest = std::max(ax, y);
+			if (largest == 0) return 0;
+			float r = std::min(ax, y) / largest;
+			float r2 = r * r;
+			float angle = r * (0.99997726f + r2 * (-0.33262347f + r2 * (0.19354346f + r2 * (-0.11643287f
+						  + r2 * (0.05265332f + r2 * -0.01172120f)))));
+			if (y > ax) angle = 1.57079633f - angle;
+			if (x < 0) angle = 3.14159265f - angle;
+			return angle;
+		}
+
+		void computeNormals(const VertexPosition* positions, uint32_t vertexCount, const uint32_t* indices,
+							size_t count, NormalWeighting weighting, unsigned threads, VertexNormal* out) {
+			size_t triangles = count / 3;
+
+			// weighted face normal for each triangle corner
+			std::vector<VertexNormal> corners(triangles * 3);
+			util::parallelFor(triangles, threads, NORMAL_TASK_SIZE, [&](size_t begin, size_t end) {
+				for (size_t t = begin; t < end; t++) {
+					const uint32_t* triangle = indices + t * 3;
+					const VertexPosition& a = positions[triangle[0]];
+					const VertexPosition& b = positions[triangle[1]];
+					const VertexPosition& c = positions[triangle[2]];
+					float abx = b.x - a.x, aby = b.y - a.y, abz = b.z - a.z;
+					float acx = c.x - a.x, acy = c.y - a.y, acz = c.z - a.z;
+					// cross product, twice the triangle's area in length
+					float nx = aby * acz - abz * acy;
+					float ny = abz * acx - abx * acz;
+					float nz = abx * acy - aby * acx;
+
+					VertexNormal* corner = &corners[t * 3];
+					if (weighting == NORMALS_AREA) {
+						corner[0] = corner[1] = corner[2] = {nx, ny, nz};
+						continue;
+					}
+
+					float length = std::sqrt(nx * nx + ny * ny + nz * nz);
+					if (length == 0) {
+						corner[0] = corner[1] = corner[2] = {0, 0, 0};
+						continue;
+					}
+					nx /= length;
+					ny /= length;
+					nz /= length;
+					// the angle at each corner, from its edges' dot product and the shared cross length
+					float bcx = c.x - b.x, bcy = c.y - b.y, bcz = c.z - b.z;
+					float angles[3] = {
+						angleOf(length, abx * acx + aby * acy + abz * acz),
+						angleOf(length, -(abx * bcx + aby * bcy + abz * bcz)),
+						angleOf(length, acx * bcx + acy * bcy + acz * bcz)
+					};
+					for (int k = 0; k < 3; k++) {
+						corner[k] = {nx * angles[k], ny * angles[k], nz * angles[k]};
+					}
+				}
+			});
+
+			// corners grouped by vertex, in triangle order
+			std::vector<uint32_t> offsets(vertexCount + 1, 0);
+			for (size_t i = 0; i < triangles * 3; i++) {
+				offsets[indices[i] + 1]++;
+			}
+			for (uint32_t v = 0; v < vertexCount; v++) {
+				offsets[v + 1] += offsets[v];
+			}
+			std::vector<uint32_t> vertexCorners(triangles * 3);
+			std::vector<uint32_t> next(offsets.begin(), offsets.end() - 1);
+			for (size_t i = 0; i < triangles * 3; i++) {
+				vertexCorners[next[indices[i]]++] = (uint32_t) i;
+			}
+
+			util::parallelFor(vertexCount, threads, NORMAL_TASK_SIZE, [&](size_t begin, size_t end) {
+				for (size_t v = begin; v < end; v++) {
+					float x = 0, y = 0, z = 0;
+					for (uint32_t i = offsets[v]; i < offsets[v + 1]; i++) {
+						const VertexNormal& corner = corners[vertexCorners[i]];
+						x += corner.x;
+						y += corner.y;
+						z += corner.z;
+					}
+					float length = std::sqrt(x * x + y * y + z * z);
+					if (length > 0) {
+						out[v] = {x / length, y / length, z / length};
+					} else {
+						out[v] = {0, 0, 0};
+					}
+				}
+			});
+		}
+	}
+}
\ No newline at end of file
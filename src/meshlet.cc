@@ -0,0 +1,394 @@
+/*
+ * File: meshlet.cc
+ * Author: DeadlyFugu
+ * License: zlib
+ * Description: Splits Geometry and Atomic Section triangles into small clusters for culling
+ */
+
+#include "meshlet.hh"
+#include "mesh.hh"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace rw {
+	namespace geom {
+		static_assert(sizeof(Meshlet) == 44, "Meshlet is stored as is");
+
+		bool isMeshletBackfacing(const Meshlet& meshlet, const Vector3f& viewpoint) {
+			float dx = meshlet.bounds.x - viewpoint.x;
+			float dy = meshlet.bounds.y - viewpoint.y;
+			float dz = meshlet.bounds.z - viewpoint.z;
+			float along = dx * meshlet.coneAxis[0] + dy * meshlet.coneAxis[1] + dz * meshlet.coneAxis[2];
+			return along >= meshlet.coneCutoff * std::sqrt(dx * dx + dy * dy + dz * dz) + meshlet.bounds.radius;
+		}
+
+		/// Fills in the bounds and normal cone of a finished meshlet
+		static void finishMeshlet(const VertexPosition* positions, const uint32_t* vertices,
+								  const uint8_t* triangles, Meshlet& meshlet) {
+			VertexPosition points[256];
+			for (uint32_t i = 0; i < meshlet.vertexCount; i++) {
+				points[i] = positions[vertices[i]];
+			}
+			computeBoundingSphere(points, meshlet.vertexCount, meshlet.bounds);
+
+			float normals[255][3];
+			uint32_t normalCount = 0;
+			float axis[3] = {0, 0, 0};
+			for (uint32_t t = 0; t < meshlet.triangleCount; t++) {
+				const VertexPosition& a = points[triangles[t * 3 + 0]];
+				const VertexPosition& b = points[triangles[t * 3 + 1]];
+				const VertexPosition& c = points[triangles[t * 3 + 2]];
+				float ux = b.x - a.x, uy = b.y - a.y, uz = b.z - a.z;
+				float vx = c.x - a.x, vy = c.y - a.y, vz = c.z - a.z;
+				float* n = normals[normalCount];
+				n[0] = uy * vz - uz * vy;
+				n[1] = uz * vx - ux * vz;
+				n[2] = ux * vy - uy * vx;
+				float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+				if (length == 0) continue;
+				for (int k = 0; k < 3; k++) {
+					n[k] /= length;
+					axis[k] += n[k];
+				}
+				normalCount++;
+			}
+
+			// a cone wider than about 84 degrees either way rarely culls anything
+			meshlet.coneAxis[0] = meshlet.coneAxis[1] = meshlet.coneAxis[2] = 0;
+			meshlet.coneCutoff = 1;
+			float length = std::sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+			if (normalCount == 0 || length == 0) return;
+			for (int k = 0; k < 3; k++) axis[k] /= length;
+
+			float minDot = 1;
+			for (uint32_t i = 0; i < normalCount; i++) {
+				float* n = normals[i];
+				minDot = std::min(minDot, n[0] * axis[0] + n[1] * axis[1] + n[2] * axis[2]);
+			}
+			if (minDot <= 0.1f) return;
+
+			memcpy(meshlet.coneAxis, axis, sizeof(axis));
+			meshlet.coneCutoff = std::sqrt(1 - minDot * minDot);
+		}
+
+		bool buildMeshlets(const VertexPosition* positions, uint32_t vertexCount, const std::vector<Face>& faces,
+						   const MeshletOptions& options, MeshletSet& out) {
+			out.clear();
+			if (options.maxVertices < 3 || options.maxVertices > 255 || options.maxTriangles < 1
+				|| options.maxTriangles > 255) {
+				util::logger.warn("Meshlets of %u vertices and %u triangles are not supported",
+								  options.maxVertices, options.maxTriangles);
+				return false;
+			}
+			for (auto& face : faces) {
+				if (face.vertex1 >= vertexCount || face.vertex2 >= vertexCount || face.vertex3 >= vertexCount) {
+					util::logger.warn("Face index out of range for %u vertices", vertexCount);
+					return false;
+				}
+			}
+
+			// faces around each vertex
+			size_t faceCount = faces.size();
+			std::vector<uint32_t> firstFace(vertexCount + 1, 0), vertexFaces(faceCount * 3);
+			for (auto& face : faces) {
+				firstFace[face.vertex1 + 1]++;
+				firstFace[face.vertex2 + 1]++;
+				firstFace[face.vertex3 + 1]++;
+			}
+			for (uint32_t v = 0; v < vertexCount; v++) {
+				firstFace[v + 1] += firstFace[v];
+			}
+			{
+				std::vector<uint32_t> cursor(firstFace.begin(), firstFace.end() - 1);
+				for (size_t f = 0; f < faceCount; f++) {
+					vertexFaces[cursor[faces[f].vertex1]++] = (uint32_t) f;
+					vertexFaces[cursor[faces[f].vertex2]++] = (uint32_t) f;
+					vertexFaces[cursor[faces[f].vertex3]++] = (uint32_t) f;
+				}
+			}
+
+			std::vector<bool> used(faceCount, false);
+			for (size_t f = 0; f < faceCount; f++) {
+				const Face& face = faces[f];
+				used[f] = face.vertex1 == face.vertex2 || face.vertex2 == face.vertex3 || face.vertex1 == face.vertex3;
+			}
+
+			const uint8_t UNUSED = 0xff;
+			const uint32_t NONE = 0xffffffffu;
+			std::vector<uint8_t> local(vertexCount, UNUSED);
+			std::vector<uint32_t> vertices; // of all meshlets
+			std::vector<uint32_t> candidates; // faces touching the current meshlet, possibly used
+			Meshlet meshlet = {};
+			float centre[3] = {0, 0, 0}; // sum of the meshlet's vertex positions
+			float last[3] = {0, 0, 0}; // centre of the last meshlet
+			size_t nextFace = 0;
+
+			auto distanceTo = [&](uint32_t f, const float point[3]) {
+				const Face& face = faces[f];
+				float d[3] = {0, 0, 0};
+				for (uint16_t v : {face.vertex1, face.vertex2, face.vertex3}) {
+					d[0] += positions[v].x;
+					d[1] += positions[v].y;
+					d[2] += positions[v].z;
+				}
+				for (int k = 0; k < 3; k++) d[k] = d[k] * (1.0f / 3) - point[k];
+				return d[0] * d[0] + d[1] * d[1] + d[2] * d[2];
+			};
+
+			auto flush = [&]() {
+				finishMeshlet(positions, vertices.data() + meshlet.vertexOffset,
+							  out.triangles.data() + meshlet.triangleOffset * 3, meshlet);
+				out.meshlets.push_back(meshlet);
+				for (int k = 0; k < 3; k++) {
+					last[k] = centre[k] / meshlet.vertexCount;
+					centre[k] = 0;
+				}
+				for (uint32_t i = 0; i < meshlet.vertexCount; i++) {
+					local[vertices[meshlet.vertexOffset + i]] = UNUSED;
+				}
+				meshlet = {};
+				meshlet.vertexOffset = (uint32_t) vertices.size();
+				meshlet.triangleOffset = (uint32_t) (out.triangles.size() / 3);
+			};
+
+			while (true) {
+				uint32_t best = NONE;
+				if (meshlet.triangleCount == 0) {
+					// start next to the last meshlet if possible, else at the next unused face
+					float bestDistance = 0;
+					for (uint32_t f : candidates) {
+						if (used[f]) continue;
+						float distance = distanceTo(f, last);
+						if (best == NONE || distance < bestDistance) {
+							best = f;
+							bestDistance = distance;
+						}
+					}
+					candidates.clear();
+					if (best == NONE) {
+						while (nextFace < faceCount && used[nextFace]) nextFace++;
+						if (nextFace == faceCount) break;
+						best = (uint32_t) nextFace;
+					}
+					meshlet.material = faces[best].material;
+				} else {
+					float mean[3];
+					for (int k = 0; k < 3; k++) mean[k] = centre[k] / meshlet.vertexCount;
+					uint32_t bestAdded = 4;
+					float bestDistance = 0;
+					size_t kept = 0;
+					for (uint32_t f : candidates) {
+						if (used[f]) continue;
+						candidates[kept++] = f;
+						const Face& face = faces[f];
+						if (face.material != meshlet.material) continue;
+						uint32_t added = (local[face.vertex1] == UNUSED) + (local[face.vertex2] == UNUSED)
+										 + (local[face.vertex3] == UNUSED);
+						if (added > bestAdded) continue;
+						float distance = distanceTo(f, mean);
+						if (added < bestAdded || distance < bestDistance) {
+							best = f;
+							bestAdded = added;
+							bestDistance = distance;
+						}
+					}
+					candidates.resize(kept);
+					if (best == NONE || meshlet.vertexCount + bestAdded > options.maxVertices) {
+						flush();
+						continue;
+					}
+				}
+
+				const Face& face = faces[best];
+				used[best] = true;
+				for (uint16_t v : {face.vertex1, face.vertex2, face.vertex3}) {
+					if (local[v] == UNUSED) {
+						local[v] = meshlet.vertexCount++;
+						vertices.push_back(v);
+						centre[0] += positions[v].x;
+						centre[1] += positions[v].y;
+						centre[2] += positions[v].z;
+						for (uint32_t i = firstFace[v]; i < firstFace[v + 1]; i++) {
+							if (!used[vertexFaces[i]]) candidates.push_back(vertexFaces[i]);
+						}
+					}
+					out.triangles.push_back(local[v]);
+				}
+				meshlet.triangleCount++;
+				if (meshlet.triangleCount == options.maxTriangles) flush();
+			}
+			if (meshlet.triangleCount > 0) flush();
+
+			out.vertices.assign(vertices);
+			return true;
+		}
+	}
+
+	void MeshletPLGChunk::dump(util::DumpWriter out) {
+		out.print("Meshlet PLG:");
+		out.print("  meshlet count: %d", meshletCount);
+		out.print("  vertex count: %d", vertexCount);
+		out.print("  triangle count: %d", triangleCount);
+		out.print("  index size: %d", indexSize);
+
+		if (!out.isVerbose()) return;
+		int idx = 0;
+		for (auto& meshlet : meshlets.meshlets) {
+			out.print("");
+			out.print("  Meshlet(%d):", idx++);
+			out.print("    vertices: %d at %d", meshlet.vertexCount, meshlet.vertexOffset);
+			out.print("    triangles: %d at %d", meshlet.triangleCount, meshlet.triangleOffset);
+			out.print("    material: %d", meshlet.material);
+			out.print("    bounds: vec3(%f, %f, %f) radius %f", meshlet.bounds.x, meshlet.bounds.y, meshlet.bounds.z,
+					  meshlet.bounds.radius);
+			out.print("    cone: vec3(%f, %f, %f) cutoff %f", meshlet.coneAxis[0], meshlet.coneAxis[1],
+					  meshlet.coneAxis[2], meshlet.coneCutoff);
+		}
+	}
+
+	void MeshletPLGChunk::dumpJson(util::JsonWriter& out) {
+		out.field("meshletCount", meshletCount);
+		out.field("vertexCount", vertexCount);
+		out.field("triangleCount", triangleCount);
+		out.field("indexSize", indexSize);
+
+		uint32_t cursor = 16;
+		dumpJsonBlob(out, "meshlets", cursor, meshletCount * sizeof(geom::Meshlet));
+		cursor += meshletCount * sizeof(geom::Meshlet);
+		dumpJsonBlob(out, "vertices", cursor, vertexCount * indexSize);
+		cursor += vertexCount * indexSize;
+		dumpJsonBlob(out, "triangles", cursor, triangleCount * 3);
+	}
+
+	void MeshletPLGChunk::postReadHook() {
+		data.seek(0);
+		meshlets.clear();
+		meshletCount = vertexCount = triangleCount = indexSize = 0;
+		if (data.size() < 16) {
+			util::logger.warn("Meshlet PLG is missing its header");
+			return;
+		}
+
+		data.read(&meshletCount);
+		data.read(&vertexCount);
+		data.read(&triangleCount);
+		data.read(&indexSize);
+
+		uint64_t size = 16 + (uint64_t) meshletCount * sizeof(geom::Meshlet) + (uint64_t) vertexCount * indexSize
+						+ (uint64_t) triangleCount * 3;
+		if ((indexSize != 2 && indexSize != 4) || size > data.size()) {
+			util::logger.warn("Meshlet PLG of %d meshlets does not fit in %d bytes", meshletCount, data.size());
+			return;
+		}
+
+		meshlets.meshlets.resize(meshletCount);
+		if (meshletCount) data.read(meshlets.meshlets.data(), meshletCount * sizeof(geom::Meshlet));
+
+		std::vector<uint32_t> vertices(vertexCount);
+		if (indexSize == 2) {
+			std::vector<uint16_t> narrow(vertexCount);
+			if (vertexCount) data.read(narrow.data(), vertexCount * 2);
+			geom::widenIndices(narrow.data(), vertices.data(), vertexCount);
+		} else if (vertexCount) {
+			data.read(vertices.data(), vertexCount * 4);
+		}
+		meshlets.vertices.assign(vertices);
+
+		meshlets.triangles.resize(triangleCount * 3);
+		if (triangleCount) data.read(meshlets.triangles.data(), triangleCount * 3);
+
+		for (auto& meshlet : meshlets.meshlets) {
+			if ((uint64_t) meshlet.vertexOffset + meshlet.vertexCount > vertexCount
+				|| (uint64_t) meshlet.triangleOffset + meshlet.triangleCount > triangleCount) {
+				util::logger.warn("Meshlet PLG has a meshlet out of range");
+				break;
+			}
+		}
+	}
+
+	void MeshletPLGChunk::preWriteHook() {
+		meshletCount = meshlets.meshlets.size();
+		vertexCount = meshlets.vertices.size();
+		triangleCount = meshlets.triangles.size() / 3;
+		indexSize = meshlets.vertices.indexSize();
+
+		// serialize into a new buffer, as data may be a view of memory shared with others
+		uint32_t size = 16 + meshletCount * sizeof(geom::Meshlet) + vertexCount * indexSize + triangleCount * 3;
+		util::Buffer out((size + 3) & ~3u);
+		out.write(meshletCount);
+		out.write(vertexCount);
+		out.write(triangleCount);
+		out.write(indexSize);
+		if (meshletCount) out.write(meshlets.meshlets.data(), meshletCount * sizeof(geom::Meshlet));
+		meshlets.vertices.write(out, indexSize);
+		if (triangleCount) out.write(meshlets.triangles.data(), triangleCount * 3);
+		while (out.tell() & 3) out.write((uint8_t) 0);
+		setData(std::move(out));
+
+		StructChunk::preWriteHook();
+	}
+
+	bool buildMeshlets(GeometryChunk* geometry, const MeshletOptions& options, geom::MeshletSet& out) {
+		out.clear();
+		if (geometry->format & RW_GEOMETRY_NATIVE) {
+			util::logger.warn("Cannot build meshlets for native geometry");
+			return false;
+		}
+		if (geometry->morphTargets.empty() || geometry->morphTargets[0].vertexPositions.size() != geometry->vertexCount) {
+			util::logger.warn("Cannot build meshlets for geometry without positions");
+			return false;
+		}
+		return geom::buildMeshlets(geometry->morphTargets[0].vertexPositions.data(), geometry->vertexCount,
+								   geometry->faces, options, out);
+	}
+
+	bool buildMeshlets(AtomicSectionChunk* section, const MeshletOptions& options, geom::MeshletSet& out) {
+		out.clear();
+		if (section->vertexPositions.size() != section->vertexCount) {
+			util::logger.warn("Cannot build meshlets for Atomic Section without positions");
+			return false;
+		}
+		return geom::buildMeshlets(section->vertexPositions.data(), section->vertexCount, section->faces, options, out);
+	}
+
+	MeshletPLGChunk* findMeshlets(GeometryChunk* geometry) {
+		for (auto extension : geometry->extensions) {
+			if (!extension->isList()) continue;
+			for (auto child : ((ListChunk*) extension)->children) {
+				if (child->type == RW_MESHLET_PLG) {
+					return (MeshletPLGChunk*) child;
+				}
+			}
+		}
+		return nullptr;
+	}
+
+	static MeshletPLGChunk* attachMeshlets(ListChunk* parent, MeshletPLGChunk* chunk, geom::MeshletSet& meshlets,
+										   std::vector<Chunk*>* extensions) {
+		if (!chunk) {
+			ListChunk* extension = getExtension(parent, extensions);
+			chunk = new MeshletPLGChunk(RW_MESHLET_PLG, parent->version);
+			extension->addChild(chunk);
+			extension->invalidateHash();
+		}
+
+		std::swap(chunk->meshlets.meshlets, meshlets.meshlets);
+		std::swap(chunk->meshlets.vertices, meshlets.vertices);
+		std::swap(chunk->meshlets.triangles, meshlets.triangles);
+		meshlets.clear();
+		chunk->preWriteHook();
+		parent->invalidateHash();
+		return chunk;
+	}
+
+	MeshletPLGChunk* attachMeshlets(GeometryChunk* geometry, geom::MeshletSet& meshlets) {
+		return attachMeshlets(geometry, findMeshlets(geometry), meshlets, &geometry->extensions);
+	}
+
+	MeshletPLGChunk* attachMeshlets(AtomicSectionChunk* section, geom::MeshletSet& meshlets) {
+		section->meshletPLG = attachMeshlets(section, section->meshletPLG, meshlets, nullptr);
+		return section->meshletPLG;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,418 @@
+/*
+ * File: quantize.cc
+ * Author: DeadlyFugu
+ * License: zlib
+ * Description: Compression of vertex attributes into compact formats, with decoding and error metrics
+ */
+
+#include "quantize.hh"
+
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace rw {
+	namespace vertex {
+		static inline uint32_t floatBits(float value) {
+			uint32_t bits;
+			memcpy(&bits, &value, sizeof(bits));
+			return bits;
+		}
+
+		static inline float bitsFloat(uint32_t bits) {
+			float value;
+			memcpy(&value, &bits, sizeof(value));
+			return value;
+		}
+
+		static inline float halfToFloat(uint16_t half) {
+			// shift exponent and mantissa into place then rebias by multiplying with 2^112,
+			// which also normalizes subnormals
+			uint32_t exponentMantissa = half & 0x7fffu;
+			uint32_t bits = floatBits(bitsFloat(exponentMantissa << 13) * bitsFloat(0x77800000u));
+			if (exponentMantissa > 0x7bffu) {
+				bits |= 0x7f800000u;
+			}
+			return bitsFloat(bits | ((half & 0x8000u) << 16));
+		}
+
+#ifdef __SSE2__
+		/// Same as halfToFloat, for halves zero-extended into 32-bit lanes
+		static inline __m128 halfToFloat4(__m128i half) {
+			__m128i exponentMantissa = _mm_and_si128(half, _mm_set1_epi32(0x7fff));
+			__m128i sign = _mm_slli_epi32(_mm_xor_si128(half, exponentMantissa), 16);
+			__m128 scaled = _mm_mul_ps(_mm_castsi128_ps(_mm_slli_epi32(exponentMantissa, 13)),
+									   _mm_castsi128_ps(_mm_set1_epi32(0x77800000)));
+			__m128i wasInfNan = _mm_cmpgt_epi32(exponentMantissa, _mm_set1_epi32(0x7bff));
+			__m128i infNanExponent = _mm_and_si128(wasInfNan, _mm_set1_epi32(0x7f800000));
+			return _mm_or_ps(scaled, _mm_castsi128_ps(_mm_or_si128(sign, infNanExponent)));
+		}
+#endif
+
+		void decodeHalf(const uint16_t* in, float* out, size_t count) {
+			size_t i = 0;
+#ifdef __SSE2__
+			const __m128i zero = _mm_setzero_si128();
+			for (; i + 8 <= count; i += 8) {
+				__m128i halves = _mm_loadu_si128((const __m128i*) (in + i));
+				_mm_storeu_ps(out + i, halfToFloat4(_mm_unpacklo_epi16(halves, zero)));
+				_mm_storeu_ps(out + i + 4, halfToFloat4(_mm_unpackhi_epi16(halves, zero)));
+			}
+#endif
+			for (; i < count; i++) {
+				out[i] = halfToFloat(in[i]);
+			}
+		}
+
+		void decodeSnorm16(const int16_t* in, float* out, size_t count) {
+			size_t i = 0;
+#ifdef __SSE2__
+			const __m128 scale = _mm_set1_ps(1.0f / 32767.0f);
+			const __m128 minusOne = _mm_set1_ps(-1.0f);
+			for (; i + 8 <= count; i += 8) {
+				__m128i values = _mm_loadu_si128((const __m128i*) (in + i));
+				// sign extend by placing each value in the high half of a lane
+				__m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(values, values), 16);
+				__m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(values, values), 16);
+				_mm_storeu_ps(out + i, _mm_max_ps(_mm_mul_ps(_mm_cvtepi32_ps(lo), scale), minusOne));
+				_mm_storeu_ps(out + i + 4, _mm_max_ps(_mm_mul_ps(_mm_cvtepi32_ps(hi), scale), minusOne));
+			}
+#endif
+			for (; i < count; i++) {
+				out[i] = std::max(in[i] * (1.0f / 32767.0f), -1.0f);
+			}
+		}
+
+		void decodeUnorm16(const uint16_t* in, float* out, size_t count) {
+			size_t i = 0;
+#ifdef __SSE2__
+			const __m128 scale = _mm_set1_ps(1.0f / 65535.0f);
+			const __m128i zero = _mm_setzero_si128();
+			for (; i + 8 <= count; i += 8) {
+				__m128i values = _mm_loadu_si128((const __m128i*) (in + i));
+				__m128 lo = _mm_cvtepi32_ps(_mm_unpacklo_epi16(values, zero));
+				__m128 hi = _mm_cvtepi32_ps(_mm_unpackhi_epi16(values, zero));
+				_mm_storeu_ps(out + i, _mm_mul_ps(lo, scale));
+				_mm_storeu_ps(out + i + 4, _mm_mul_ps(hi, scale));
+			}
+#endif
+			for (; i < count; i++) {
+				out[i] = in[i] * (1.0f / 65535.0f);
+			}
+		}
+
+		void decodeUnorm8(const uint8_t* in, float* out, size_t count) {
+			size_t i = 0;
+#ifdef __SSE2__
+			const __m128 scale = _mm_set1_ps(1.0f / 255.0f);
+			const __m128i zero = _mm_setzero_si128();
+			for (; i + 16 <= count; i += 16) {
+				__m128i bytes = _mm_loadu_si128((const __m128i*) (in + i));
+				__m128i words[2] = {_mm_unpacklo_epi8(bytes, zero), _mm_unpackhi_epi8(bytes, zero)};
+				for (int j = 0; j < 2; j++) {
+					__m128 lo = _mm_cvtepi32_ps(_mm_unpacklo_epi16(words[j], zero));
+					__m128 hi = _mm_cvtepi32_ps(_mm_unpackhi_epi16(words[j], zero));
+					_mm_storeu_ps(out + i + j * 8, _mm_mul_ps(lo, scale));
+					_mm_storeu_ps(out + i + j * 8 + 4, _mm_mul_ps(hi, scale));
+				}
+			}
+#endif
+			for (; i < count; i++) {
+				out[i] = in[i] * (1.0f / 255.0f);
+			}
+		}
+
+		// Octahedral normals
+
+		static const size_t OCT_BLOCK = 256;
+
+		static inline float copySign(float magnitude, float sign) {
+			return bitsFloat((floatBits(magnitude) & 0x7fffffffu) | (floatBits(sign) & 0x80000000u));
+		}
+
+		void encodeOctahedral(const geom::VertexNormal* in, int16_t* out, size_t count) {
+			float uv[OCT_BLOCK * 2];
+			for (size_t first = 0; first < count; first += OCT_BLOCK) {
+				size_t n = std::min(OCT_BLOCK, count - first);
+				const geom::VertexNormal* normals = in + first;
+				size_t i = 0;
+#ifdef __SSE2__
+				const __m128 signMask = _mm_set1_ps(-0.0f);
+				const __m128 one = _mm_set1_ps(1.0f);
+				const __m128 tiny = _mm_set1_ps(1e-20f);
+				for (; i + 4 <= n; i += 4) {
+					__m128 x = _mm_setr_ps(normals[i].x, normals[i + 1].x, normals[i + 2].x, normals[i + 3].x);
+					__m128 y = _mm_setr_ps(normals[i].y, normals[i + 1].y, normals[i + 2].y, normals[i + 3].y);
+					__m128 z = _mm_setr_ps(normals[i].z, normals[i + 1].z, normals[i + 2].z, normals[i + 3].z);
+
+					// project onto the octahedron |x| + |y| + |z| = 1
+					__m128 length = _mm_add_ps(_mm_add_ps(_mm_andnot_ps(signMask, x), _mm_andnot_ps(signMask, y)),
+											   _mm_andnot_ps(signMask, z));
+					__m128 scale = _mm_div_ps(one, _mm_max_ps(length, tiny));
+					x = _mm_mul_ps(x, scale);
+					y = _mm_mul_ps(y, scale);
+
+					// fold the lower hemisphere over the diagonals
+					__m128 lower = _mm_cmplt_ps(z, _mm_setzero_ps());
+					__m128 foldX = _mm_or_ps(_mm_sub_ps(one, _mm_andnot_ps(signMask, y)), _mm_and_ps(signMask, x));
+					__m128 foldY = _mm_or_ps(_mm_sub_ps(one, _mm_andnot_ps(signMask, x)), _mm_and_ps(signMask, y));
+					x = _mm_or_ps(_mm_and_ps(lower, foldX), _mm_andnot_ps(lower, x));
+					y = _mm_or_ps(_mm_and_ps(lower, foldY), _mm_andnot_ps(lower, y));
+
+					_mm_storeu_ps(uv + i * 2, _mm_unpacklo_ps(x, y));
+					_mm_storeu_ps(uv + i * 2 + 4, _mm_unpackhi_ps(x, y));
+				}
+#endif
+				for (; i < n; i++) {
+					float length = std::fabs(normals[i].x) + std::fabs(normals[i].y) + std::fabs(normals[i].z);
+					float scale = 1.0f / std::max(length, 1e-20f);
+					float x = normals[i].x * scale;
+					float y = normals[i].y * scale;
+					if (normals[i].z < 0.0f) {
+						float foldX = copySign(1.0f - std::fabs(y), x);
+						float foldY = copySign(1.0f - std::fabs(x), y);
+						x = foldX;
+						y = foldY;
+					}
+					uv[i * 2] = x;
+					uv[i * 2 + 1] = y;
+				}
+				encodeSnorm16(uv, out + first * 2, n * 2);
+			}
+		}
+
+		void decodeOctahedral(const int16_t* in, geom::VertexNormal* out, size_t count) {
+			float uv[OCT_BLOCK * 2];
+			for (size_t first = 0; first < count; first += OCT_BLOCK) {
+				size_t n = std::min(OCT_BLOCK, count - first);
+				decodeSnorm16(in + first * 2, uv, n * 2);
+				geom::VertexNormal* normals = out + first;
+				size_t i = 0;
+#ifdef __SSE2__
+				const __m128 signMask = _mm_set1_ps(-0.0f);
+				const __m128 one = _mm_set1_ps(1.0f);
+				for (; i + 4 <= n; i += 4) {
+					__m128 a = _mm_loadu_ps(uv + i * 2);
+					__m128 b = _mm_loadu_ps(uv + i * 2 + 4);
+					__m128 x = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+					__m128 y = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+
+					// unfold the lower hemisphere
+					__m128 z = _mm_sub_ps(_mm_sub_ps(one, _mm_andnot_ps(signMask, x)), _mm_andnot_ps(signMask, y));
+					__m128 t = _mm_max_ps(_mm_sub_ps(_mm_setzero_ps(), z), _mm_setzero_ps());
+					x = _mm_sub_ps(x, _mm_or_ps(t, _mm_and_ps(signMask, x)));
+					y = _mm_sub_ps(y, _mm_or_ps(t, _mm_and_ps(signMask, y)));
+
+					__m128 lengthSquared = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z));
+					__m128 scale = _mm_div_ps(one, _mm_sqrt_ps(lengthSquared));
+					float xs[4], ys[4], zs[4];
+					_mm_storeu_ps(xs, _mm_mul_ps(x, scale));
+					_mm_storeu_ps(ys, _mm_mul_ps(y, scale));
+					_mm_storeu_ps(zs, _mm_mul_ps(z, scale));
+					for (int j = 0; j < 4; j++) {
+						normals[i + j].x = xs[j];
+						normals[i + j].y = ys[j];
+						normals[i + j].z = zs[j];
+					}
+				}
+#endif
+				for (; i < n; i++) {
+					float x = uv[i * 2];
+					float y = uv[i * 2 + 1];
+					float z = 1.0f - std::fabs(x) - std::fabs(y);
+					float t = std::max(-z, 0.0f);
+					x -= copySign(t, x);
+					y -= copySign(t, y);
+					float scale = 1.0f / std::sqrt(x * x + y * y + z * z);
+					normals[i].x = x * scale;
+					normals[i].y = y * scale;
+					normals[i].z = z * scale;
+				}
+			}
+		}
+
+		// Mesh quantization
+
+		static const double RADIANS_TO_DEGREES = 57.295779513082321;
+
+		/// Accumulates per-vertex errors into a QuantizationError
+		class ErrorAccumulator {
+		public:
+			double max;
+			double sumSquared;
+			size_t count;
+
+			ErrorAccumulator() : max(0), sumSquared(0), count(0) {}
+
+			void add(double error) {
+				max = std::max(max, error);
+				sumSquared += error * error;
+				count++;
+			}
+
+			QuantizationError result() {
+				QuantizationError error = {max, count ? std::sqrt(sumSquared / count) : 0.0};
+				return error;
+			}
+		};
+
+		static void measureDistance(const float* original, const float* decoded, size_t vertices,
+									uint32_t components, ErrorAccumulator& error) {
+			for (size_t i = 0; i < vertices; i++) {
+				double sum = 0;
+				for (uint32_t c = 0; c < components; c++) {
+					double delta = (double) original[i * components + c] - decoded[i * components + c];
+					sum += delta * delta;
+				}
+				error.add(std::sqrt(sum));
+			}
+		}
+
+		void quantizeMesh(const geom::MeshView& mesh, QuantizedMesh& out,
+						  NormalEncoding normalEncoding, ColorEncoding colorEncoding) {
+			uint32_t n = mesh.vertexCount;
+			out.vertexCount = n;
+			out.normalEncoding = normalEncoding;
+			out.colorEncoding = colorEncoding;
+			out.positions.clear();
+			out.normals.clear();
+			out.colors.clear();
+			out.uvLayers.clear();
+			out.positionError = out.normalError = out.colorError = out.uvError = QuantizationError{0, 0};
+
+			if (mesh.positions) {
+				out.positions.resize(n * 3);
+				encodeHalf((const float*) mesh.positions, out.positions.data(), n * 3);
+
+				std::vector<geom::VertexPosition> decoded;
+				decodePositions(out, decoded);
+				ErrorAccumulator error;
+				measureDistance((const float*) mesh.positions, (const float*) decoded.data(), n, 3, error);
+				out.positionError = error.result();
+			}
+
+			if (mesh.normals) {
+				if (normalEncoding == NORMAL_OCTAHEDRAL) {
+					out.normals.resize(n * 2);
+					encodeOctahedral(mesh.normals, out.normals.data(), n);
+				} else {
+					out.normals.resize(n * 3);
+					encodeSnorm16((const float*) mesh.normals, out.normals.data(), n * 3);
+				}
+
+				std::vector<geom::VertexNormal> decoded;
+				decodeNormals(out, decoded);
+				ErrorAccumulator error;
+				for (uint32_t i = 0; i < n; i++) {
+					auto& a = mesh.normals[i];
+					auto& b = decoded[i];
+					if (a.x == 0 && a.y == 0 && a.z == 0) continue;
+					// atan2 of |a x b| and a . b stays accurate for tiny angles, unlike acos
+					double cx = (double) a.y * b.z - (double) a.z * b.y;
+					double cy = (double) a.z * b.x - (double) a.x * b.z;
+					double cz = (double) a.x * b.y - (double) a.y * b.x;
+					double dot = (double) a.x * b.x + (double) a.y * b.y + (double) a.z * b.z;
+					error.add(std::atan2(std::sqrt(cx * cx + cy * cy + cz * cz), dot) * RADIANS_TO_DEGREES);
+				}
+				out.normalError = error.result();
+			}
+
+			if (mesh.colors) {
+				if (colorEncoding == COLOR_RGB565) {
+					for (uint32_t i = 0; i < n; i++) {
+						if (mesh.colors[i].a != 255) {
+							util::logger.warn("Mesh has translucent vertex colours, keeping RGBA8");
+							out.colorEncoding = COLOR_RGBA8;
+							break;
+						}
+					}
+				}
+
+				if (out.colorEncoding == COLOR_RGB565) {
+					out.colors.resize(n * 2);
+					for (uint32_t i = 0; i < n; i++) {
+						auto& color = mesh.colors[i];
+						uint16_t r = (uint16_t) ((color.r * 31 + 127) / 255);
+						uint16_t g = (uint16_t) ((color.g * 63 + 127) / 255);
+						uint16_t b = (uint16_t) ((color.b * 31 + 127) / 255);
+						uint16_t packed = (uint16_t) ((r << 11) | (g << 5) | b);
+						memcpy(&out.colors[i * 2], &packed, 2);
+					}
+				} else {
+					out.colors.resize(n * 4);
+					memcpy(out.colors.data(), mesh.colors, n * 4);
+				}
+
+				std::vector<geom::VertexColor> decoded;
+				decodeColors(out, decoded);
+				ErrorAccumulator error;
+				for (uint32_t i = 0; i < n; i++) {
+					auto& a = mesh.colors[i];
+					auto& b = decoded[i];
+					int channel = std::max(std::max(std::abs(a.r - b.r), std::abs(a.g - b.g)),
+										   std::max(std::abs(a.b - b.b), std::abs(a.a - b.a)));
+					error.add(channel);
+				}
+				out.colorError = error.result();
+			}
+
+			ErrorAccumulator uvError;
+			for (uint32_t layer = 0; layer < mesh.uvLayers.size(); layer++) {
+				out.uvLayers.emplace_back();
+				if (!mesh.uvLayers[layer]) continue;
+				out.uvLayers.back().resize(n * 2);
+				encodeHalf((const float*) mesh.uvLayers[layer], out.uvLayers.back().data(), n * 2);
+
+				std::vector<geom::VertexUVs> decoded;
+				decodeUVs(out, layer, decoded);
+				measureDistance((const float*) mesh.uvLayers[layer], (const float*) decoded.data(), n, 2, uvError);
+			}
+			out.uvError = uvError.result();
+		}
+
+		void decodePositions(const QuantizedMesh& mesh, std::vector<geom::VertexPosition>& out) {
+			out.resize(mesh.positions.size() / 3);
+			decodeHalf(mesh.positions.data(), (float*) out.data(), out.size() * 3);
+		}
+
+		void decodeNormals(const QuantizedMesh& mesh, std::vector<geom::VertexNormal>& out) {
+			if (mesh.normalEncoding == NORMAL_OCTAHEDRAL) {
+				out.resize(mesh.normals.size() / 2);
+				decodeOctahedral(mesh.normals.data(), out.data(), out.size());
+			} else {
+				out.resize(mesh.normals.size() / 3);
+				decodeSnorm16(mesh.normals.data(), (float*) out.data(), out.size() * 3);
+			}
+		}
+
+		void decodeColors(const QuantizedMesh& mesh, std::vector<geom::VertexColor>& out) {
+			if (mesh.colorEncoding == COLOR_RGB565) {
+				out.resize(mesh.colors.size() / 2);
+				for (size_t i = 0; i < out.size(); i++) {
+					uint16_t packed;
+					memcpy(&packed, &mesh.colors[i * 2], 2);
+					out[i].r = (uint8_t) (((packed >> 11) * 255 + 15) / 31);
+					out[i].g = (uint8_t) ((((packed >> 5) & 63) * 255 + 31) / 63);
+					out[i].b = (uint8_t) (((packed & 31) * 255 + 15) / 31);
+					out[i].a = 255;
+				}
+			} else {
+				out.resize(mesh.colors.size() / 4);
+				memcpy(out.data(), mesh.colors.data(), mesh.colors.size());
+			}
+		}
+
+		void decodeUVs(const QuantizedMesh& mesh, uint32_t layer, std::vector<geom::VertexUVs>& out) {
+			if (layer >= mesh.uvLayers.size()) {
+				out.clear();
+				return;
+			}
+			auto& uvs = mesh.uvLayers[layer];
+			out.resize(uvs.size() / 2);
+			decodeHalf(uvs.data(), (float*) out.data(), out.size() * 2);
+		}
+	}
+}
\ No newline at end of file
@@ -0,0 +1,531 @@
+/*
+ * File: raycast.cc
+ * Author: DeadlyFugu
+ * License: zlib
+ * Description: Ray and segment intersection against Geometry and World triangles
+ */
+
+#include "raycast.hh"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace rw {
+	namespace geom {
+		static const uint32_t MAX_DEPTH = 62; // keeps traversal stacks within 64 entries
+		static const uint32_t MAX_LEAF = 16;
+		static const uint32_t BIN_COUNT = 16;
+
+		Ray segmentRay(const Vector3f& a, const Vector3f& b) {
+			Vector3f direction = {b.x - a.x, b.y - a.y, b.z - a.z};
+			float length = std::sqrt(direction.x * direction.x + direction.y * direction.y + direction.z * direction.z);
+			if (length > 0) {
+				direction.x /= length;
+				direction.y /= length;
+				direction.z /= length;
+			}
+			Ray ray = {a, direction, length};
+			return ray;
+		}
+
+		/// A ray with everything the box and triangle tests need precomputed
+		struct PreparedRay {
+			float origin[3];
+			float direction[3];
+			float inverse[3];
+#ifdef __SSE2__
+			__m128 origin4, inverse4;
+			__m128 ox, oy, oz, dx, dy, dz;
+#endif
+
+			explicit PreparedRay(const Ray& ray) {
+				origin[0] = ray.origin.x;
+				origin[1] = ray.origin.y;
+				origin[2] = ray.origin.z;
+				direction[0] = ray.direction.x;
+				direction[1] = ray.direction.y;
+				direction[2] = ray.direction.z;
+				for (int axis = 0; axis < 3; axis++) {
+					inverse[axis] = 1.0f / direction[axis];
+				}
+#ifdef __SSE2__
+				origin4 = _mm_setr_ps(origin[0], origin[1], origin[2], 0);
+				inverse4 = _mm_setr_ps(inverse[0], inverse[1], inverse[2], 0);
+				ox = _mm_set1_ps(origin[0]);
+				oy = _mm_set1_ps(origin[1]);
+				oz = _mm_set1_ps(origin[2]);
+				dx = _mm_set1_ps(direction[0]);
+				dy = _mm_set1_ps(direction[1]);
+				dz = _mm_set1_ps(direction[2]);
+#endif
+			}
+		};
+
+		/// Slab test of a box laid out as min, (4 bytes), max. On a hit within [0, limit), entry
+		/// is where the ray enters the box.
+		static inline bool hitBox(const float* min, const float* max, const PreparedRay& ray, float limit, float& entry) {
+#ifdef __SSE2__
+			const __m128 xyz = _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0));
+			__m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(min), ray.origin4), ray.inverse4);
+			__m128 t2 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(max), ray.origin4), ray.inverse4);
+			// the fourth lane holds other fields: make it 0 for the entry and limit for the exit
+			__m128 enter = _mm_and_ps(_mm_min_ps(t1, t2), xyz);
+			__m128 leave = _mm_or_ps(_mm_and_ps(_mm_max_ps(t1, t2), xyz), _mm_andnot_ps(xyz, _mm_set1_ps(limit)));
+			enter = _mm_max_ps(enter, _mm_shuffle_ps(enter, enter, _MM_SHUFFLE(2, 3, 0, 1)));
+			enter = _mm_max_ps(enter, _mm_shuffle_ps(enter, enter, _MM_SHUFFLE(1, 0, 3, 2)));
+			leave = _mm_min_ps(leave, _mm_shuffle_ps(leave, leave, _MM_SHUFFLE(2, 3, 0, 1)));
+			leave = _mm_min_ps(leave, _mm_shuffle_ps(leave, leave, _MM_SHUFFLE(1, 0, 3, 2)));
+			entry = _mm_cvtss_f32(enter);
+			return entry <= _mm_cvtss_f32(leave) && entry < limit;
+#else
+			float enter = 0, leave = limit;
+			for (int axis = 0; axis < 3; axis++) {
+				float t1 = (min[axis] - ray.origin[axis]) * ray.inverse[axis];
+				float t2 = (max[axis] - ray.origin[axis]) * ray.inverse[axis];
+				enter = std::max(enter, std::min(t1, t2));
+				leave = std::min(leave, std::max(t1, t2));
+			}
+			entry = enter;
+			return enter <= leave && enter < limit;
+#endif
+		}
+
+		/// Moller-Trumbore test of a ray against the four triangles of a packet. Returns the lane
+		/// of the nearest hit closer than limit, or -1.
+		static inline int hitPacket(const TrianglePacket& packet, const PreparedRay& ray, float limit,
+									float& distance, float& u, float& v) {
+#ifdef __SSE2__
+			__m128 e1x = _mm_load_ps(packet.edge1[0]), e1y = _mm_load_ps(packet.edge1[1]), e1z = _mm_load_ps(packet.edge1[2]);
+			__m128 e2x = _mm_load_ps(packet.edge2[0]), e2y = _mm_load_ps(packet.edge2[1]), e2z = _mm_load_ps(packet.edge2[2]);
+
+			// p = direction x edge2
+			__m128 px = _mm_sub_ps(_mm_mul_ps(ray.dy, e2z), _mm_mul_ps(ray.dz, e2y));
+			__m128 py = _mm_sub_ps(_mm_mul_ps(ray.dz, e2x), _mm_mul_ps(ray.dx, e2z));
+			__m128 pz = _mm_sub_ps(_mm_mul_ps(ray.dx, e2y), _mm_mul_ps(ray.dy, e2x));
+			__m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+			__m128 inverse = _mm_div_ps(_mm_set1_ps(1.0f), det);
+
+			// s = origin - vertex1
+			__m128 sx = _mm_sub_ps(ray.ox, _mm_load_ps(packet.origin[0]));
+			__m128 sy = _mm_sub_ps(ray.oy, _mm_load_ps(packet.origin[1]));
+			__m128 sz = _mm_sub_ps(ray.oz, _mm_load_ps(packet.origin[2]));
+			__m128 lu = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, px), _mm_mul_ps(sy, py)), _mm_mul_ps(sz, pz)), inverse);
+
+			// q = s x edge1
+			__m128 qx = _mm_sub_ps(_mm_mul_ps(sy, e1z), _mm_mul_ps(sz, e1y));
+			__m128 qy = _mm_sub_ps(_mm_mul_ps(sz, e1x), _mm_mul_ps(sx, e1z));
+			__m128 qz = _mm_sub_ps(_mm_mul_ps(sx, e1y), _mm_mul_ps(sy, e1x));
+			__m128 lv = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(ray.dx, qx), _mm_mul_ps(ray.dy, qy)), _mm_mul_ps(ray.dz, qz)), inverse);
+			__m128 t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), inverse);
+
+			const __m128 zero = _mm_setzero_ps();
+			__m128 valid = _mm_cmpneq_ps(det, zero);
+			valid = _mm_and_ps(valid, _mm_cmpge_ps(lu, zero));
+			valid = _mm_and_ps(valid, _mm_cmpge_ps(lv, zero));
+			valid = _mm_and_ps(valid, _mm_cmple_ps(_mm_add_ps(lu, lv), _mm_set1_ps(1.0f)));
+			valid = _mm_and_ps(valid, _mm_cmpge_ps(t, zero));
+			valid = _mm_and_ps(valid, _mm_cmplt_ps(t, _mm_set1_ps(limit)));
+			int mask = _mm_movemask_ps(valid);
+			if (!mask) return -1;
+
+			alignas(16) float ts[4], us[4], vs[4];
+			_mm_store_ps(ts, t);
+			_mm_store_ps(us, lu);
+			_mm_store_ps(vs, lv);
+			int best = -1;
+			for (int lane = 0; lane < 4; lane++) {
+				if ((mask >> lane & 1) && (best < 0 || ts[lane] < ts[best])) best = lane;
+			}
+			distance = ts[best];
+			u = us[best];
+			v = vs[best];
+			return best;
+#else
+			int best = -1;
+			for (int lane = 0; lane < 4; lane++) {
+				float e1[3] = {packet.edge1[0][lane], packet.edge1[1][lane], packet.edge1[2][lane]};
+				float e2[3] = {packet.edge2[0][lane], packet.edge2[1][lane], packet.edge2[2][lane]};
+				const float* d = ray.direction;
+				float p[3] = {d[1] * e2[2] - d[2] * e2[1], d[2] * e2[0] - d[0] * e2[2], d[0] * e2[1] - d[1] * e2[0]};
+				float det = e1[0] * p[0] + e1[1] * p[1] + e1[2] * p[2];
+				if (det == 0) continue;
+				float inverse = 1.0f / det;
+				float s[3];
+				for (int axis = 0; axis < 3; axis++) s[axis] = ray.origin[axis] - packet.origin[axis][lane];
+				float lu = (s[0] * p[0] + s[1] * p[1] + s[2] * p[2]) * inverse;
+				float q[3] = {s[1] * e1[2] - s[2] * e1[1], s[2] * e1[0] - s[0] * e1[2], s[0] * e1[1] - s[1] * e1[0]};
+				float lv = (d[0] * q[0] + d[1] * q[1] + d[2] * q[2]) * inverse;
+				float t = (e2[0] * q[0] + e2[1] * q[1] + e2[2] * q[2]) * inverse;
+				if (lu >= 0 && lv >= 0 && lu + lv <= 1 && t >= 0 && t < limit) {
+					best = lane;
+					limit = distance = t;
+					u = lu;
+					v = lv;
+				}
+			}
+			return best;
+#endif
+		}
+
+		void TriangleBvh::clear() {
+			nodes.clear();
+			packets.clear();
+			materials.clear();
+		}
+
+		static inline float halfArea(const float* min, const float* max) {
+			float x = max[0] - min[0], y = max[1] - min[1], z = max[2] - min[2];
+			return x * y + y * z + z * x;
+		}
+
+		bool TriangleBvh::build(const VertexPosition* positions, uint32_t vertexCount, const std::vector<Face>& faces) {
+			clear();
+			for (auto& face : faces) {
+				if (face.vertex1 >= vertexCount || face.vertex2 >= vertexCount || face.vertex3 >= vertexCount) {
+					util::logger.warn("Face index out of range for %u vertices", vertexCount);
+					return false;
+				}
+			}
+			uint32_t count = (uint32_t) faces.size();
+			materials.resize(count);
+			for (uint32_t f = 0; f < count; f++) {
+				materials[f] = faces[f].material;
+			}
+			if (!count) return true;
+
+			// box and centroid of each triangle
+			std::vector<float> boxes(count * 6), centroids(count * 3);
+			for (uint32_t f = 0; f < count; f++) {
+				const VertexPosition* corners[3] = {&positions[faces[f].vertex1], &positions[faces[f].vertex2],
+													&positions[faces[f].vertex3]};
+				float* box = &boxes[f * 6];
+				for (int axis = 0; axis < 3; axis++) {
+					float a = (&corners[0]->x)[axis], b = (&corners[1]->x)[axis], c = (&corners[2]->x)[axis];
+					box[axis] = std::min(std::min(a, b), c);
+					box[axis + 3] = std::max(std::max(a, b), c);
+					centroids[f * 3 + axis] = (box[axis] + box[axis + 3]) * 0.5f;
+				}
+			}
+			std::vector<uint32_t> order(count);
+			for (uint32_t f = 0; f < count; f++) order[f] = f;
+
+			struct Task {
+				uint32_t parent; // NONE for the root
+				uint32_t begin;
+				uint32_t end;
+				uint32_t depth;
+			};
+			std::vector<Task> tasks(1, Task{NONE, 0, count, 0});
+			while (!tasks.empty()) {
+				Task task = tasks.back();
+				tasks.pop_back();
+
+				// a left child is made straight after its parent; a right child is linked here
+				uint32_t index = (uint32_t) nodes.size();
+				if (task.parent != NONE && task.parent + 1 != index) nodes[task.parent].offset = index;
+				nodes.emplace_back();
+
+				float min[3], max[3], centroidMin[3], centroidMax[3];
+				for (int axis = 0; axis < 3; axis++) {
+					min[axis] = centroidMin[axis] = std::numeric_limits<float>::infinity();
+					max[axis] = centroidMax[axis] = -std::numeric_limits<float>::infinity();
+				}
+				for (uint32_t i = task.begin; i < task.end; i++) {
+					const float* box = &boxes[order[i] * 6];
+					const float* centroid = &centroids[order[i] * 3];
+					for (int axis = 0; axis < 3; axis++) {
+						min[axis] = std::min(min[axis], box[axis]);
+						max[axis] = std::max(max[axis], box[axis + 3]);
+						centroidMin[axis] = std::min(centroidMin[axis], centroid[axis]);
+						centroidMax[axis] = std::max(centroidMax[axis], centroid[axis]);
+					}
+				}
+				std::copy(min, min + 3, nodes[index].min);
+				std::copy(max, max + 3, nodes[index].max);
+
+				// binned surface area heuristic along the centroids' longest axis
+				uint32_t n = task.end - task.begin;
+				uint32_t middle = task.begin;
+				if (n > 4 && task.depth < MAX_DEPTH) {
+					int axis = 0;
+					for (int k = 1; k < 3; k++) {
+						if (centroidMax[k] - centroidMin[k] > centroidMax[axis] - centroidMin[axis]) axis = k;
+					}
+					float extent = centroidMax[axis] - centroidMin[axis];
+					if (extent > 0) {
+						float scale = BIN_COUNT * (1 - 1e-6f) / extent;
+						uint32_t binCounts[BIN_COUNT] = {};
+						float binMin[BIN_COUNT][3], binMax[BIN_COUNT][3];
+						for (uint32_t b = 0; b < BIN_COUNT; b++) {
+							for (int k = 0; k < 3; k++) {
+								binMin[b][k] = std::numeric_limits<float>::infinity();
+								binMax[b][k] = -std::numeric_limits<float>::infinity();
+							}
+						}
+						auto binOf = [&](uint32_t f) {
+							return std::min(BIN_COUNT - 1, (uint32_t) ((centroids[f * 3 + axis] - centroidMin[axis]) * scale));
+						};
+						for (uint32_t i = task.begin; i < task.end; i++) {
+							uint32_t b = binOf(order[i]);
+							const float* box = &boxes[order[i] * 6];
+							binCounts[b]++;
+							for (int k = 0; k < 3; k++) {
+								binMin[b][k] = std::min(binMin[b][k], box[k]);
+								binMax[b][k] = std::max(binMax[b][k], box[k + 3]);
+							}
+						}
+
+						// area and count to the right of each bin boundary
+						float rightArea[BIN_COUNT];
+						uint32_t rightCount[BIN_COUNT];
+						float accumulatedMin[3], accumulatedMax[3];
+						std::copy(binMin[BIN_COUNT - 1], binMin[BIN_COUNT - 1] + 3, accumulatedMin);
+						std::copy(binMax[BIN_COUNT - 1], binMax[BIN_COUNT - 1] + 3, accumulatedMax);
+						uint32_t accumulatedCount = 0;
+						for (uint32_t b = BIN_COUNT - 1; b > 0; b--) {
+							accumulatedCount += binCounts[b];
+							for (int k = 0; k < 3; k++) {
+								accumulatedMin[k] = std::min(accumulatedMin[k], binMin[b][k]);
+								accumulatedMax[k] = std::max(accumulatedMax[k], binMax[b][k]);
+							}
+							rightCount[b] = accumulatedCount;
+							rightArea[b] = accumulatedCount ? halfArea(accumulatedMin, accumulatedMax) : 0;
+						}
+
+						float bestCost = std::numeric_limits<float>::infinity();
+						uint32_t bestBin = 0;
+						std::copy(binMin[0], binMin[0] + 3, accumulatedMin);
+						std::copy(binMax[0], binMax[0] + 3, accumulatedMax);
+						accumulatedCount = 0;
+						for (uint32_t b = 1; b < BIN_COUNT; b++) {
+							accumulatedCount += binCounts[b - 1];
+							for (int k = 0; k < 3; k++) {
+								accumulatedMin[k] = std::min(accumulatedMin[k], binMin[b - 1][k]);
+								accumulatedMax[k] = std::max(accumulatedMax[k], binMax[b - 1][k]);
+							}
+							if (!accumulatedCount || !rightCount[b]) continue;
+							float cost = halfArea(accumulatedMin, accumulatedMax) * accumulatedCount + rightArea[b] * rightCount[b];
+							if (cost < bestCost) {
+								bestCost = cost;
+								bestBin = b;
+							}
+						}
+
+						// a packet tests four triangles for about the cost of visiting a node
+						float area = halfArea(min, max);
+						bool split = bestBin && (n > MAX_LEAF || area == 0 || 1 + bestCost / (4 * area) < n / 4.0f);
+						if (split) {
+							middle = (uint32_t) (std::partition(order.begin() + task.begin, order.begin() + task.end,
+										[&](uint32_t f) { return binOf(f) < bestBin; }) - order.begin());
+						}
+					}
+					if (middle == task.begin && n > MAX_LEAF) {
+						// identical centroids: split in order
+						middle = task.begin + n / 2;
+					}
+				}
+
+				if (middle != task.begin) {
+					tasks.push_back(Task{index, middle, task.end, task.depth + 1});
+					tasks.push_back(Task{index, task.begin, middle, task.depth + 1});
+					continue;
+				}
+
+				nodes[index].offset = (uint32_t) packets.size();
+				nodes[index].count = (n + 3) / 4;
+				for (uint32_t i = task.begin; i < task.end; i += 4) {
+					TrianglePacket packet = {};
+					for (uint32_t lane = 0; lane < 4; lane++) {
+						packet.face[lane] = NONE;
+						if (i + lane >= task.end) continue;
+						uint32_t f = order[i + lane];
+						const VertexPosition& a = positions[faces[f].vertex1];
+						const VertexPosition& b = positions[faces[f].vertex2];
+						const VertexPosition& c = positions[faces[f].vertex3];
+						packet.origin[0][lane] = a.x;
+						packet.origin[1][lane] = a.y;
+						packet.origin[2][lane] = a.z;
+						packet.edge1[0][lane] = b.x - a.x;
+						packet.edge1[1][lane] = b.y - a.y;
+						packet.edge1[2][lane] = b.z - a.z;
+						packet.edge2[0][lane] = c.x - a.x;
+						packet.edge2[1][lane] = c.y - a.y;
+						packet.edge2[2][lane] = c.z - a.z;
+						packet.face[lane] = f;
+					}
+					packets.push_back(packet);
+				}
+			}
+			return true;
+		}
+
+		template<bool ANY>
+		bool TriangleBvh::traverse(const Ray& ray, RayHit& hit) const {
+			if (nodes.empty()) return false;
+			PreparedRay prepared(ray);
+			float best = ray.maxDistance;
+			bool found = false;
+
+			float entry;
+			if (!hitBox(nodes[0].min, nodes[0].max, prepared, best, entry)) return false;
+			uint32_t stack[64];
+			uint32_t depth = 0;
+			stack[depth++] = 0;
+			while (depth) {
+				uint32_t index = stack[--depth];
+				const Node& node = nodes[index];
+				if (node.count) {
+					for (uint32_t p = node.offset; p < node.offset + node.count; p++) {
+						float distance, u, v;
+						int lane = hitPacket(packets[p], prepared, best, distance, u, v);
+						if (lane < 0) continue;
+						found = true;
+						if (ANY) return true;
+						best = distance;
+						hit.distance = distance;
+						hit.face = packets[p].face[lane];
+						hit.u = u;
+						hit.v = v;
+					}
+					continue;
+				}
+
+				// visit the nearer child first
+				uint32_t left = index + 1, right = node.offset;
+				float leftEntry, rightEntry;
+				bool hitLeft = hitBox(nodes[left].min, nodes[left].max, prepared, best, leftEntry);
+				bool hitRight = hitBox(nodes[right].min, nodes[right].max, prepared, best, rightEntry);
+				if (hitLeft && hitRight) {
+					bool leftFirst = leftEntry <= rightEntry;
+					stack[depth++] = leftFirst ? right : left;
+					stack[depth++] = leftFirst ? left : right;
+				} else if (hitLeft) {
+					stack[depth++] = left;
+				} else if (hitRight) {
+					stack[depth++] = right;
+				}
+			}
+
+			if (found) {
+				hit.material = materials[hit.face];
+				hit.section = NONE;
+			}
+			return found;
+		}
+
+		bool TriangleBvh::intersect(const Ray& ray, RayHit& hit) const {
+			return traverse<false>(ray, hit);
+		}
+
+		bool TriangleBvh::occluded(const Ray& ray) const {
+			RayHit hit;
+			return traverse<true>(ray, hit);
+		}
+	}
+
+	bool buildTriangleBvh(GeometryChunk* geometry, geom::TriangleBvh& bvh) {
+		bvh.clear();
+		if (geometry->format & RW_GEOMETRY_NATIVE) {
+			util::logger.warn("Cannot build a BVH for native geometry");
+			return false;
+		}
+		if (geometry->morphTargets.empty() || geometry->morphTargets[0].vertexPositions.size() != geometry->vertexCount) {
+			util::logger.warn("Cannot build a BVH for geometry without positions");
+			return false;
+		}
+		return bvh.build(geometry->morphTargets[0].vertexPositions.data(), geometry->vertexCount, geometry->faces);
+	}
+
+	bool buildTriangleBvh(AtomicSectionChunk* section, geom::TriangleBvh& bvh) {
+		bvh.clear();
+		if (section->vertexPositions.size() != section->vertexCount) {
+			util::logger.warn("Cannot build a BVH for Atomic Section without positions");
+			return false;
+		}
+		return bvh.build(section->vertexPositions.data(), section->vertexCount, section->faces);
+	}
+
+	bool WorldRaycaster::build(WorldChunk* world) {
+		sections.clear();
+		if (!bsp.build(world)) return false;
+
+		std::vector<uint32_t> depths(bsp.nodes.size(), 0);
+		for (size_t i = 0; i < bsp.nodes.size(); i++) {
+			if (bsp.nodes[i].section != WorldBsp::NONE) continue;
+			if (depths[i] >= geom::MAX_DEPTH) {
+				util::logger.warn("World sections are nested over %u levels deep", geom::MAX_DEPTH);
+				bsp.clear();
+				return false;
+			}
+			depths[i + 1] = depths[bsp.nodes[i + 1].skip] = depths[i] + 1;
+		}
+
+		sections.resize(bsp.sections.size());
+		for (size_t i = 0; i < sections.size(); i++) {
+			buildTriangleBvh(bsp.sections[i], sections[i]);
+		}
+		return true;
+	}
+
+	template<bool ANY>
+	bool WorldRaycaster::traverse(const geom::Ray& ray, geom::RayHit& hit) const {
+		if (bsp.nodes.empty()) return false;
+		geom::PreparedRay prepared(ray);
+		const float origin[3] = {ray.origin.x, ray.origin.y, ray.origin.z};
+		float best = ray.maxDistance;
+		bool found = false;
+
+		float entry;
+		if (!geom::hitBox(bsp.nodes[0].min, bsp.nodes[0].max, prepared, best, entry)) return false;
+		uint32_t stack[64];
+		uint32_t depth = 0;
+		stack[depth++] = 0;
+		while (depth) {
+			uint32_t index = stack[--depth];
+			const BspNode& node = bsp.nodes[index];
+			if (node.section != WorldBsp::NONE) {
+				geom::Ray limited = ray;
+				limited.maxDistance = best;
+				const geom::TriangleBvh& bvh = sections[node.section];
+				if (ANY) {
+					if (bvh.occluded(limited)) return true;
+					continue;
+				}
+				geom::RayHit sectionHit;
+				if (bvh.intersect(limited, sectionHit)) {
+					found = true;
+					best = sectionHit.distance;
+					hit = sectionHit;
+					hit.section = node.section;
+				}
+				continue;
+			}
+
+			// the child on the origin's side of the split plane comes first
+			uint32_t left = index + 1, right = bsp.nodes[left].skip;
+			const BspPlane& plane = bsp.planes[index];
+			bool leftFirst = origin[plane.axis] < plane.value;
+			uint32_t nearChild = leftFirst ? left : right, farChild = leftFirst ? right : left;
+			if (geom::hitBox(bsp.nodes[farChild].min, bsp.nodes[farChild].max, prepared, best, entry)) {
+				stack[depth++] = farChild;
+			}
+			if (geom::hitBox(bsp.nodes[nearChild].min, bsp.nodes[nearChild].max, prepared, best, entry)) {
+				stack[depth++] = nearChild;
+			}
+		}
+		return found;
+	}
+
+	bool WorldRaycaster::intersect(const geom::Ray& ray, geom::RayHit& hit) const {
+		return traverse<false>(ray, hit);
+	}
+
+	bool WorldRaycaster::occluded(const geom::Ray& ray) const {
+		geom::RayHit hit;
+		return traverse<true>(ray, hit);
+	}
+}
\ No newline at end of file
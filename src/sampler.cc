@@ -0,0 +1,286 @@
+/*
+ * File: sampler.cc
+ * Author: DeadlyFugu
+ * License: zlib
+ * Description: Samples keyframe animations as one track per bone
+ */
+
+#include "sampler.hh"
+
+#include <algorithm>
+#include <cmath>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace rw {
+	static const uint32_t KEYFRAME_SIZE = 36; // time, rotation, translation, previous offset
+
+	bool AnimationTracks::build(const AnimAnimationChunk* animation, uint32_t boneCount) {
+		clear();
+		if (animation->interpolationType != 1) {
+			util::logger.warn("Cannot sample animation with interpolation type %d", animation->interpolationType);
+			return false;
+		}
+		auto& frames = animation->frames;
+		if (frames.empty()) return false;
+		if (!boneCount) {
+			while (boneCount < frames.size() && frames[boneCount].time == 0) boneCount++;
+			if (!boneCount) {
+				util::logger.warn("Animation has no keyframes at time 0");
+				return false;
+			}
+		} else if (boneCount > frames.size()) {
+			util::logger.warn("Animation has %d keyframes, too few for %d bones", (uint32_t) frames.size(), boneCount);
+			return false;
+		}
+
+		// bone of each keyframe and the keyframe ending each track so far
+		const uint32_t count = (uint32_t) frames.size();
+		const uint32_t NONE = 0xffffffffu;
+		std::vector<uint32_t> boneOf(count, NONE);
+		std::vector<uint32_t> last(boneCount);
+		std::vector<uint32_t> lengths(boneCount, 1);
+		for (uint32_t k = 0; k < boneCount; k++) {
+			boneOf[k] = k;
+			last[k] = k;
+		}
+		uint32_t dropped = 0;
+		for (uint32_t k = boneCount; k < count; k++) {
+			uint32_t offset = frames[k].previousOffset;
+			uint32_t previous = offset / KEYFRAME_SIZE;
+			if (offset % KEYFRAME_SIZE || previous >= k || boneOf[previous] == NONE
+				|| last[boneOf[previous]] != previous || frames[k].time < frames[previous].time) {
+				dropped++;
+				continue;
+			}
+			boneOf[k] = boneOf[previous];
+			last[boneOf[k]] = k;
+			lengths[boneOf[k]]++;
+		}
+		if (dropped) {
+			util::logger.warn("Dropped %d keyframes which do not continue a track", dropped);
+		}
+
+		firstKeys.resize(boneCount + 1);
+		firstKeys[0] = 0;
+		for (uint32_t b = 0; b < boneCount; b++) {
+			firstKeys[b + 1] = firstKeys[b] + lengths[b];
+		}
+		keys.resize(firstKeys[boneCount]);
+		std::vector<uint32_t> next(firstKeys.begin(), firstKeys.end() - 1);
+		for (uint32_t k = 0; k < count; k++) {
+			if (boneOf[k] == NONE) continue;
+			auto& source = frames[k].data.standard;
+			Key& key = keys[next[boneOf[k]]++];
+			std::copy(source.rotationQuat, source.rotationQuat + 4, key.rotation);
+			std::copy(source.translation, source.translation + 3, key.translation);
+			key.time = frames[k].time;
+		}
+		duration = animation->duration;
+		return true;
+	}
+
+	void AnimationTracks::clear() {
+		duration = 0;
+		keys.clear();
+		firstKeys.clear();
+	}
+
+	uint32_t AnimationTracks::boneCount() const {
+		return firstKeys.empty() ? 0 : (uint32_t) firstKeys.size() - 1;
+	}
+
+	AnimationSampler::AnimationSampler(const AnimationTracks& tracks) : tracks(tracks) {
+		reset();
+	}
+
+	void AnimationSampler::reset() {
+		cursors.assign(tracks.firstKeys.begin(), tracks.firstKeys.end() - (tracks.firstKeys.empty() ? 0 : 1));
+	}
+
+	uint32_t AnimationSampler::findKey(uint32_t bone, float time) {
+		const AnimationTracks::Key* keys = tracks.keys.data();
+		const uint32_t first = tracks.firstKeys[bone], end = tracks.firstKeys[bone + 1];
+		uint32_t key = cursors[bone];
+		if (key < first || key >= end) key = first;
+
+		auto before = [](float time, const AnimationTracks::Key& key) { return time < key.time; };
+		if (time >= keys[key].time) {
+			// playing forwards usually moves a key or two, so step before searching
+			for (int step = 0; step < 4; step++) {
+				if (key + 1 >= end || time < keys[key + 1].time) return cursors[bone] = key;
+				key++;
+			}
+			key = (uint32_t) (std::upper_bound(keys + key + 1, keys + end, time, before) - keys) - 1;
+		} else {
+			key = (uint32_t) (std::upper_bound(keys + first, keys + key, time, before) - keys);
+			key = key > first ? key - 1 : first;
+		}
+		return cursors[bone] = key;
+	}
+
+	// slerp coefficients from Eberly, "A Fast and Accurate Algorithm for Computing SLERP" (2011):
+	// u = 1 / (i (2i + 1)) and v = i / (2i + 1) for i = 1..8, with the last pair scaled by mu
+	static const float SLERP_MU = 1.85298109240830f;
+	static const float SLERP_U[8] = {1.0f / (1 * 3), 1.0f / (2 * 5), 1.0f / (3 * 7), 1.0f / (4 * 9),
+									 1.0f / (5 * 11), 1.0f / (6 * 13), 1.0f / (7 * 15), SLERP_MU / (8 * 17)};
+	static const float SLERP_V[8] = {1.0f / 3, 2.0f / 5, 3.0f / 7, 4.0f / 9,
+									 5.0f / 11, 6.0f / 13, 7.0f / 15, SLERP_MU * 8 / 17};
+
+	/// Weights of a and b for sin-weighted slerp between unit quaternions with dot product x >= 0
+	static inline void slerpWeights(float x, float t, float& weightA, float& weightB) {
+		float xm1 = x - 1, d = 1 - t, sqrT = t * t, sqrD = d * d;
+		float accT = 1, accD = 1;
+		for (int i = 7; i >= 0; i--) {
+			accT = 1 + (SLERP_U[i] * sqrT - SLERP_V[i]) * xm1 * accT;
+			accD = 1 + (SLERP_U[i] * sqrD - SLERP_V[i]) * xm1 * accD;
+		}
+		weightA = d * accD;
+		weightB = t * accT;
+	}
+
+	static void blendKeys(const AnimationTracks::Key& a, const AnimationTracks::Key& b, float t, RotationBlend blend,
+						  BonePose& out) {
+		float dot = a.rotation[0] * b.rotation[0] + a.rotation[1] * b.rotation[1]
+					+ a.rotation[2] * b.rotation[2] + a.rotation[3] * b.rotation[3];
+		// q and -q are the same rotation, so take the shorter way round
+		float sign = dot < 0 ? -1.0f : 1.0f;
+		if (blend == BLEND_SLERP) {
+			float weightA, weightB;
+			slerpWeights(dot * sign, t, weightA, weightB);
+			weightB *= sign;
+			for (int i = 0; i < 4; i++) out.rotation[i] = a.rotation[i] * weightA + b.rotation[i] * weightB;
+		} else {
+			float length = 0;
+			for (int i = 0; i < 4; i++) {
+				out.rotation[i] = a.rotation[i] + (b.rotation[i] * sign - a.rotation[i]) * t;
+				length += out.rotation[i] * out.rotation[i];
+			}
+			float scale = length > 0 ? 1 / std::sqrt(length) : 0;
+			for (int i = 0; i < 4; i++) out.rotation[i] *= scale;
+		}
+		for (int i = 0; i < 3; i++) out.translation[i] = a.translation[i] + (b.translation[i] - a.translation[i]) * t;
+	}
+
+	void AnimationSampler::sample(float time, BonePose* out, RotationBlend blend) {
+		const AnimationTracks::Key* keys = tracks.keys.data();
+		const uint32_t boneCount = tracks.boneCount();
+		if (cursors.size() != boneCount) reset();
+
+		// the keys around time for one bone, and how far time is between them
+		auto segment = [&](uint32_t bone, const AnimationTracks::Key*& a, const AnimationTracks::Key*& b) {
+			uint32_t key = findKey(bone, time);
+			a = keys + key;
+			b = key + 1 < tracks.firstKeys[bone + 1] ? a + 1 : a;
+			float span = b->time - a->time;
+			return span > 0 ? std::min(std::max((time - a->time) / span, 0.0f), 1.0f) : 0.0f;
+		};
+
+		uint32_t bone = 0;
+#ifdef __SSE2__
+		const __m128 one = _mm_set1_ps(1);
+		const __m128 signBit = _mm_set1_ps(-0.0f);
+		for (; bone + 4 <= boneCount; bone += 4) {
+			const AnimationTracks::Key* a[4];
+			const AnimationTracks::Key* b[4];
+			alignas(16) float fractions[4];
+			for (int lane = 0; lane < 4; lane++) fractions[lane] = segment(bone + lane, a[lane], b[lane]);
+			__m128 t = _mm_load_ps(fractions);
+
+			// one register per component, one bone per lane (translations carry the key time as w)
+			__m128 ax = _mm_loadu_ps(a[0]->rotation), ay = _mm_loadu_ps(a[1]->rotation);
+			__m128 az = _mm_loadu_ps(a[2]->rotation), aw = _mm_loadu_ps(a[3]->rotation);
+			_MM_TRANSPOSE4_PS(ax, ay, az, aw);
+			__m128 bx = _mm_loadu_ps(b[0]->rotation), by = _mm_loadu_ps(b[1]->rotation);
+			__m128 bz = _mm_loadu_ps(b[2]->rotation), bw = _mm_loadu_ps(b[3]->rotation);
+			_MM_TRANSPOSE4_PS(bx, by, bz, bw);
+			__m128 atx = _mm_loadu_ps(a[0]->translation), aty = _mm_loadu_ps(a[1]->translation);
+			__m128 atz = _mm_loadu_ps(a[2]->translation), atw = _mm_loadu_ps(a[3]->translation);
+			_MM_TRANSPOSE4_PS(atx, aty, atz, atw);
+			__m128 btx = _mm_loadu_ps(b[0]->translation), bty = _mm_loadu_ps(b[1]->translation);
+			__m128 btz = _mm_loadu_ps(b[2]->translation), btw = _mm_loadu_ps(b[3]->translation);
+			_MM_TRANSPOSE4_PS(btx, bty, btz, btw);
+
+			__m128 dot = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax, bx), _mm_mul_ps(ay, by)),
+									_mm_add_ps(_mm_mul_ps(az, bz), _mm_mul_ps(aw, bw)));
+			__m128 flip = _mm_and_ps(dot, signBit);
+			bx = _mm_xor_ps(bx, flip);
+			by = _mm_xor_ps(by, flip);
+			bz = _mm_xor_ps(bz, flip);
+			bw = _mm_xor_ps(bw, flip);
+
+			__m128 rx, ry, rz, rw;
+			if (blend == BLEND_SLERP) {
+				__m128 xm1 = _mm_sub_ps(_mm_xor_ps(dot, flip), one);
+				__m128 d = _mm_sub_ps(one, t);
+				__m128 sqrT = _mm_mul_ps(t, t), sqrD = _mm_mul_ps(d, d);
+				__m128 accT = one, accD = one;
+				for (int i = 7; i >= 0; i--) {
+					__m128 u = _mm_set1_ps(SLERP_U[i]), v = _mm_set1_ps(SLERP_V[i]);
+					__m128 bT = _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(u, sqrT), v), xm1);
+					__m128 bD = _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(u, sqrD), v), xm1);
+					accT = _mm_add_ps(one, _mm_mul_ps(bT, accT));
+					accD = _mm_add_ps(one, _mm_mul_ps(bD, accD));
+				}
+				__m128 weightA = _mm_mul_ps(d, accD), weightB = _mm_mul_ps(t, accT);
+				rx = _mm_add_ps(_mm_mul_ps(ax, weightA), _mm_mul_ps(bx, weightB));
+				ry = _mm_add_ps(_mm_mul_ps(ay, weightA), _mm_mul_ps(by, weightB));
+				rz = _mm_add_ps(_mm_mul_ps(az, weightA), _mm_mul_ps(bz, weightB));
+				rw = _mm_add_ps(_mm_mul_ps(aw, weightA), _mm_mul_ps(bw, weightB));
+			} else {
+				rx = _mm_add_ps(ax, _mm_mul_ps(_mm_sub_ps(bx, ax), t));
+				ry = _mm_add_ps(ay, _mm_mul_ps(_mm_sub_ps(by, ay), t));
+				rz = _mm_add_ps(az, _mm_mul_ps(_mm_sub_ps(bz, az), t));
+				rw = _mm_add_ps(aw, _mm_mul_ps(_mm_sub_ps(bw, aw), t));
+				__m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(rx, rx), _mm_mul_ps(ry, ry)),
+													   _mm_add_ps(_mm_mul_ps(rz, rz), _mm_mul_ps(rw, rw))));
+				// a zero length (opposite keys blended halfway) gives a zero quaternion, as scalar
+				__m128 scale = _mm_and_ps(_mm_div_ps(one, length), _mm_cmpgt_ps(length, _mm_setzero_ps()));
+				rx = _mm_mul_ps(rx, scale);
+				ry = _mm_mul_ps(ry, scale);
+				rz = _mm_mul_ps(rz, scale);
+				rw = _mm_mul_ps(rw, scale);
+			}
+			_MM_TRANSPOSE4_PS(rx, ry, rz, rw);
+			_mm_storeu_ps(out[bone + 0].rotation, rx);
+			_mm_storeu_ps(out[bone + 1].rotation, ry);
+			_mm_storeu_ps(out[bone + 2].rotation, rz);
+			_mm_storeu_ps(out[bone + 3].rotation, rw);
+
+			__m128 tx = _mm_add_ps(atx, _mm_mul_ps(_mm_sub_ps(btx, atx), t));
+			__m128 ty = _mm_add_ps(aty, _mm_mul_ps(_mm_sub_ps(bty, aty), t));
+			__m128 tz = _mm_add_ps(atz, _mm_mul_ps(_mm_sub_ps(btz, atz), t));
+			__m128 tw = _mm_setzero_ps();
+			_MM_TRANSPOSE4_PS(tx, ty, tz, tw);
+			__m128 translations[4] = {tx, ty, tz, tw};
+			for (int lane = 0; lane < 4; lane++) {
+				// three floats, so the next pose is not overwritten
+				float* target = out[bone + lane].translation;
+				_mm_storel_pi((__m64*) target, translations[lane]);
+				_mm_store_ss(target + 2, _mm_movehl_ps(translations[lane], translations[lane]));
+			}
+		}
+#endif
+		for (; bone < boneCount; bone++) {
+			const AnimationTracks::Key* a;
+			const AnimationTracks::Key* b;
+			float t = segment(bone, a, b);
+			blendKeys(*a, *b, t, blend, out[bone]);
+		}
+	}
+
+	void poseToTransforms(const BonePose* poses, size_t count, geom::Transform* out) {
+		for (size_t i = 0; i < count; i++) {
+			const float* q = poses[i].rotation;
+			float xx = q[0] * q[0], yy = q[1] * q[1], zz = q[2] * q[2];
+			float xy = q[0] * q[1], xz = q[0] * q[2], yz = q[1] * q[2];
+			float wx = q[3] * q[0], wy = q[3] * q[1], wz = q[3] * q[2];
+			// rows are the rotated axes, for row vectors
+			out[i].rotation.row1 = {1 - 2 * (yy + zz), 2 * (xy + wz), 2 * (xz - wy)};
+			out[i].rotation.row2 = {2 * (xy - wz), 1 - 2 * (xx + zz), 2 * (yz + wx)};
+			out[i].rotation.row3 = {2 * (xz + wy), 2 * (yz - wx), 1 - 2 * (xx + yy)};
+			out[i].translation = {poses[i].translation[0], poses[i].translation[1], poses[i].translation[2]};
+		}
+	}
+}
\ No newline at end of file
@@ -0,0 +1,391 @@
+/*
+ * File: simplify.cc
+ * Author: DeadlyFugu
+ * License: zlib
+ * Description: Quadric error mesh simplification and generation of LOD geometry chains
+ */
+
+#include "simplify.hh"
+#include "bounds.hh"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <queue>
+
+namespace rw {
+	namespace geom {
+		/// Symmetric 4x4 error matrix of squared distances to a set of planes, with the total area
+		/// of the faces it came from
+		struct Quadric {
+			double xx, xy, xz, xw, yy, yz, yw, zz, zw, ww;
+			double weight;
+
+			void add(const Quadric& other) {
+				xx += other.xx; xy += other.xy; xz += other.xz; xw += other.xw;
+				yy += other.yy; yz += other.yz; yw += other.yw;
+				zz += other.zz; zw += other.zw;
+				ww += other.ww;
+				weight += other.weight;
+			}
+
+			/// Area weighted sum of squared distances from p to the planes
+			double evaluate(const VertexPosition& p) const {
+				double x = p.x, y = p.y, z = p.z;
+				return xx * x * x + 2 * xy * x * y + 2 * xz * x * z + 2 * xw * x
+					   + yy * y * y + 2 * yz * y * z + 2 * yw * y
+					   + zz * z * z + 2 * zw * z + ww;
+			}
+		};
+
+		struct Collapse {
+			double cost; // mean squared distance
+			uint32_t from;
+			uint32_t to;
+			uint32_t fromStamp;
+			uint32_t toStamp;
+
+			bool operator>(const Collapse& other) const { return cost > other.cost; }
+		};
+
+		class Simplifier {
+		public:
+			Simplifier(const VertexPosition* positions, uint32_t vertexCount, const std::vector<bool>& locked,
+					   const std::vector<Face>& faces)
+				: positions(positions), locked(locked), faces(faces), triangles(faces.size() * 3),
+				  alive(faces.size(), true), aliveCount(faces.size()), quadrics(vertexCount),
+				  vertexFaces(vertexCount), stamps(vertexCount, 0), marks(vertexCount, 0), mark(0) {
+				memset(quadrics.data(), 0, quadrics.size() * sizeof(Quadric));
+				for (size_t f = 0; f < faces.size(); f++) {
+					uint32_t* triangle = &triangles[f * 3];
+					triangle[0] = faces[f].vertex1;
+					triangle[1] = faces[f].vertex2;
+					triangle[2] = faces[f].vertex3;
+					for (int k = 0; k < 3; k++) {
+						vertexFaces[triangle[k]].push_back((uint32_t) f);
+					}
+					addFaceQuadric(triangle);
+				}
+
+				// candidate collapses in both directions along each edge
+				std::vector<uint64_t> edges;
+				edges.reserve(triangles.size());
+				for (size_t f = 0; f < faces.size(); f++) {
+					for (int k = 0; k < 3; k++) {
+						uint32_t a = triangles[f * 3 + k], b = triangles[f * 3 + (k + 1) % 3];
+						if (a == b) continue;
+						edges.push_back((uint64_t) std::min(a, b) << 32 | std::max(a, b));
+					}
+				}
+				std::sort(edges.begin(), edges.end());
+				edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+				for (uint64_t edge : edges) {
+					push((uint32_t) (edge >> 32), (uint32_t) edge);
+					push((uint32_t) edge, (uint32_t) (edge >> 32));
+				}
+			}
+
+			size_t triangleCount() const { return aliveCount; }
+
+			/// Makes the cheapest valid collapse. Returns false if there is none within maxCost.
+			/// Costs are mean squared distances, so rmsError takes the root of the largest.
+			bool step(double maxCost, float& rmsError) {
+				while (!heap.empty()) {
+					Collapse collapse = heap.top();
+					heap.pop();
+					if (collapse.fromStamp != stamps[collapse.from] || collapse.toStamp != stamps[collapse.to]) continue;
+					if (maxCost > 0 && collapse.cost > maxCost) return false;
+					if (!canCollapse(collapse.from, collapse.to)) continue;
+
+					apply(collapse.from, collapse.to);
+					rmsError = std::max(rmsError, (float) std::sqrt(std::max(collapse.cost, 0.0)));
+					return true;
+				}
+				return false;
+			}
+
+			void output(std::vector<Face>& out) const {
+				out.clear();
+				out.reserve(aliveCount);
+				for (size_t f = 0; f < faces.size(); f++) {
+					if (!alive[f]) continue;
+					Face face = faces[f];
+					face.vertex1 = (uint16_t) triangles[f * 3 + 0];
+					face.vertex2 = (uint16_t) triangles[f * 3 + 1];
+					face.vertex3 = (uint16_t) triangles[f * 3 + 2];
+					out.push_back(face);
+				}
+			}
+
+		private:
+			const VertexPosition* positions;
+			const std::vector<bool>& locked;
+			const std::vector<Face>& faces;
+			std::vector<uint32_t> triangles;
+			std::vector<bool> alive;
+			size_t aliveCount;
+			std::vector<Quadric> quadrics;
+			std::vector<std::vector<uint32_t>> vertexFaces;
+			std::vector<uint32_t> stamps; // changed whenever a vertex's quadric or faces change
+			std::vector<uint32_t> marks;
+			uint32_t mark;
+			std::vector<uint32_t> common;
+			std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>> heap;
+
+			static void cross(const VertexPosition& a, const VertexPosition& b, const VertexPosition& c, double n[3]) {
+				double ux = b.x - a.x, uy = b.y - a.y, uz = b.z - a.z;
+				double vx = c.x - a.x, vy = c.y - a.y, vz = c.z - a.z;
+				n[0] = uy * vz - uz * vy;
+				n[1] = uz * vx - ux * vz;
+				n[2] = ux * vy - uy * vx;
+			}
+
+			void addFaceQuadric(const uint32_t* triangle) {
+				double n[3];
+				const VertexPosition& a = positions[triangle[0]];
+				cross(a, positions[triangle[1]], positions[triangle[2]], n);
+				double length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+				if (length == 0) return;
+				double area = length * 0.5;
+				n[0] /= length;
+				n[1] /= length;
+				n[2] /= length;
+				double d = -(n[0] * a.x + n[1] * a.y + n[2] * a.z);
+
+				Quadric plane = {n[0] * n[0], n[0] * n[1], n[0] * n[2], n[0] * d, n[1] * n[1], n[1] * n[2], n[1] * d,
+								 n[2] * n[2], n[2] * d, d * d, 1};
+				plane.xx *= area; plane.xy *= area; plane.xz *= area; plane.xw *= area;
+				plane.yy *= area; plane.yz *= area; plane.yw *= area;
+				plane.zz *= area; plane.zw *= area; plane.ww *= area;
+				plane.weight = area;
+				for (int k = 0; k < 3; k++) {
+					quadrics[triangle[k]].add(plane);
+				}
+			}
+
+			void push(uint32_t from, uint32_t to) {
+				if (locked[from]) return;
+				Quadric sum = quadrics[from];
+				sum.add(quadrics[to]);
+				double cost = sum.weight > 0 ? sum.evaluate(positions[to]) / sum.weight : 0;
+				Collapse collapse = {std::max(cost, 0.0), from, to, stamps[from], stamps[to]};
+				heap.push(collapse);
+			}
+
+			bool contains(uint32_t f, uint32_t vertex) const {
+				const uint32_t* triangle = &triangles[f * 3];
+				return triangle[0] == vertex || triangle[1] == vertex || triangle[2] == vertex;
+			}
+
+			bool canCollapse(uint32_t from, uint32_t to) {
+				// faces on the edge disappear; every other neighbour they share would pinch the mesh
+				mark++;
+				for (uint32_t f : vertexFaces[to]) {
+					if (!alive[f]) continue;
+					for (int k = 0; k < 3; k++) marks[triangles[f * 3 + k]] = mark;
+				}
+				size_t shared = 0;
+				common.clear();
+				for (uint32_t f : vertexFaces[from]) {
+					if (!alive[f]) continue;
+					if (contains(f, to)) {
+						shared++;
+						continue;
+					}
+					for (int k = 0; k < 3; k++) {
+						uint32_t vertex = triangles[f * 3 + k];
+						if (vertex != from && marks[vertex] == mark) common.push_back(vertex);
+					}
+				}
+				std::sort(common.begin(), common.end());
+				size_t commonCount = std::unique(common.begin(), common.end()) - common.begin();
+				if (!shared || commonCount > shared) return false;
+
+				// moving from onto to must not turn any remaining face over
+				for (uint32_t f : vertexFaces[from]) {
+					if (!alive[f] || contains(f, to)) continue;
+					const uint32_t* triangle = &triangles[f * 3];
+					double before[3], after[3];
+					cross(positions[triangle[0]], positions[triangle[1]], positions[triangle[2]], before);
+					const VertexPosition* moved[3];
+					for (int k = 0; k < 3; k++) {
+						moved[k] = &positions[triangle[k] == from ? to : triangle[k]];
+					}
+					cross(*moved[0], *moved[1], *moved[2], after);
+					double dot = before[0] * after[0] + before[1] * after[1] + before[2] * after[2];
+					if (dot <= 0) return false;
+				}
+				return true;
+			}
+
+			void apply(uint32_t from, uint32_t to) {
+				for (uint32_t f : vertexFaces[from]) {
+					if (!alive[f]) continue;
+					if (contains(f, to)) {
+						alive[f] = false;
+						aliveCount--;
+						continue;
+					}
+					uint32_t* triangle = &triangles[f * 3];
+					for (int k = 0; k < 3; k++) {
+						if (triangle[k] == from) triangle[k] = to;
+					}
+					vertexFaces[to].push_back(f);
+				}
+				std::vector<uint32_t>().swap(vertexFaces[from]);
+				auto& toFaces = vertexFaces[to];
+				toFaces.erase(std::remove_if(toFaces.begin(), toFaces.end(), [this](uint32_t f) {
+					return !alive[f];
+				}), toFaces.end());
+
+				quadrics[to].add(quadrics[from]);
+				stamps[from]++;
+				stamps[to]++;
+
+				// costs involving to have changed
+				for (uint32_t f : toFaces) {
+					for (int k = 0; k < 3; k++) {
+						uint32_t vertex = triangles[f * 3 + k];
+						if (vertex == to) continue;
+						push(vertex, to);
+						push(to, vertex);
+					}
+				}
+			}
+		};
+
+		void simplifyFaces(const VertexPosition* positions, uint32_t vertexCount, const std::vector<bool>& locked,
+						   const std::vector<Face>& faces, const std::vector<size_t>& targets, float maxError,
+						   std::vector<SimplifiedLevel>& levels) {
+			levels.clear();
+			Simplifier simplifier(positions, vertexCount, locked, faces);
+			double maxCost = maxError > 0 ? (double) maxError * maxError : 0;
+			float rmsError = 0;
+			size_t lastCount = faces.size();
+
+			for (size_t target : targets) {
+				bool reached = true;
+				while (simplifier.triangleCount() > target) {
+					if (!simplifier.step(maxCost, rmsError)) {
+						reached = false;
+						break;
+					}
+				}
+				if (simplifier.triangleCount() < lastCount) {
+					levels.emplace_back();
+					simplifier.output(levels.back().faces);
+					levels.back().rmsError = rmsError;
+					lastCount = simplifier.triangleCount();
+				}
+				if (!reached) break;
+			}
+		}
+	}
+
+	void findLockedVertices(GeometryChunk* geometry, std::vector<bool>& locked) {
+		uint32_t vertexCount = geometry->vertexCount;
+		auto& positions = geometry->morphTargets[0].vertexPositions;
+		locked.assign(vertexCount, false);
+
+		// vertices sharing a position differ in colour, UVs or normal: a seam
+		std::vector<uint32_t> order(vertexCount), group(vertexCount);
+		for (uint32_t v = 0; v < vertexCount; v++) order[v] = v;
+		std::sort(order.begin(), order.end(), [&positions](uint32_t a, uint32_t b) {
+			return memcmp(&positions[a], &positions[b], sizeof(geom::VertexPosition)) < 0;
+		});
+		for (size_t i = 0; i < order.size();) {
+			size_t end = i + 1;
+			while (end < order.size() && !memcmp(&positions[order[i]], &positions[order[end]], sizeof(geom::VertexPosition))) {
+				end++;
+			}
+			for (size_t j = i; j < end; j++) {
+				group[order[j]] = order[i];
+				if (end - i > 1) locked[order[j]] = true;
+			}
+			i = end;
+		}
+
+		// material boundaries
+		const uint32_t NO_MATERIAL = 0xffffffffu;
+		std::vector<uint32_t> material(vertexCount, NO_MATERIAL);
+		for (auto& face : geometry->faces) {
+			for (uint32_t v : {face.vertex1, face.vertex2, face.vertex3}) {
+				if (material[v] == NO_MATERIAL) material[v] = face.material;
+				else if (material[v] != face.material) locked[v] = true;
+			}
+		}
+
+		// edges used by one face (a border) or more than two, between positions so seams do not count
+		std::vector<uint64_t> edges;
+		for (auto& face : geometry->faces) {
+			uint32_t corners[3] = {group[face.vertex1], group[face.vertex2], group[face.vertex3]};
+			for (int k = 0; k < 3; k++) {
+				uint32_t a = corners[k], b = corners[(k + 1) % 3];
+				if (a != b) edges.push_back((uint64_t) std::min(a, b) << 32 | std::max(a, b));
+			}
+		}
+		std::sort(edges.begin(), edges.end());
+		std::vector<bool> lockedGroup(vertexCount, false);
+		for (size_t i = 0; i < edges.size();) {
+			size_t end = i + 1;
+			while (end < edges.size() && edges[end] == edges[i]) end++;
+			if (end - i != 2) {
+				lockedGroup[(uint32_t) (edges[i] >> 32)] = true;
+				lockedGroup[(uint32_t) edges[i]] = true;
+			}
+			i = end;
+		}
+		for (uint32_t v = 0; v < vertexCount; v++) {
+			if (lockedGroup[group[v]]) locked[v] = true;
+		}
+	}
+
+	std::vector<LodLevel> buildLodChain(GeometryChunk* geometry, const LodOptions& options) {
+		std::vector<LodLevel> chain;
+		if (geometry->format & RW_GEOMETRY_NATIVE) {
+			util::logger.warn("Cannot simplify native geometry");
+			return chain;
+		}
+		if (geometry->morphTargets.empty() || geometry->morphTargets[0].vertexPositions.size() != geometry->vertexCount) {
+			util::logger.warn("Cannot simplify geometry without positions");
+			return chain;
+		}
+		for (auto& face : geometry->faces) {
+			if (face.vertex1 >= geometry->vertexCount || face.vertex2 >= geometry->vertexCount
+				|| face.vertex3 >= geometry->vertexCount) {
+				util::logger.warn("Cannot simplify geometry with a face out of range");
+				return chain;
+			}
+		}
+
+		std::vector<size_t> targets;
+		double count = geometry->faces.size();
+		for (uint32_t i = 0; i < options.levels; i++) {
+			count *= options.ratio;
+			if ((size_t) count < 1) break;
+			targets.push_back((size_t) count);
+		}
+
+		std::vector<bool> locked;
+		findLockedVertices(geometry, locked);
+		std::vector<geom::SimplifiedLevel> levels;
+		geom::simplifyFaces(geometry->morphTargets[0].vertexPositions.data(), geometry->vertexCount, locked,
+							geometry->faces, targets, options.maxError, levels);
+
+		for (auto& level : levels) {
+			auto lod = (GeometryChunk*) cloneChunk(geometry);
+			lod->faces.swap(level.faces);
+			lod->preWriteHook();
+			if (BinMeshPLGChunk* binMesh = findBinMesh(lod)) {
+				BinMeshOptions binMeshOptions = {binMesh->flags == 1, false};
+				rebuildBinMesh(lod, binMeshOptions);
+			}
+			compactVertices(lod);
+			updateBounds(lod);
+
+			LodLevel result = {lod, (uint32_t) lod->faces.size(), lod->vertexCount, level.rmsError};
+			chain.push_back(result);
+		}
+		return chain;
+	}
+}
\ No newline at end of file
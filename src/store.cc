@@ -0,0 +1,402 @@
+/*
+ * File: store.cc
+ * Author: DeadlyFugu
+ * License: zlib
+ * Description: Content-addressed store which keeps each unique chunk once across many streams
+ */
+
+#include "store.hh"
+
+namespace rw {
+	static const uint32_t STORE_MAGIC = 0x53435752; // "RWCS"
+	static const uint32_t STORE_VERSION = 1;
+
+	struct ChunkHeader {
+		uint32_t type;
+		uint32_t size;
+		uint32_t version;
+	};
+
+	static void writePadding(util::Buffer& out) {
+		while (out.tell() & 3) {
+			out.write((uint8_t) 0);
+		}
+	}
+
+	ChunkStore::ChunkStore() : file(0), inputBytes(0) {}
+
+	bool ChunkStore::addNode(Node& node, Key& key) {
+		if (node.isList) {
+			key = hashListChunk(node.type, node.version, node.children.data(), node.children.size());
+		} else {
+			key = hashStructChunk(node.type, node.version, node.data, node.size);
+		}
+
+		auto it = nodes.find(key);
+		if (it != nodes.end()) {
+			// already stored, but make sure this is not a collision
+			Node& existing = it->second;
+			bool same = existing.type == node.type && existing.version == node.version
+						&& existing.size == node.size && existing.isList == node.isList;
+			if (same && node.isList) {
+				same = existing.children == node.children;
+			} else if (same) {
+				same = !node.size || !memcmp(existing.data, node.data, node.size);
+			}
+			if (!same) {
+				util::logger.error("Hash collision in chunk store (key %016llx)", (unsigned long long) key);
+				return false;
+			}
+			return true;
+		}
+
+		Node& stored = nodes[key];
+		stored.type = node.type;
+		stored.version = node.version;
+		stored.size = node.size;
+		stored.isList = node.isList;
+		stored.children.swap(node.children);
+		if (!node.isList) {
+			stored.owned.assign(node.data, node.data + node.size);
+			stored.data = stored.owned.data();
+		} else {
+			stored.data = nullptr;
+		}
+		return true;
+	}
+
+	bool ChunkStore::addChunk(const uint8_t* p, uint32_t len, Key& key, uint32_t depth) {
+		ChunkHeader header;
+		if (len < sizeof(header)) {
+			util::logger.warn("Chunk of 0x%x bytes is too short for its header", len);
+			return false;
+		}
+		memcpy(&header, p, sizeof(header));
+		if (header.size > len - sizeof(header)) {
+			util::logger.warn("Invalid chunk (size 0x%x exceeds the 0x%x bytes available)", header.size,
+							  len - (uint32_t) sizeof(header));
+			return false;
+		}
+		const uint8_t* body = p + sizeof(header);
+
+		Node node;
+		node.type = (ChunkType) header.type;
+		node.version = header.version;
+		node.size = header.size;
+		node.data = body;
+
+		// split into children only where readChunk would read a list
+		util::Buffer content((void*) body, header.size, false);
+		Chunk* probe = createChunk(node.type, node.version, content);
+		node.isList = probe->isList();
+		delete probe;
+
+		if (node.isList) {
+			// the body must be exactly a sequence of complete chunks to be rebuilt from them
+			std::vector<uint32_t> childOffsets;
+			uint32_t cursor = 0;
+			while (cursor < header.size) {
+				ChunkHeader child;
+				if (header.size - cursor < sizeof(child)) break;
+				memcpy(&child, body + cursor, sizeof(child));
+				if (child.size > header.size - cursor - sizeof(child)) break;
+				childOffsets.push_back(cursor);
+				cursor += sizeof(child) + child.size;
+			}
+
+			if (cursor == header.size && !childOffsets.empty() && depth >= DEFAULT_MAX_CHUNK_DEPTH) {
+				util::logger.warn("Chunk is nested deeper than %u, cannot store it", DEFAULT_MAX_CHUNK_DEPTH);
+				return false;
+			}
+			if (cursor == header.size) {
+				for (uint32_t childOffset : childOffsets) {
+					ChunkHeader child;
+					memcpy(&child, body + childOffset, sizeof(child));
+					Key childKey;
+					if (!addChunk(body + childOffset, sizeof(child) + child.size, childKey, depth + 1)) {
+						return false;
+					}
+					node.children.push_back(childKey);
+				}
+			} else {
+				node.isList = false;
+			}
+		}
+
+		return addNode(node, key);
+	}
+
+	bool ChunkStore::add(const std::string& name, util::Buffer& stream) {
+		Stream entry;
+		auto start = (const uint8_t*) stream.base_ptr();
+		uint32_t size = stream.size();
+		uint32_t cursor = 0;
+		while (size - cursor >= sizeof(ChunkHeader)) {
+			ChunkHeader header;
+			memcpy(&header, start + cursor, sizeof(header));
+			if (header.size > size - cursor - sizeof(header)) break;
+
+			Key key;
+			if (!addChunk(start + cursor, sizeof(header) + header.size, key, 0)) {
+				return false;
+			}
+			entry.roots.push_back(key);
+			cursor += sizeof(header) + header.size;
+		}
+		entry.trailing.assign(start + cursor, start + size);
+
+		inputBytes += size;
+		streams[name] = std::move(entry);
+		return true;
+	}
+
+	bool ChunkStore::addFile(const char* filepath) {
+		util::Buffer buffer(0);
+		if (!util::readFile(filepath, buffer)) {
+			return false;
+		}
+		return add(filepath, buffer);
+	}
+
+	bool ChunkStore::contains(const std::string& name) {
+		return streams.find(name) != streams.end();
+	}
+
+	std::vector<std::string> ChunkStore::names() {
+		std::vector<std::string> result;
+		for (auto& entry : streams) {
+			result.push_back(entry.first);
+		}
+		return result;
+	}
+
+	void ChunkStore::rebuildNode(const Node& node, util::Buffer& out) {
+		ChunkHeader header = {node.type, node.size, node.version};
+		out.write(header);
+		if (node.isList) {
+			for (Key child : node.children) {
+				rebuildNode(nodes.at(child), out);
+			}
+		} else {
+			out.write(node.data, node.size);
+		}
+	}
+
+	bool ChunkStore::rebuild(const std::string& name, util::Buffer& out) {
+		auto it = streams.find(name);
+		if (it == streams.end()) {
+			util::logger.warn("Stream %s is not in chunk store", name.c_str());
+			return false;
+		}
+
+		for (Key root : it->second.roots) {
+			rebuildNode(nodes.at(root), out);
+		}
+		auto& trailing = it->second.trailing;
+		if (!trailing.empty()) {
+			out.write(trailing.data(), trailing.size());
+		}
+		return true;
+	}
+
+	Chunk* ChunkStore::loadNode(Key key, uint32_t offset) {
+		auto it = nodes.find(key);
+		if (it == nodes.end()) return nullptr;
+		const Node& node = it->second;
+
+		if (node.isList) {
+			// the first child's header is all createChunk needs to pick a class
+			ChunkHeader first = {0, 0, 0};
+			if (!node.children.empty()) {
+				const Node& child = nodes.at(node.children[0]);
+				first = {child.type, child.size, child.version};
+			}
+			util::Buffer content(&first, node.children.empty() ? 0 : sizeof(first), false);
+			auto chunk = (ListChunk*) createChunk(node.type, node.version, content);
+			chunk->offset = offset;
+
+			uint32_t childOffset = offset + sizeof(ChunkHeader);
+			for (Key childKey : node.children) {
+				chunk->addChild(loadNode(childKey, childOffset));
+				childOffset += sizeof(ChunkHeader) + nodes.at(childKey).size;
+			}
+			chunk->postReadHook();
+			return chunk;
+		}
+
+		util::Buffer content((void*) node.data, node.size, false);
+		Chunk* chunk = createChunk(node.type, node.version, content);
+		chunk->offset = offset;
+		if (chunk->isList()) {
+			// list body which did not split into complete chunks
+			chunk->read(content);
+		} else {
+			((StructChunk*) chunk)->readView(content);
+		}
+		return chunk;
+	}
+
+	Chunk* ChunkStore::load(const std::string& name) {
+		auto it = streams.find(name);
+		if (it == streams.end() || it->second.roots.empty()) {
+			util::logger.warn("No chunk stored for stream %s", name.c_str());
+			return nullptr;
+		}
+		return loadNode(it->second.roots[0], 0);
+	}
+
+	Chunk* ChunkStore::loadChunk(Key key) {
+		return loadNode(key, 0);
+	}
+
+	size_t ChunkStore::chunkCount() {
+		return nodes.size();
+	}
+
+	size_t ChunkStore::totalBytes() {
+		return inputBytes;
+	}
+
+	size_t ChunkStore::storedBytes() {
+		size_t total = 0;
+		for (auto& entry : nodes) {
+			total += entry.second.isList ? entry.second.children.size() * sizeof(Key) : entry.second.size;
+		}
+		return total;
+	}
+
+	bool ChunkStore::save(const char* filepath) {
+		util::Buffer out(0);
+		out.setStretchy(true);
+		out.write(STORE_MAGIC);
+		out.write(STORE_VERSION);
+		out.write((uint64_t) inputBytes);
+
+		out.write((uint32_t) nodes.size());
+		for (auto& entry : nodes) {
+			const Node& node = entry.second;
+			out.write(entry.first);
+			ChunkHeader header = {node.type, node.size, node.version};
+			out.write(header);
+			out.write((uint32_t) node.isList);
+			if (node.isList) {
+				out.write((uint32_t) node.children.size());
+				out.write(node.children.data(), node.children.size() * sizeof(Key));
+			} else {
+				out.write(node.data, node.size);
+				writePadding(out);
+			}
+		}
+
+		out.write((uint32_t) streams.size());
+		for (auto& entry : streams) {
+			out.write((uint32_t) entry.first.size());
+			out.write(entry.first.data(), entry.first.size());
+			writePadding(out);
+			out.write((uint32_t) entry.second.roots.size());
+			out.write(entry.second.roots.data(), entry.second.roots.size() * sizeof(Key));
+			out.write((uint32_t) entry.second.trailing.size());
+			out.write(entry.second.trailing.data(), entry.second.trailing.size());
+			writePadding(out);
+		}
+
+		return util::writeFile(filepath, out);
+	}
+
+	bool ChunkStore::open(const char* filepath) {
+		nodes.clear();
+		streams.clear();
+		inputBytes = 0;
+
+		util::Buffer loaded(0);
+		if (!util::readFile(filepath, loaded)) {
+			return false;
+		}
+		file = std::move(loaded);
+		file.seek(0);
+
+		uint32_t magic = 0, formatVersion = 0, count;
+		uint64_t totalInput;
+		if (file.remaining() < 20) {
+			util::logger.warn("Chunk store %s is truncated", filepath);
+			return false;
+		}
+		file.read(&magic);
+		file.read(&formatVersion);
+		if (magic != STORE_MAGIC || formatVersion != STORE_VERSION) {
+			util::logger.warn("%s is not a chunk store", filepath);
+			return false;
+		}
+		file.read(&totalInput);
+		inputBytes = (size_t) totalInput;
+
+		file.read(&count);
+		for (uint32_t i = 0; i < count; i++) {
+			Key key;
+			ChunkHeader header;
+			uint32_t isList;
+			if (file.remaining() < sizeof(key) + sizeof(header) + 4) break;
+			file.read(&key);
+			file.read(&header);
+			file.read(&isList);
+
+			Node& node = nodes[key];
+			node.type = (ChunkType) header.type;
+			node.size = header.size;
+			node.version = header.version;
+			node.isList = isList != 0;
+			node.data = nullptr;
+			if (node.isList) {
+				uint32_t childCount = 0;
+				if (file.remaining() >= 4) file.read(&childCount);
+				if (file.remaining() / sizeof(Key) < childCount) break;
+				node.children.resize(childCount);
+				file.read(node.children.data(), childCount * sizeof(Key));
+			} else {
+				if (file.remaining() < node.size) break;
+				// struct bodies are used in place
+				node.data = (const uint8_t*) file.head_ptr();
+				file.skip(node.size);
+				file.align32();
+			}
+		}
+		if (nodes.size() != count) {
+			util::logger.warn("Chunk store %s is truncated", filepath);
+			return false;
+		}
+
+		if (file.remaining() < 4) {
+			util::logger.warn("Chunk store %s is truncated", filepath);
+			return false;
+		}
+		file.read(&count);
+		for (uint32_t i = 0; i < count; i++) {
+			uint32_t length;
+			if (file.remaining() < 4) break;
+			file.read(&length);
+			if (file.remaining() < length) break;
+			std::string name((const char*) file.head_ptr(), length);
+			file.skip(length);
+			file.align32();
+
+			Stream& stream = streams[name];
+			uint32_t rootCount = 0;
+			if (file.remaining() >= 4) file.read(&rootCount);
+			if (file.remaining() / sizeof(Key) < rootCount) break;
+			stream.roots.resize(rootCount);
+			file.read(stream.roots.data(), rootCount * sizeof(Key));
+			if (file.remaining() < 4) break;
+			file.read(&length);
+			if (file.remaining() < length) break;
+			auto trailing = (const uint8_t*) file.head_ptr();
+			stream.trailing.assign(trailing, trailing + length);
+			file.skip(length);
+			file.align32();
+		}
+		if (streams.size() != count) {
+			util::logger.warn("Chunk store %s is truncated", filepath);
+			return false;
+		}
+		return true;
+	}
+}
\ No newline at end of file
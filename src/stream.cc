@@ -0,0 +1,297 @@
+/*
+ * File: stream.cc
+ * Author: DeadlyFugu
+ * License: zlib
+ * Description: Loads the atomic sections of a world on demand, by the region they cover
+ */
+
+#include "stream.hh"
+
+#include <cstdlib>
+#include <limits>
+
+namespace rw {
+	struct ChunkHeader {
+		uint32_t type;
+		uint32_t size;
+		uint32_t version;
+	};
+
+	/// Chunks decoded from a copy of their bytes are offset from the copy, not the stream
+	static void shiftOffsets(Chunk* chunk, uint32_t by) {
+		visitChunks(chunk, [by](Chunk* descendant, uint32_t) {
+			descendant->offset += by;
+			return true;
+		});
+	}
+
+	WorldStream::WorldStream() : materialList(nullptr), file(nullptr), memory(0), streamSize(0), decoded(0) {}
+
+	WorldStream::~WorldStream() {
+		close();
+	}
+
+	bool WorldStream::open(const char* filepath) {
+		close();
+		file = fopen(filepath, "rb");
+		if (!file) {
+			util::logger.error("Unable to open file %s for reading", filepath);
+			return false;
+		}
+		fseek(file, 0, SEEK_END);
+		long length = ftell(file);
+		if (length < 0 || (unsigned long) length > std::numeric_limits<uint32_t>::max()) {
+			util::logger.warn("File %s is too large to stream", filepath);
+			close();
+			return false;
+		}
+		streamSize = (uint32_t) length;
+
+		if (!index()) {
+			close();
+			return false;
+		}
+		return true;
+	}
+
+	bool WorldStream::open(util::Buffer& stream) {
+		close();
+		memory = stream.view(0, stream.size());
+		streamSize = memory.size();
+
+		if (!index()) {
+			close();
+			return false;
+		}
+		return true;
+	}
+
+	void WorldStream::close() {
+		for (auto section : bsp.sections) {
+			delete section;
+		}
+		bsp.clear();
+		extents.clear();
+		delete materialList;
+		materialList = nullptr;
+		if (file) {
+			fclose(file);
+			file = nullptr;
+		}
+		memory = util::Buffer(0);
+		streamSize = 0;
+		decoded = 0;
+	}
+
+	bool WorldStream::readBytes(uint32_t offset, uint32_t length, util::Buffer& out) {
+		if (offset > streamSize || length > streamSize - offset) {
+			util::logger.warn("Read past the end of the stream at 0x%x", offset);
+			return false;
+		}
+		if (!file) {
+			out = memory.view(offset, length);
+			return true;
+		}
+
+		uint8_t* data = (uint8_t*) malloc(length);
+		if (fseek(file, offset, SEEK_SET) != 0 || (length && fread(data, length, 1, file) != 1)) {
+			util::logger.warn("Unable to read 0x%x bytes at 0x%x", length, offset);
+			free(data);
+			return false;
+		}
+		out = util::Buffer(data, length, true);
+		return true;
+	}
+
+	bool WorldStream::index() {
+		util::Buffer bytes(0);
+		// reads the header of the chunk at offset, which must end by end
+		auto readHeader = [&](uint32_t offset, uint32_t end, ChunkHeader& header) {
+			if (end - offset < sizeof(header) || !readBytes(offset, sizeof(header), bytes)) {
+				util::logger.warn("No chunk found at 0x%x", offset);
+				return false;
+			}
+			bytes.read(&header);
+			if (header.size > end - offset - sizeof(header)) {
+				util::logger.warn("Invalid chunk at 0x%x (size too large)", offset);
+				return false;
+			}
+			return true;
+		};
+
+		ChunkHeader world;
+		if (!readHeader(0, streamSize, world)) return false;
+		if (world.type != RW_WORLD) {
+			util::logger.warn("Stream does not begin with a World");
+			return false;
+		}
+
+		uint32_t worldEnd = sizeof(world) + world.size;
+		uint32_t root = WorldBsp::NONE;
+		for (uint32_t at = sizeof(world); at < worldEnd;) {
+			ChunkHeader child;
+			if (!readHeader(at, worldEnd, child)) return false;
+			if (child.type == RW_MATERIAL_LIST && !materialList) {
+				if (!readBytes(at, sizeof(child) + child.size, bytes)) return false;
+				materialList = (MaterialListChunk*) readChunk(bytes);
+				if (file) shiftOffsets(materialList, at);
+			} else if ((child.type == RW_ATOMIC_SECTION || child.type == RW_PLANE_SECTION) && root == WorldBsp::NONE) {
+				root = at;
+			}
+			at += sizeof(child) + child.size;
+		}
+		if (!materialList) {
+			util::logger.warn("World is missing Material List");
+		}
+		if (root == WorldBsp::NONE) {
+			util::logger.warn("World is missing root section");
+			return true;
+		}
+
+		// pre-order, left before right, as WorldBsp::build numbers sections
+		std::vector<uint32_t> stack(1, root);
+		while (!stack.empty()) {
+			uint32_t at = stack.back();
+			stack.pop_back();
+
+			ChunkHeader section;
+			if (!readHeader(at, streamSize, section)) return false;
+			bool isAtomic = section.type == RW_ATOMIC_SECTION;
+			uint32_t end = at + sizeof(section) + section.size;
+
+			BspNode node = {};
+			BspPlane plane = {0, 0};
+			uint32_t children[2];
+			int childCount = 0;
+			bool structWasSeen = false;
+			for (uint32_t child = at + sizeof(section); child < end;) {
+				ChunkHeader header;
+				if (!readHeader(child, end, header)) return false;
+				if (header.type == RW_STRUCT && !structWasSeen) {
+					structWasSeen = true;
+					if (isAtomic) {
+						// model flags, face count, vertex count, bbox max, bbox min
+						uint32_t counts[3];
+						float bboxMax[3], bboxMin[3];
+						if (header.size < 36 || !readBytes(child + sizeof(header), 36, bytes)) {
+							util::logger.warn("Atomic Section struct is too short");
+							return false;
+						}
+						bytes.read(&counts);
+						bytes.read(&bboxMax);
+						bytes.read(&bboxMin);
+						for (int axis = 0; axis < 3; axis++) {
+							// an empty section overlaps nothing
+							node.min[axis] = counts[2] ? bboxMin[axis] : std::numeric_limits<float>::infinity();
+							node.max[axis] = counts[2] ? bboxMax[axis] : -std::numeric_limits<float>::infinity();
+						}
+					} else {
+						uint32_t type;
+						if (header.size < 8 || !readBytes(child + sizeof(header), 8, bytes)) {
+							util::logger.warn("Plane Section struct is too short");
+							return false;
+						}
+						bytes.read(&type);
+						bytes.read(&plane.value);
+						if (type != 0 && type != 4 && type != 8) {
+							util::logger.warn("Plane Section has unknown plane type %d", type);
+							return false;
+						}
+						plane.axis = type / 4;
+					}
+				} else if (!isAtomic && (header.type == RW_ATOMIC_SECTION || header.type == RW_PLANE_SECTION)) {
+					if (childCount < 2) {
+						children[childCount++] = child;
+					} else {
+						util::logger.warn("Extraneous child section in Plane Section");
+					}
+				}
+				child += sizeof(header) + header.size;
+			}
+
+			if (!structWasSeen) {
+				util::logger.warn(isAtomic ? "Atomic Section is missing struct" : "Plane Section is missing struct");
+				return false;
+			}
+			if (isAtomic) {
+				node.section = (uint32_t) extents.size();
+				SectionExtent extent = {at, end - at};
+				extents.push_back(extent);
+				bsp.sections.push_back(nullptr);
+			} else {
+				if (childCount < 2) {
+					util::logger.warn("Plane Section is missing a child");
+					return false;
+				}
+				node.section = WorldBsp::NONE;
+				stack.push_back(children[1]);
+				stack.push_back(children[0]);
+			}
+			bsp.nodes.push_back(node);
+			bsp.planes.push_back(plane);
+		}
+		bsp.finishNodes();
+		wanted.assign(extents.size(), false);
+		return true;
+	}
+
+	AtomicSectionChunk* WorldStream::acquire(uint32_t section) {
+		if (section >= extents.size()) return nullptr;
+		if (bsp.sections[section]) return bsp.sections[section];
+
+		const SectionExtent& extent = extents[section];
+		util::Buffer bytes(0);
+		if (!readBytes(extent.offset, extent.size, bytes)) return nullptr;
+		Chunk* chunk = readChunk(bytes);
+		if (!chunk) return nullptr;
+		if (chunk->type != RW_ATOMIC_SECTION) {
+			util::logger.warn("Expected Atomic Section at 0x%x", extent.offset);
+			delete chunk;
+			return nullptr;
+		}
+		if (file) shiftOffsets(chunk, extent.offset);
+
+		bsp.sections[section] = (AtomicSectionChunk*) chunk;
+		decoded++;
+		return bsp.sections[section];
+	}
+
+	void WorldStream::evict(uint32_t section) {
+		if (section >= extents.size() || !bsp.sections[section]) return;
+		delete bsp.sections[section];
+		bsp.sections[section] = nullptr;
+		decoded--;
+	}
+
+	uint32_t WorldStream::applyQuery() {
+		for (uint32_t section : query) {
+			wanted[section] = true;
+		}
+		for (uint32_t section = 0; section < extents.size(); section++) {
+			if (!wanted[section]) evict(section);
+		}
+
+		uint32_t before = decoded;
+		for (uint32_t section : query) {
+			acquire(section);
+			wanted[section] = false;
+		}
+		return decoded - before;
+	}
+
+	uint32_t WorldStream::setRegion(const geom::AABB& region) {
+		query.clear();
+		bsp.queryAABB(region, query);
+		return applyQuery();
+	}
+
+	uint32_t WorldStream::setRegion(const geom::Sphere& region) {
+		query.clear();
+		bsp.querySphere(region, query);
+		return applyQuery();
+	}
+
+	uint32_t WorldStream::decodedCount() const {
+		return decoded;
+	}
+}
\ No newline at end of file
@@ -67,6 +67,45 @@ namespace rw {
 		}
 	}
 
+	void rw::TextureNative::dumpJson(util::JsonWriter& out) {
+		out.field("platformId", platformId);
+		out.field("filterMode", (uint32_t) filterMode);
+		out.field("addressUMode", (uint32_t) addressUMode);
+		out.field("addressVMode", (uint32_t) addressVMode);
+		out.field("name", name);
+		out.field("maskName", maskName);
+		if (platformId != PLATFORM_XBOX) return;
+
+		out.field("format", format);
+		out.field("hasAlpha", (bool) hasAlpha);
+		out.field("unknownFlag", (uint32_t) unknownFlag);
+		out.field("width", (uint32_t) width);
+		out.field("height", (uint32_t) height);
+		out.field("depth", (uint32_t) depth);
+		out.field("mipLevels", (uint32_t) mipLevels);
+		out.field("type", (uint32_t) type);
+		out.field("compression", (uint32_t) compression);
+
+		StructChunk* content = getStruct();
+		if (!content) return;
+
+		// walk the same layout as postReadHook: common header, xbox header, palette, mipmaps
+		uint32_t cursor = 72 + 16;
+		if (palette) {
+			uint32_t paletteSize = (format & RASTER_PAL4) ? 4 * 32 : 4 * 256;
+			content->dumpJsonBlob(out, "palette", cursor, paletteSize);
+			cursor += paletteSize;
+		}
+		out.beginArray("mipmaps");
+		for (auto& mipmap : mipmaps) {
+			out.beginObject();
+			content->dumpJsonBlob(out, "data", cursor + 4, mipmap.size);
+			out.endObject();
+			cursor += 4 + mipmap.size;
+		}
+		out.endArray();
+	}
+
 	void rw::TextureNative::postReadHook() {
 		bool structWasSeen = false;
 		for (auto child : children) {
@@ -158,6 +197,11 @@ namespace rw {
 		ListChunk::dump(out);
 	}
 
+	void TextureDictionary::dumpJson(util::JsonWriter& out) {
+		out.field("textureCount", (uint32_t) textureCount);
+		out.field("deviceId", (uint32_t) deviceId);
+	}
+
 	void TextureDictionary::postReadHook() {
 		bool structWasSeen = false;
 		for (auto child : children) {
@@ -0,0 +1,228 @@
+/*
+ * File: transform.cc
+ * Author: DeadlyFugu
+ * License: zlib
+ * Description: Affine transforms in the layout RenderWare uses for frames, and frame hierarchies
+ */
+
+#include "transform.hh"
+
+#include <algorithm>
+#include <cmath>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace rw {
+	namespace geom {
+		Transform identityTransform() {
+			Transform transform = {{{1, 0, 0}, {0, 1, 0}, {0, 0, 1}}, {0, 0, 0}};
+			return transform;
+		}
+
+		/// v * matrix
+		static inline Vector3f rotate(const Vector3f& v, const Matrix3x3f& matrix) {
+			Vector3f result = {
+				v.x * matrix.row1.x + v.y * matrix.row2.x + v.z * matrix.row3.x,
+				v.x * matrix.row1.y + v.y * matrix.row2.y + v.z * matrix.row3.y,
+				v.x * matrix.row1.z + v.y * matrix.row2.z + v.z * matrix.row3.z
+			};
+			return result;
+		}
+
+		Transform combineTransforms(const Transform& first, const Transform& second) {
+			Transform result;
+			result.rotation.row1 = rotate(first.rotation.row1, second.rotation);
+			result.rotation.row2 = rotate(first.rotation.row2, second.rotation);
+			result.rotation.row3 = rotate(first.rotation.row3, second.rotation);
+			result.translation = transformPoint(second, first.translation);
+			return result;
+		}
+
+		Vector3f transformPoint(const Transform& transform, const Vector3f& point) {
+			Vector3f result = rotate(point, transform.rotation);
+			result.x += transform.translation.x;
+			result.y += transform.translation.y;
+			result.z += transform.translation.z;
+			return result;
+		}
+
+		float maxScale(const Transform& transform) {
+			float lengths = 0;
+			for (const Vector3f* row : {&transform.rotation.row1, &transform.rotation.row2, &transform.rotation.row3}) {
+				lengths = std::max(lengths, row->x * row->x + row->y * row->y + row->z * row->z);
+			}
+			return std::sqrt(lengths);
+		}
+	}
+
+	bool FrameHierarchy::build(FrameListChunk* frameList) {
+		clear();
+		auto& frames = frameList->frames;
+		if (frames.empty()) return false;
+
+		uint32_t count = (uint32_t) frames.size();
+		std::vector<uint32_t> position(count, NONE);
+		std::vector<uint8_t> state(count, 0); // 0 pending, 1 on the current chain, 2 placed
+		std::vector<uint32_t> chain;
+		for (uint32_t i = 0; i < count; i++) {
+			// walk up to a placed frame or a root, then place the chain top down
+			uint32_t frame = i;
+			while (frame < count && state[frame] == 0) {
+				state[frame] = 1;
+				chain.push_back(frame);
+				frame = frames[frame].previous;
+			}
+			uint32_t parent = frame < count && state[frame] == 2 ? position[frame] : NONE;
+			if (frame < count && state[frame] == 1) {
+				util::logger.warn("Frame %u is its own ancestor", frame);
+			}
+			for (size_t j = chain.size(); j-- > 0;) {
+				uint32_t current = chain[j];
+				position[current] = (uint32_t) order.size();
+				order.push_back(current);
+				parents.push_back(parent);
+				parent = position[current];
+				state[current] = 2;
+			}
+			chain.clear();
+		}
+		return true;
+	}
+
+	void FrameHierarchy::clear() {
+		order.clear();
+		parents.clear();
+	}
+
+	uint32_t FrameHierarchy::frameCount() const {
+		return (uint32_t) order.size();
+	}
+
+	static_assert(sizeof(geom::Transform) == 12 * sizeof(float), "Transform is read as 12 floats");
+
+#ifdef __SSE2__
+	/// One transform in each of four lanes, as rotation rows then translation
+	struct TransformLanes {
+		__m128 e[12];
+	};
+
+	static inline void loadLanes(const geom::Transform* const* transforms, TransformLanes& out) {
+		for (int q = 0; q < 3; q++) {
+			__m128 a = _mm_loadu_ps((const float*) transforms[0] + q * 4);
+			__m128 b = _mm_loadu_ps((const float*) transforms[1] + q * 4);
+			__m128 c = _mm_loadu_ps((const float*) transforms[2] + q * 4);
+			__m128 d = _mm_loadu_ps((const float*) transforms[3] + q * 4);
+			_MM_TRANSPOSE4_PS(a, b, c, d);
+			out.e[q * 4 + 0] = a;
+			out.e[q * 4 + 1] = b;
+			out.e[q * 4 + 2] = c;
+			out.e[q * 4 + 3] = d;
+		}
+	}
+
+	static inline void storeLanes(const TransformLanes& in, geom::Transform* const* transforms) {
+		for (int q = 0; q < 3; q++) {
+			__m128 a = in.e[q * 4 + 0], b = in.e[q * 4 + 1], c = in.e[q * 4 + 2], d = in.e[q * 4 + 3];
+			_MM_TRANSPOSE4_PS(a, b, c, d);
+			_mm_storeu_ps((float*) transforms[0] + q * 4, a);
+			_mm_storeu_ps((float*) transforms[1] + q * 4, b);
+			_mm_storeu_ps((float*) transforms[2] + q * 4, c);
+			_mm_storeu_ps((float*) transforms[3] + q * 4, d);
+		}
+	}
+
+	/// x * c0 + y * c1 + z * c2 in each lane
+	static inline __m128 combineRow(__m128 x, __m128 y, __m128 z, __m128 c0, __m128 c1, __m128 c2) {
+		return _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, c0), _mm_mul_ps(y, c1)), _mm_mul_ps(z, c2));
+	}
+
+	/// combineTransforms in each lane
+	static inline void combineLanes(const TransformLanes& first, const TransformLanes& second, TransformLanes& out) {
+		const __m128* m = second.e;
+		const __m128* v = first.e;
+		// rows of the rotation, then the translation, which is also moved
+		out.e[0] = combineRow(v[0], v[1], v[2], m[0], m[3], m[6]);
+		out.e[1] = combineRow(v[0], v[1], v[2], m[1], m[4], m[7]);
+		out.e[2] = combineRow(v[0], v[1], v[2], m[2], m[5], m[8]);
+		out.e[3] = combineRow(v[3], v[4], v[5], m[0], m[3], m[6]);
+		out.e[4] = combineRow(v[3], v[4], v[5], m[1], m[4], m[7]);
+		out.e[5] = combineRow(v[3], v[4], v[5], m[2], m[5], m[8]);
+		out.e[6] = combineRow(v[6], v[7], v[8], m[0], m[3], m[6]);
+		out.e[7] = combineRow(v[6], v[7], v[8], m[1], m[4], m[7]);
+		out.e[8] = combineRow(v[6], v[7], v[8], m[2], m[5], m[8]);
+		out.e[9] = _mm_add_ps(combineRow(v[9], v[10], v[11], m[0], m[3], m[6]), m[9]);
+		out.e[10] = _mm_add_ps(combineRow(v[9], v[10], v[11], m[1], m[4], m[7]), m[10]);
+		out.e[11] = _mm_add_ps(combineRow(v[9], v[10], v[11], m[2], m[5], m[8]), m[11]);
+	}
+#endif
+
+	void FrameHierarchy::evaluate(const geom::Transform* locals, const geom::Transform* roots, size_t instanceCount,
+								  geom::Transform* out) const {
+		const uint32_t count = frameCount();
+		size_t first = 0;
+#ifdef __SSE2__
+		std::vector<TransformLanes> world(count);
+		const geom::Transform* sources[4];
+		geom::Transform* targets[4];
+		for (; first + 4 <= instanceCount; first += 4) {
+			TransformLanes local, root;
+			if (roots) {
+				for (int lane = 0; lane < 4; lane++) sources[lane] = roots + first + lane;
+				loadLanes(sources, root);
+			}
+			for (uint32_t p = 0; p < count; p++) {
+				uint32_t frame = order[p];
+				for (int lane = 0; lane < 4; lane++) {
+					size_t base = (first + lane) * count + frame;
+					sources[lane] = locals + base;
+					targets[lane] = out + base;
+				}
+				loadLanes(sources, local);
+				if (parents[p] != NONE) {
+					combineLanes(local, world[parents[p]], world[p]);
+				} else if (roots) {
+					combineLanes(local, root, world[p]);
+				} else {
+					world[p] = local;
+				}
+				storeLanes(world[p], targets);
+			}
+		}
+#endif
+		for (size_t instance = first; instance < instanceCount; instance++) {
+			const geom::Transform* local = locals + instance * count;
+			geom::Transform* result = out + instance * count;
+			for (uint32_t p = 0; p < count; p++) {
+				uint32_t frame = order[p];
+				if (parents[p] != NONE) {
+					result[frame] = geom::combineTransforms(local[frame], result[order[parents[p]]]);
+				} else if (roots) {
+					result[frame] = geom::combineTransforms(local[frame], roots[instance]);
+				} else {
+					result[frame] = local[frame];
+				}
+			}
+		}
+	}
+
+	void getLocalTransforms(FrameListChunk* frameList, std::vector<geom::Transform>& out) {
+		out.clear();
+		for (auto& frame : frameList->frames) {
+			geom::Transform local = {frame.rotation, frame.translation};
+			out.push_back(local);
+		}
+	}
+
+	bool computeFrameTransforms(FrameListChunk* frameList, std::vector<geom::Transform>& out) {
+		out.clear();
+		FrameHierarchy hierarchy;
+		if (!hierarchy.build(frameList)) return false;
+
+		std::vector<geom::Transform> locals;
+		getLocalTransforms(frameList, locals);
+		out.resize(locals.size());
+		hierarchy.evaluate(locals.data(), nullptr, 1, out.data());
+		return true;
+	}
+}
\ No newline at end of file
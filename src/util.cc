@@ -10,7 +10,16 @@
 #include <cstdio>
 #include <cstring>
 #include <cstdlib>
+#include <algorithm>
 #include <exception>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 namespace rw {
 	namespace util {
@@ -96,9 +105,254 @@ namespace rw {
 				return false;
 			}
 
+			fclose(f);
 			return true;
 		}
 
+		void parallelFor(size_t count, unsigned threads, size_t minRange,
+						 const std::function<void(size_t begin, size_t end)>& fn) {
+			if (!threads) threads = std::thread::hardware_concurrency();
+			if (!threads) threads = 1;
+			if (!minRange) minRange = 1;
+			size_t ranges = std::min<size_t>(threads, (count + minRange - 1) / minRange);
+			if (ranges <= 1) {
+				if (count) fn(0, count);
+				return;
+			}
+
+			// the caller takes the first range
+			std::vector<std::thread> workers;
+			for (size_t i = 1; i < ranges; i++) {
+				workers.emplace_back(fn, count * i / ranges, count * (i + 1) / ranges);
+			}
+			fn(0, count / ranges);
+			for (auto& worker : workers) {
+				worker.join();
+			}
+		}
+
+		FileDumpSink::FileDumpSink(FILE* file, size_t blockSize) : file(file), used(0), capacity(blockSize) {
+			block = (char*) malloc(capacity);
+		}
+
+		FileDumpSink::~FileDumpSink() {
+			flush();
+			free(block);
+		}
+
+		void FileDumpSink::write(const char* text, size_t len) {
+			if (used + len > capacity) {
+				flush();
+				if (len > capacity) {
+					// too big to be worth buffering
+					fwrite(text, 1, len, file);
+					return;
+				}
+			}
+			memcpy(block + used, text, len);
+			used += len;
+		}
+
+		void FileDumpSink::flush() {
+			if (used) {
+				fwrite(block, 1, used, file);
+				used = 0;
+			}
+			fflush(file);
+		}
+
+		/// Text is published to the writer thread in blocks of about this size
+		static const size_t DUMP_PUBLISH_BYTES = 64 << 10;
+		/// Past this much published but unwritten text, sections are dumped inline instead of queued
+		/// and writers wait for the sink to catch up
+		static const size_t DUMP_MAX_BUFFERED = 32 << 20;
+
+		/// Output of one writer or spawned section, as text blocks and child sections in order
+		struct DumpSegment {
+			struct Item {
+				std::string text;
+				DumpSegment* child;
+			};
+			std::deque<Item> items; // published, guarded by the scheduler's mutex
+			std::string pending; // not yet published, only touched by the producing thread
+			bool done;
+
+			DumpSegment() : done(false) {}
+
+			~DumpSegment() {
+				for (auto& item : items) {
+					delete item.child;
+				}
+			}
+		};
+
+		struct DumpScheduler::Impl {
+			struct Task {
+				DumpSegment* segment;
+				int indent;
+				bool verbose;
+				std::function<void(DumpWriter&)> fn;
+			};
+
+			std::vector<std::thread> workers;
+			std::thread writer;
+			std::deque<Task> queue;
+			std::deque<std::pair<DumpSegment*, DumpSink*>> roots; // not yet fully written
+			size_t buffered; // bytes published and not yet written
+			std::mutex mutex;
+			std::condition_variable taskReady;
+			std::condition_variable published; // wakes the writer thread
+			std::condition_variable drained; // a root has been written out
+			std::condition_variable writable; // text has been written, or the writer thread is stalled
+			bool stalled; // the writer thread is waiting for text which is not yet published
+			bool stopping;
+
+			/// Moves a segment's pending text into its items (mutex must be held)
+			void publish(DumpSegment* segment) {
+				if (segment->pending.empty()) return;
+				buffered += segment->pending.size();
+				segment->items.push_back({std::move(segment->pending), nullptr});
+				segment->pending.clear();
+			}
+
+			/// Writes each root in turn, following child sections depth first with an explicit
+			/// stack. Text is written as soon as everything before it is, then freed.
+			void writeRoots() {
+				std::unique_lock<std::mutex> lock(mutex);
+				std::vector<DumpSegment*> stack;
+				while (true) {
+					published.wait(lock, [this]() { return stopping || !roots.empty(); });
+					if (roots.empty()) return;
+					DumpSegment* root = roots.front().first;
+					DumpSink* sink = roots.front().second;
+
+					stack.assign(1, root);
+					while (!stack.empty()) {
+						DumpSegment* segment = stack.back();
+						if (segment->items.empty()) {
+							if (!segment->done) {
+								// producers held back by the sink must go on, as one may owe this text
+								stalled = true;
+								writable.notify_all();
+								published.wait(lock);
+								stalled = false;
+								continue;
+							}
+							stack.pop_back();
+							if (segment != root) delete segment;
+							continue;
+						}
+
+						DumpSegment::Item item = std::move(segment->items.front());
+						segment->items.pop_front();
+						if (item.child) {
+							stack.push_back(item.child);
+						} else {
+							lock.unlock();
+							sink->write(item.text.data(), item.text.size());
+							lock.lock();
+							buffered -= item.text.size();
+							writable.notify_all();
+						}
+					}
+
+					lock.unlock();
+					sink->flush();
+					delete root;
+					lock.lock();
+					roots.pop_front();
+					drained.notify_all();
+				}
+			}
+		};
+
+		DumpScheduler::DumpScheduler(unsigned threads) : impl(new Impl) {
+			if (!threads) threads = std::thread::hardware_concurrency();
+			if (!threads) threads = 1;
+			impl->buffered = 0;
+			impl->stalled = false;
+			impl->stopping = false;
+
+			for (unsigned i = 0; i < threads; i++) {
+				impl->workers.emplace_back([this]() {
+					Impl& self = *impl;
+					std::unique_lock<std::mutex> lock(self.mutex);
+					while (true) {
+						self.taskReady.wait(lock, [&self]() { return self.stopping || !self.queue.empty(); });
+						if (self.queue.empty()) return;
+
+						Impl::Task task = std::move(self.queue.front());
+						self.queue.pop_front();
+						lock.unlock();
+
+						DumpWriter out(nullptr, task.verbose, this);
+						out.indent = task.indent;
+						out.segment = task.segment;
+						task.fn(out);
+
+						lock.lock();
+						self.publish(task.segment);
+						task.segment->done = true;
+						self.published.notify_all();
+					}
+				});
+			}
+			impl->writer = std::thread([this]() { impl->writeRoots(); });
+		}
+
+		DumpScheduler::~DumpScheduler() {
+			finish();
+			{
+				std::lock_guard<std::mutex> lock(impl->mutex);
+				impl->stopping = true;
+			}
+			impl->taskReady.notify_all();
+			impl->published.notify_all();
+			for (auto& worker : impl->workers) {
+				worker.join();
+			}
+			impl->writer.join();
+			delete impl;
+		}
+
+		DumpSegment* DumpScheduler::addRoot(DumpSink* sink) {
+			DumpSegment* root = new DumpSegment();
+			std::lock_guard<std::mutex> lock(impl->mutex);
+			impl->roots.emplace_back(root, sink);
+			impl->published.notify_all();
+			return root;
+		}
+
+		void DumpScheduler::publish(DumpSegment* segment) {
+			std::unique_lock<std::mutex> lock(impl->mutex);
+			impl->publish(segment);
+			impl->published.notify_all();
+			impl->writable.wait(lock, [this]() { return impl->buffered <= DUMP_MAX_BUFFERED || impl->stalled; });
+		}
+
+		bool DumpScheduler::submit(DumpSegment* segment, DumpSegment* child, const DumpWriter& writer,
+								   const std::function<void(DumpWriter&)>& fn) {
+			std::lock_guard<std::mutex> lock(impl->mutex);
+			// past a few tasks per worker, or while the sink lags behind, running inline is better
+			if (impl->queue.size() >= impl->workers.size() * 4 || impl->buffered > DUMP_MAX_BUFFERED) return false;
+			impl->publish(segment);
+			segment->items.push_back({std::string(), child});
+			impl->queue.push_back({child, writer.indent, writer.verbose, fn});
+			impl->taskReady.notify_one();
+			impl->published.notify_all();
+			return true;
+		}
+
+		void DumpScheduler::finish() {
+			std::unique_lock<std::mutex> lock(impl->mutex);
+			for (auto& root : impl->roots) {
+				impl->publish(root.first);
+				root.first->done = true;
+			}
+			impl->published.notify_all();
+			impl->drained.wait(lock, [this]() { return impl->roots.empty(); });
+		}
+
 		static void dumpWriterDefaultCallback(const char* text) {
 			printf("%s\n", text);
 		}
@@ -107,58 +361,359 @@ namespace rw {
 
 		DumpWriter::DumpWriter(const DumpWriter& parent) {
 			fnPrintCallback = parent.fnPrintCallback;
+			sink = parent.sink;
+			segment = parent.segment;
+			scheduler = parent.scheduler;
 			indent = parent.indent + 1;
 			verbose = parent.verbose;
 		}
 
 		DumpWriter::DumpWriter(void (* fnPrint)(const char*), bool _verbose) {
 			fnPrintCallback = fnPrint;
+			sink = nullptr;
+			segment = nullptr;
+			scheduler = nullptr;
 			indent = 0;
 			verbose = _verbose;
 		}
 
+		DumpWriter::DumpWriter(DumpSink* _sink, bool _verbose, DumpScheduler* _scheduler) {
+			fnPrintCallback = nullptr;
+			sink = _sink;
+			scheduler = _scheduler;
+			segment = (scheduler && sink) ? scheduler->addRoot(sink) : nullptr;
+			indent = 0;
+			verbose = _verbose;
+		}
+
+		void DumpWriter::emit(char* line, size_t len) {
+			if (segment) {
+				segment->pending.append(line, len);
+				if (segment->pending.size() >= DUMP_PUBLISH_BYTES) scheduler->publish(segment);
+			} else if (sink) {
+				sink->write(line, len);
+			} else {
+				line[len - 1] = '\0';
+				fnPrintCallback(line);
+			}
+		}
+
 		const void DumpWriter::print(const char* format, ...) {
 			char buffer[512];
-			// write indent
-			char* p = buffer;
-			for (int i = 0; i < indent; i++) {
-				*p++ = ' ';
-				*p++ = ' ';
-			}
+			size_t prefix = (size_t) indent * 2;
+			if (prefix > sizeof(buffer) - 2) prefix = sizeof(buffer) - 2;
+			memset(buffer, ' ', prefix);
+
 			// write formatted string
-			va_list args;
+			va_list args, argsRetry;
 			va_start(args, format);
-			vsnprintf(p, 512 - indent * 2, format, args);
+			va_copy(argsRetry, args);
+			size_t room = sizeof(buffer) - prefix - 1;
+			int written = vsnprintf(buffer + prefix, room, format, args);
 			va_end(args);
-			fnPrintCallback(buffer);
+			if (written < 0) written = 0;
+
+			if ((size_t) written < room) {
+				buffer[prefix + written] = '\n';
+				emit(buffer, prefix + written + 1);
+			} else {
+				// too long for the stack buffer (deep indent or long line), format again on the heap
+				std::vector<char> line(prefix + written + 2);
+				memset(line.data(), ' ', prefix);
+				vsnprintf(line.data() + prefix, (size_t) written + 1, format, argsRetry);
+				line[prefix + written] = '\n';
+				emit(line.data(), prefix + written + 1);
+			}
+			va_end(argsRetry);
+		}
+
+		void DumpWriter::printLine(const char* text, size_t len) {
+			size_t prefix = (size_t) indent * 2;
+			char buffer[512];
+			std::vector<char> heap;
+			char* line = buffer;
+			if (prefix + len + 2 > sizeof(buffer)) {
+				heap.resize(prefix + len + 2);
+				line = heap.data();
+			}
+			memset(line, ' ', prefix);
+			memcpy(line + prefix, text, len);
+			line[prefix + len] = '\n';
+			emit(line, prefix + len + 1);
+		}
+
+		void DumpWriter::spawn(const std::function<void(DumpWriter&)>& fn) {
+			if (segment) {
+				DumpSegment* child = new DumpSegment();
+				if (scheduler->submit(segment, child, *this, fn)) return;
+				delete child;
+			}
+			fn(*this);
 		}
 
 		bool DumpWriter::isVerbose() {
 			return verbose;
 		}
 
+		static const char hexChars[] = "0123456789abcdef";
+
+		/// Formats one 16 byte row as "xxxxxxxx xxxxxxxx xxxxxxxx xxxxxxxx  aaaaaaaaaaaaaaaa"
+		static void formatHexRow(const uint8_t* row, char* out) {
+#ifdef __SSE2__
+			__m128i bytes = _mm_loadu_si128((const __m128i*) row);
+			__m128i nibbleMask = _mm_set1_epi8(0x0f);
+			__m128i hi = _mm_and_si128(_mm_srli_epi16(bytes, 4), nibbleMask);
+			__m128i lo = _mm_and_si128(bytes, nibbleMask);
+
+			// nibble to ascii: '0' + n, plus ('a' - '9' - 1) where n > 9
+			__m128i zero = _mm_set1_epi8('0');
+			__m128i nine = _mm_set1_epi8(9);
+			__m128i letterGap = _mm_set1_epi8('a' - '9' - 1);
+			hi = _mm_add_epi8(_mm_add_epi8(hi, zero), _mm_and_si128(_mm_cmpgt_epi8(hi, nine), letterGap));
+			lo = _mm_add_epi8(_mm_add_epi8(lo, zero), _mm_and_si128(_mm_cmpgt_epi8(lo, nine), letterGap));
+
+			char hex[32];
+			_mm_storeu_si128((__m128i*) hex, _mm_unpacklo_epi8(hi, lo));
+			_mm_storeu_si128((__m128i*) (hex + 16), _mm_unpackhi_epi8(hi, lo));
+
+			// printable is 0x20 to 0x7e; bytes >= 0x80 compare as negative so fail the first test
+			__m128i printable = _mm_and_si128(_mm_cmpgt_epi8(bytes, _mm_set1_epi8(0x1f)),
+											  _mm_cmplt_epi8(bytes, _mm_set1_epi8(0x7f)));
+			__m128i ascii = _mm_or_si128(_mm_and_si128(printable, bytes),
+										 _mm_andnot_si128(printable, _mm_set1_epi8('.')));
+			_mm_storeu_si128((__m128i*) (out + 37), ascii);
+#else
+			char hex[32];
+			for (int i = 0; i < 16; i++) {
+				hex[i * 2] = hexChars[row[i] >> 4];
+				hex[i * 2 + 1] = hexChars[row[i] & 0x0f];
+				out[37 + i] = (row[i] >= 0x20 && row[i] < 0x7f) ? (char) row[i] : '.';
+			}
+#endif
+			for (int group = 0; group < 4; group++) {
+				memcpy(out + group * 9, hex + group * 8, 8);
+				out[group * 9 + 8] = ' ';
+			}
+			out[35] = ' ';
+			out[36] = ' ';
+		}
+
 		void dumpBuffer(Buffer& buf, DumpWriter out) {
 			auto start = (uint8_t*) buf.base_ptr();
-			auto p = start;
-			auto end = start + buf.size();
-			char hex_row[] = "........ ........ ........ ........";
-			static const char hex_char[] = "0123456789abcdef";
-			char ascii_row[] = "................";
-			while (p < end) {
-				auto local_offs = p - start;
-				auto char_offs = 0;
-				for (int i = 0; i < 16; i++) {
-					uint8_t value = uint8_t(p < end ? *p : 0);
-					hex_row[char_offs] = hex_char[value >> 4];
-					hex_row[char_offs + 1] = hex_char[value & 0x0f];
-					char_offs += (i % 4 == 3 ? 3 : 2);
-					ascii_row[i] = isprint(value) ? value : '.';
-					p++;
+			size_t size = buf.size();
+			// "[0x00000000] " + hex and ascii columns
+			char line[13 + 53];
+			memcpy(line, "[0x00000000] ", 13);
+			for (size_t offs = 0; offs < size; offs += 16) {
+				for (int i = 0; i < 8; i++) {
+					line[3 + i] = hexChars[(offs >> (28 - i * 4)) & 0x0f];
+				}
+				if (size - offs >= 16) {
+					formatHexRow(start + offs, line + 13);
+				} else {
+					// pad final row with zeroes
+					uint8_t row[16] = {0};
+					memcpy(row, start + offs, size - offs);
+					formatHexRow(row, line + 13);
 				}
-				out.print("[0x%08x] %s  %s", local_offs, hex_row, ascii_row);
+				out.printLine(line, sizeof(line));
 			}
 		}
 
+		JsonWriter::JsonWriter(DumpSink* sink, BlobMode blobMode) : sink(sink), blobMode(blobMode), afterKey(false) {}
+
+		JsonWriter::BlobMode JsonWriter::getBlobMode() {
+			return blobMode;
+		}
+
+		void JsonWriter::separate() {
+			if (afterKey) {
+				// value belongs to the key just written
+				afterKey = false;
+				return;
+			}
+			if (firstStack.empty()) return;
+			if (firstStack.back()) {
+				firstStack.back() = false;
+			} else {
+				sink->write(",", 1);
+			}
+		}
+
+		void JsonWriter::writeString(const char* str, size_t len) {
+			char buffer[256];
+			size_t used = 0;
+			buffer[used++] = '"';
+			for (size_t i = 0; i < len; i++) {
+				// leave room for the longest escape plus closing quote
+				if (used > sizeof(buffer) - 8) {
+					sink->write(buffer, used);
+					used = 0;
+				}
+				uint8_t c = (uint8_t) str[i];
+				if (c == '"' || c == '\\') {
+					buffer[used++] = '\\';
+					buffer[used++] = (char) c;
+				} else if (c < 0x20) {
+					used += snprintf(buffer + used, 7, "\\u%04x", c);
+				} else {
+					buffer[used++] = (char) c;
+				}
+			}
+			buffer[used++] = '"';
+			sink->write(buffer, used);
+		}
+
+		void JsonWriter::beginObject() {
+			separate();
+			sink->write("{", 1);
+			firstStack.push_back(true);
+		}
+
+		void JsonWriter::beginObject(const char* name) {
+			key(name);
+			separate();
+			sink->write("{", 1);
+			firstStack.push_back(true);
+		}
+
+		void JsonWriter::endObject() {
+			firstStack.pop_back();
+			sink->write("}", 1);
+		}
+
+		void JsonWriter::beginArray() {
+			separate();
+			sink->write("[", 1);
+			firstStack.push_back(true);
+		}
+
+		void JsonWriter::beginArray(const char* name) {
+			key(name);
+			separate();
+			sink->write("[", 1);
+			firstStack.push_back(true);
+		}
+
+		void JsonWriter::endArray() {
+			firstStack.pop_back();
+			sink->write("]", 1);
+		}
+
+		void JsonWriter::key(const char* name) {
+			separate();
+			writeString(name, strlen(name));
+			sink->write(":", 1);
+			afterKey = true;
+		}
+
+		void JsonWriter::value(int32_t v) {
+			char buffer[16];
+			separate();
+			sink->write(buffer, (size_t) snprintf(buffer, sizeof(buffer), "%d", v));
+		}
+
+		void JsonWriter::value(uint32_t v) {
+			char buffer[16];
+			separate();
+			sink->write(buffer, (size_t) snprintf(buffer, sizeof(buffer), "%u", v));
+		}
+
+		void JsonWriter::value(uint64_t v) {
+			char buffer[24];
+			separate();
+			sink->write(buffer, (size_t) snprintf(buffer, sizeof(buffer), "%llu", (unsigned long long) v));
+		}
+
+		void JsonWriter::value(double v) {
+			if (v != v || v - v != 0) {
+				// NaN and infinities have no JSON representation
+				null();
+				return;
+			}
+			char buffer[32];
+			separate();
+			sink->write(buffer, (size_t) snprintf(buffer, sizeof(buffer), "%.9g", v));
+		}
+
+		void JsonWriter::value(bool v) {
+			separate();
+			if (v) sink->write("true", 4);
+			else sink->write("false", 5);
+		}
+
+		void JsonWriter::value(const char* v) {
+			separate();
+			writeString(v, strlen(v));
+		}
+
+		void JsonWriter::value(const std::string& v) {
+			separate();
+			writeString(v.data(), v.size());
+		}
+
+		void JsonWriter::null() {
+			separate();
+			sink->write("null", 4);
+		}
+
+		void JsonWriter::blob(const char* name, Buffer& body, uint32_t bodyOffset, uint32_t start, uint32_t size) {
+			if (start > body.size() || size > body.size() - start) {
+				logger.warn("JSON blob %s out of bounds", name);
+				size = start > body.size() ? 0 : body.size() - start;
+			}
+
+			if (blobMode == BLOB_REFERENCE) {
+				beginObject(name);
+				field("offset", bodyOffset + start);
+				field("size", size);
+				endObject();
+				return;
+			}
+
+			static const char table[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+			key(name);
+			separate();
+			auto p = (const uint8_t*) body.base_ptr() + start;
+			auto end = p + size;
+			char buffer[4096];
+			size_t used = 0;
+			buffer[used++] = '"';
+			while (end - p >= 3) {
+				if (used > sizeof(buffer) - 4) {
+					sink->write(buffer, used);
+					used = 0;
+				}
+				uint32_t triple = (uint32_t) p[0] << 16 | (uint32_t) p[1] << 8 | p[2];
+				buffer[used++] = table[triple >> 18];
+				buffer[used++] = table[(triple >> 12) & 0x3f];
+				buffer[used++] = table[(triple >> 6) & 0x3f];
+				buffer[used++] = table[triple & 0x3f];
+				p += 3;
+			}
+			if (used > sizeof(buffer) - 5) {
+				sink->write(buffer, used);
+				used = 0;
+			}
+			if (end - p == 1) {
+				buffer[used++] = table[p[0] >> 2];
+				buffer[used++] = table[(p[0] & 0x03) << 4];
+				buffer[used++] = '=';
+				buffer[used++] = '=';
+			} else if (end - p == 2) {
+				buffer[used++] = table[p[0] >> 2];
+				buffer[used++] = table[(p[0] & 0x03) << 4 | p[1] >> 4];
+				buffer[used++] = table[(p[1] & 0x0f) << 2];
+				buffer[used++] = '=';
+			}
+			buffer[used++] = '"';
+			sink->write(buffer, used);
+		}
+
+		void JsonWriter::endLine() {
+			sink->write("\n", 1);
+		}
+
 		// next 3 functions from https://www.gtamodding.com/wiki/RenderWare
 
 		uint32_t unpackVersionNumber(uint32_t packedVersion) {
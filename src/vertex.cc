@@ -0,0 +1,473 @@
+/*
+ * File: vertex.cc
+ * Author: DeadlyFugu
+ * License: zlib
+ * Description: Builds interleaved GPU vertex and index buffers from geometry data
+ */
+
+#include "vertex.hh"
+#include "quantize.hh"
+
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace rw {
+	namespace vertex {
+		uint32_t formatSize(Format format) {
+			switch (format) {
+				case FORMAT_FLOAT2: return 8;
+				case FORMAT_FLOAT3: return 12;
+				case FORMAT_FLOAT4: return 16;
+				case FORMAT_HALF2: return 4;
+				case FORMAT_HALF4: return 8;
+				case FORMAT_SNORM16x4: return 8;
+				case FORMAT_UNORM16x2: return 4;
+				case FORMAT_UNORM8x4: return 4;
+				case FORMAT_OCT16x2: return 4;
+			}
+			return 0;
+		}
+
+		uint32_t formatComponents(Format format) {
+			switch (format) {
+				case FORMAT_FLOAT2: return 2;
+				case FORMAT_FLOAT3: return 3;
+				case FORMAT_FLOAT4: return 4;
+				case FORMAT_HALF2: return 2;
+				case FORMAT_HALF4: return 4;
+				case FORMAT_SNORM16x4: return 4;
+				case FORMAT_UNORM16x2: return 2;
+				case FORMAT_UNORM8x4: return 4;
+				case FORMAT_OCT16x2: return 2;
+			}
+			return 0;
+		}
+
+		Layout& Layout::add(Attribute attribute, Format format, uint32_t layer) {
+			uint32_t offset = 0;
+			for (auto& element : elements) {
+				offset = std::max(offset, element.offset + formatSize(element.format));
+			}
+			return add(attribute, format, layer, (offset + 3) & ~3u);
+		}
+
+		Layout& Layout::add(Attribute attribute, Format format, uint32_t layer, uint32_t offset) {
+			Element element = {attribute, format, layer, offset};
+			elements.push_back(element);
+			stride = std::max(stride, offset + formatSize(format));
+			return *this;
+		}
+
+		Layout& Layout::align(uint32_t alignment) {
+			stride = (stride + alignment - 1) / alignment * alignment;
+			return *this;
+		}
+
+		bool Layout::validate() const {
+			for (size_t i = 0; i < elements.size(); i++) {
+				auto& a = elements[i];
+				if (a.offset + formatSize(a.format) > stride) {
+					util::logger.warn("Vertex element at offset %d exceeds stride %d", a.offset, stride);
+					return false;
+				}
+				for (size_t j = 0; j < i; j++) {
+					auto& b = elements[j];
+					if (a.offset < b.offset + formatSize(b.format) && b.offset < a.offset + formatSize(a.format)) {
+						util::logger.warn("Vertex elements at offsets %d and %d overlap", b.offset, a.offset);
+						return false;
+					}
+				}
+			}
+			return true;
+		}
+
+		// Conversion kernels
+
+		static inline uint32_t floatBits(float value) {
+			uint32_t bits;
+			memcpy(&bits, &value, sizeof(bits));
+			return bits;
+		}
+
+		static inline float bitsFloat(uint32_t bits) {
+			float value;
+			memcpy(&value, &bits, sizeof(value));
+			return value;
+		}
+
+		static inline uint16_t floatToHalf(float value) {
+			uint32_t f = floatBits(value);
+			uint32_t sign = f & 0x80000000u;
+			f ^= sign;
+
+			uint32_t half;
+			if (f >= 0x47800000u) {
+				// overflow to infinity, or NaN
+				half = f > 0x7f800000u ? 0x7e00 : 0x7c00;
+			} else if (f < 0x38800000u) {
+				// subnormal or zero, let the FPU round by adding 0.5
+				half = floatBits(bitsFloat(f) + 0.5f) - 0x3f000000u;
+			} else {
+				// rebias exponent and round mantissa to nearest even
+				uint32_t mantissaOdd = (f >> 13) & 1;
+				f += 0xc8000fffu + mantissaOdd;
+				half = f >> 13;
+			}
+			return (uint16_t) (half | (sign >> 16));
+		}
+
+#ifdef __SSE2__
+		/// Same rounding as floatToHalf, four lanes at a time. Results are sign-extended so they
+		/// can be packed with _mm_packs_epi32.
+		static inline __m128i floatToHalf4(__m128 value) {
+			const __m128i f16Max = _mm_set1_epi32(0x47800000);
+			const __m128i minNormal = _mm_set1_epi32(0x38800000);
+			const __m128i subnormalMagic = _mm_set1_epi32(0x3f000000);
+			const __m128i normalBias = _mm_set1_epi32((int) 0xc8000fffu);
+
+			__m128 sign = _mm_and_ps(value, _mm_set1_ps(-0.0f));
+			__m128 absolute = _mm_xor_ps(value, sign);
+			__m128i bits = _mm_castps_si128(absolute);
+
+			__m128i isRegular = _mm_cmpgt_epi32(f16Max, bits);
+			__m128i isNan = _mm_castps_si128(_mm_cmpunord_ps(absolute, absolute));
+			__m128i special = _mm_or_si128(_mm_and_si128(isNan, _mm_set1_epi32(0x200)), _mm_set1_epi32(0x7c00));
+
+			__m128i isSubnormal = _mm_cmpgt_epi32(minNormal, bits);
+			__m128 subnormalSum = _mm_add_ps(absolute, _mm_castsi128_ps(subnormalMagic));
+			__m128i subnormal = _mm_sub_epi32(_mm_castps_si128(subnormalSum), subnormalMagic);
+
+			__m128i mantissaOdd = _mm_srai_epi32(_mm_slli_epi32(bits, 18), 31);
+			__m128i normal = _mm_srli_epi32(_mm_sub_epi32(_mm_add_epi32(bits, normalBias), mantissaOdd), 13);
+
+			__m128i finite = _mm_or_si128(_mm_and_si128(isSubnormal, subnormal), _mm_andnot_si128(isSubnormal, normal));
+			__m128i result = _mm_or_si128(_mm_and_si128(isRegular, finite), _mm_andnot_si128(isRegular, special));
+			return _mm_or_si128(result, _mm_srai_epi32(_mm_castps_si128(sign), 16));
+		}
+
+		/// Packs eight 32-bit lanes holding values in [0, 65535] into unsigned 16-bit lanes
+		static inline __m128i packUnsigned16(__m128i a, __m128i b) {
+			const __m128i bias = _mm_set1_epi32(0x8000);
+			__m128i packed = _mm_packs_epi32(_mm_sub_epi32(a, bias), _mm_sub_epi32(b, bias));
+			return _mm_xor_si128(packed, _mm_set1_epi16((short) 0x8000));
+		}
+#endif
+
+		void encodeHalf(const float* in, uint16_t* out, size_t count) {
+			size_t i = 0;
+#ifdef __SSE2__
+			for (; i + 8 <= count; i += 8) {
+				__m128i lo = floatToHalf4(_mm_loadu_ps(in + i));
+				__m128i hi = floatToHalf4(_mm_loadu_ps(in + i + 4));
+				_mm_storeu_si128((__m128i*) (out + i), _mm_packs_epi32(lo, hi));
+			}
+#endif
+			for (; i < count; i++) {
+				out[i] = floatToHalf(in[i]);
+			}
+		}
+
+		void encodeSnorm16(const float* in, int16_t* out, size_t count) {
+			size_t i = 0;
+#ifdef __SSE2__
+			const __m128 one = _mm_set1_ps(1.0f);
+			const __m128 minusOne = _mm_set1_ps(-1.0f);
+			const __m128 scale = _mm_set1_ps(32767.0f);
+			for (; i + 8 <= count; i += 8) {
+				__m128 a = _mm_max_ps(_mm_min_ps(_mm_loadu_ps(in + i), one), minusOne);
+				__m128 b = _mm_max_ps(_mm_min_ps(_mm_loadu_ps(in + i + 4), one), minusOne);
+				__m128i ia = _mm_cvtps_epi32(_mm_mul_ps(a, scale));
+				__m128i ib = _mm_cvtps_epi32(_mm_mul_ps(b, scale));
+				_mm_storeu_si128((__m128i*) (out + i), _mm_packs_epi32(ia, ib));
+			}
+#endif
+			for (; i < count; i++) {
+				float value = std::min(std::max(in[i], -1.0f), 1.0f);
+				out[i] = (int16_t) std::lrint(value * 32767.0f);
+			}
+		}
+
+		void encodeUnorm16(const float* in, uint16_t* out, size_t count) {
+			size_t i = 0;
+#ifdef __SSE2__
+			const __m128 one = _mm_set1_ps(1.0f);
+			const __m128 zero = _mm_setzero_ps();
+			const __m128 scale = _mm_set1_ps(65535.0f);
+			for (; i + 8 <= count; i += 8) {
+				__m128 a = _mm_max_ps(_mm_min_ps(_mm_loadu_ps(in + i), one), zero);
+				__m128 b = _mm_max_ps(_mm_min_ps(_mm_loadu_ps(in + i + 4), one), zero);
+				__m128i ia = _mm_cvtps_epi32(_mm_mul_ps(a, scale));
+				__m128i ib = _mm_cvtps_epi32(_mm_mul_ps(b, scale));
+				_mm_storeu_si128((__m128i*) (out + i), packUnsigned16(ia, ib));
+			}
+#endif
+			for (; i < count; i++) {
+				float value = std::min(std::max(in[i], 0.0f), 1.0f);
+				out[i] = (uint16_t) std::lrint(value * 65535.0f);
+			}
+		}
+
+		void encodeUnorm8(const float* in, uint8_t* out, size_t count) {
+			size_t i = 0;
+#ifdef __SSE2__
+			const __m128 one = _mm_set1_ps(1.0f);
+			const __m128 zero = _mm_setzero_ps();
+			const __m128 scale = _mm_set1_ps(255.0f);
+			for (; i + 16 <= count; i += 16) {
+				__m128i lanes[4];
+				for (int j = 0; j < 4; j++) {
+					__m128 value = _mm_max_ps(_mm_min_ps(_mm_loadu_ps(in + i + j * 4), one), zero);
+					lanes[j] = _mm_cvtps_epi32(_mm_mul_ps(value, scale));
+				}
+				__m128i lo = _mm_packs_epi32(lanes[0], lanes[1]);
+				__m128i hi = _mm_packs_epi32(lanes[2], lanes[3]);
+				_mm_storeu_si128((__m128i*) (out + i), _mm_packus_epi16(lo, hi));
+			}
+#endif
+			for (; i < count; i++) {
+				float value = std::min(std::max(in[i], 0.0f), 1.0f);
+				out[i] = (uint8_t) std::lrint(value * 255.0f);
+			}
+		}
+
+		// Vertex interleaving
+
+		/// Vertices converted per pass, sized so the staging arrays stay in L1
+		static const uint32_t BLOCK_SIZE = 256;
+
+		/// Copies count vertices of one attribute into out as floats with the given number of
+		/// components, padding missing components (or a missing stream) with defaults
+		static void gatherAttribute(const geom::MeshView& mesh, const Element& element,
+									uint32_t first, uint32_t count, uint32_t components, float* out) {
+			const float* source = nullptr;
+			uint32_t sourceComponents = 0;
+			float defaults[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+
+			switch (element.attribute) {
+				case ATTRIB_POSITION:
+					source = (const float*) mesh.positions;
+					sourceComponents = 3;
+					defaults[3] = 1.0f;
+					break;
+				case ATTRIB_NORMAL:
+					source = (const float*) mesh.normals;
+					sourceComponents = 3;
+					if (!source) defaults[2] = 1.0f;
+					break;
+				case ATTRIB_COLOR:
+					if (mesh.colors) {
+						auto colors = mesh.colors + first;
+						for (uint32_t i = 0; i < count; i++) {
+							float rgba[4] = {colors[i].r / 255.0f, colors[i].g / 255.0f,
+											 colors[i].b / 255.0f, colors[i].a / 255.0f};
+							memcpy(out + i * components, rgba, components * sizeof(float));
+						}
+						return;
+					}
+					std::fill(defaults, defaults + 4, 1.0f);
+					break;
+				case ATTRIB_TEXCOORD:
+					if (element.layer < mesh.uvLayers.size()) {
+						source = (const float*) mesh.uvLayers[element.layer];
+					}
+					sourceComponents = 2;
+					break;
+			}
+
+			if (!source) {
+				for (uint32_t i = 0; i < count; i++) {
+					memcpy(out + i * components, defaults, components * sizeof(float));
+				}
+			} else if (sourceComponents == components) {
+				memcpy(out, source + first * components, count * components * sizeof(float));
+			} else {
+				source += first * sourceComponents;
+				uint32_t copied = std::min(sourceComponents, components);
+				for (uint32_t i = 0; i < count; i++) {
+					float* vertex = out + i * components;
+					memcpy(vertex, source + i * sourceComponents, copied * sizeof(float));
+					for (uint32_t c = copied; c < components; c++) {
+						vertex[c] = defaults[c];
+					}
+				}
+			}
+		}
+
+		/// Writes count packed values of the given size to every stride bytes of out
+		static void scatter(const uint8_t* packed, uint32_t size, uint32_t count, uint8_t* out, uint32_t stride) {
+			// fixed size copies let the compiler emit plain moves
+			switch (size) {
+				case 4:
+					for (uint32_t i = 0; i < count; i++) memcpy(out + i * stride, packed + i * 4, 4);
+					break;
+				case 8:
+					for (uint32_t i = 0; i < count; i++) memcpy(out + i * stride, packed + i * 8, 8);
+					break;
+				case 12:
+					for (uint32_t i = 0; i < count; i++) memcpy(out + i * stride, packed + i * 12, 12);
+					break;
+				case 16:
+					for (uint32_t i = 0; i < count; i++) memcpy(out + i * stride, packed + i * 16, 16);
+					break;
+				default:
+					for (uint32_t i = 0; i < count; i++) memcpy(out + i * stride, packed + i * size, size);
+			}
+		}
+
+		static void interleaveElement(const geom::MeshView& mesh, const Element& element, VertexBuffer& out) {
+			// octahedral encoding works from the full vector
+			uint32_t components = element.format == FORMAT_OCT16x2 ? 3 : formatComponents(element.format);
+			uint32_t size = formatSize(element.format);
+			uint32_t stride = out.layout.stride;
+			uint8_t* base = out.vertices.data() + element.offset;
+
+			// colours are stored as bytes already
+			if (element.attribute == ATTRIB_COLOR && element.format == FORMAT_UNORM8x4 && mesh.colors) {
+				scatter((const uint8_t*) mesh.colors, 4, out.vertexCount, base, stride);
+				return;
+			}
+
+			float staging[BLOCK_SIZE * 4];
+			uint8_t packed[BLOCK_SIZE * 16];
+			for (uint32_t first = 0; first < out.vertexCount; first += BLOCK_SIZE) {
+				uint32_t count = std::min(BLOCK_SIZE, out.vertexCount - first);
+				uint32_t values = count * components;
+				gatherAttribute(mesh, element, first, count, components, staging);
+
+				switch (element.format) {
+					case FORMAT_FLOAT2:
+					case FORMAT_FLOAT3:
+					case FORMAT_FLOAT4:
+						memcpy(packed, staging, values * sizeof(float));
+						break;
+					case FORMAT_HALF2:
+					case FORMAT_HALF4:
+						encodeHalf(staging, (uint16_t*) packed, values);
+						break;
+					case FORMAT_SNORM16x4:
+						encodeSnorm16(staging, (int16_t*) packed, values);
+						break;
+					case FORMAT_UNORM16x2:
+						encodeUnorm16(staging, (uint16_t*) packed, values);
+						break;
+					case FORMAT_UNORM8x4:
+						encodeUnorm8(staging, packed, values);
+						break;
+					case FORMAT_OCT16x2:
+						encodeOctahedral((const geom::VertexNormal*) staging, (int16_t*) packed, count);
+						break;
+				}
+
+				scatter(packed, size, count, base + first * stride, stride);
+			}
+		}
+
+		// Index buffers
+
+		static bool buildFaceIndices(const geom::MeshView& mesh, bool wide, VertexBuffer& out) {
+			auto& faces = *mesh.faces;
+			out.isStrip = false;
+			out.indexCount = (uint32_t) faces.size() * 3;
+			out.indices.resize(out.indexCount * out.indexSize);
+
+			uint16_t* narrow = (uint16_t*) out.indices.data();
+			uint32_t* wideOut = (uint32_t*) out.indices.data();
+			for (size_t i = 0; i < faces.size(); i++) {
+				auto& face = faces[i];
+				if (face.vertex1 >= mesh.vertexCount || face.vertex2 >= mesh.vertexCount
+					|| face.vertex3 >= mesh.vertexCount) {
+					util::logger.warn("Face %d references a vertex out of range", (int) i);
+					return false;
+				}
+				if (wide) {
+					wideOut[i * 3 + 0] = face.vertex1;
+					wideOut[i * 3 + 1] = face.vertex2;
+					wideOut[i * 3 + 2] = face.vertex3;
+				} else {
+					narrow[i * 3 + 0] = face.vertex1;
+					narrow[i * 3 + 1] = face.vertex2;
+					narrow[i * 3 + 2] = face.vertex3;
+				}
+
+				// one submesh per run of faces sharing a material
+				if (out.submeshes.empty() || out.submeshes.back().material != face.material) {
+					Submesh submesh = {face.material, (uint32_t) i * 3, 0};
+					out.submeshes.push_back(submesh);
+				}
+				out.submeshes.back().indexCount += 3;
+			}
+			return true;
+		}
+
+		static bool buildBinMeshIndices(const geom::MeshView& mesh, bool wide, VertexBuffer& out) {
+			auto binMesh = mesh.binMesh;
+			out.isStrip = binMesh->flags == 1;
+			out.indexCount = 0;
+			for (auto& object : binMesh->objects) {
+				out.indexCount += (uint32_t) object.indices.size();
+			}
+			out.indices.resize(out.indexCount * out.indexSize);
+
+			uint32_t first = 0;
+			for (auto& object : binMesh->objects) {
+				uint32_t count = (uint32_t) object.indices.size();
+				uint32_t maxIndex = object.indices.maxIndex();
+				if (count && maxIndex >= mesh.vertexCount) {
+					util::logger.warn("BinMesh index %d out of range", maxIndex);
+					return false;
+				}
+				if (wide) {
+					object.indices.copyTo((uint32_t*) out.indices.data() + first);
+				} else if (auto narrow = object.indices.data16()) {
+					memcpy(out.indices.data() + first * 2, narrow, count * 2);
+				} else {
+					geom::narrowIndices(object.indices.data32(), (uint16_t*) out.indices.data() + first, count);
+				}
+				Submesh submesh = {object.material, first, count};
+				out.submeshes.push_back(submesh);
+				first += count;
+			}
+			return true;
+		}
+
+		bool buildVertexBuffer(const geom::MeshView& mesh, const Layout& layout, VertexBuffer& out,
+							   IndexSource source, IndexWidth width) {
+			if (!layout.validate()) {
+				return false;
+			}
+
+			out.layout = layout;
+			out.vertexCount = mesh.vertexCount;
+			out.vertices.assign((size_t) layout.stride * mesh.vertexCount, 0);
+			for (auto& element : layout.elements) {
+				interleaveElement(mesh, element, out);
+			}
+
+			if (source == INDICES_AUTO) {
+				source = mesh.binMesh ? INDICES_BINMESH : INDICES_FACES;
+			}
+			if (source == INDICES_BINMESH && !mesh.binMesh) {
+				util::logger.warn("Mesh has no BinMesh to build indices from");
+				return false;
+			}
+
+			bool wide = mesh.vertexCount > 0x10000;
+			if (width == INDEX_32) {
+				wide = true;
+			} else if (width == INDEX_16 && wide) {
+				util::logger.warn("Mesh has %d vertices, using 32-bit indices", mesh.vertexCount);
+			}
+			out.indexSize = wide ? 4 : 2;
+			out.submeshes.clear();
+
+			if (source == INDICES_BINMESH) {
+				return buildBinMeshIndices(mesh, wide, out);
+			}
+			return buildFaceIndices(mesh, wide, out);
+		}
+	}
+}
\ No newline at end of file
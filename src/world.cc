@@ -7,6 +7,8 @@
 
 #include "world.hh"
 
+#include <deque>
+
 namespace rw {
 	void BinMeshPLGChunk::dump(rw::util::DumpWriter out) {
 		out.print("BinMesh PLG:");
@@ -32,6 +34,24 @@ namespace rw {
 		}
 	}
 
+	void BinMeshPLGChunk::dumpJson(util::JsonWriter& out) {
+		out.field("flags", flags);
+		out.field("objectCount", objectCount);
+		out.field("indexCount", indexCount);
+
+		uint32_t cursor = 12;
+		out.beginArray("objects");
+		for (auto& object : objects) {
+			out.beginObject();
+			out.field("material", object.material);
+			out.field("meshIndexCount", object.meshIndexCount);
+			dumpJsonBlob(out, "indices", cursor + 8, object.indices.size() * 4);
+			out.endObject();
+			cursor += 8 + object.indices.size() * 4;
+		}
+		out.endArray();
+	}
+
 	void BinMeshPLGChunk::postReadHook() {
 		data.seek(0);
 
@@ -43,16 +63,37 @@ namespace rw {
 			BinMeshObject object;
 			data.read(&object.meshIndexCount);
 			data.read(&object.material);
+			std::vector<uint32_t> indices;
 			for (int j = 0; j < object.meshIndexCount; j++) {
 				uint32_t index;
 				data.read(&index);
-				object.indices.push_back(index);
+				indices.push_back(index);
 			}
+			object.indices.assign(indices);
 			objects.push_back(object);
 		}
 	}
 
 	void BinMeshPLGChunk::preWriteHook() {
+		objectCount = objects.size();
+		indexCount = 0;
+		for (auto& object : objects) {
+			object.meshIndexCount = object.indices.size();
+			indexCount += object.meshIndexCount;
+		}
+
+		// serialize into a new buffer, as data may be a view of memory shared with others
+		util::Buffer out(12 + objectCount * 8 + indexCount * 4);
+		out.write(flags);
+		out.write(objectCount);
+		out.write(indexCount);
+		for (auto& object : objects) {
+			out.write(object.meshIndexCount);
+			out.write(object.material);
+			object.indices.write(out, 4);
+		}
+		setData(std::move(out));
+
 		StructChunk::preWriteHook();
 	}
 
@@ -109,10 +150,37 @@ namespace rw {
 		}
 	}
 
+	void AtomicSectionChunk::dumpJson(util::JsonWriter& out) {
+		out.field("modelFlags", modelFlags);
+		out.field("faceCount", faceCount);
+		out.field("vertexCount", vertexCount);
+		out.beginArray("bboxMax");
+		for (float v : bboxMax) out.value(v);
+		out.endArray();
+		out.beginArray("bboxMin");
+		for (float v : bboxMin) out.value(v);
+		out.endArray();
+		out.field("unknownA", unknownA);
+		out.field("unknownB", unknownB);
+
+		StructChunk* content = getStruct();
+		if (!content) return;
+
+		uint32_t cursor = 44;
+		content->dumpJsonBlob(out, "vertexPositions", cursor, vertexPositions.size() * sizeof(geom::VertexPosition));
+		cursor += vertexPositions.size() * sizeof(geom::VertexPosition);
+		content->dumpJsonBlob(out, "vertexColors", cursor, vertexColors.size() * sizeof(geom::VertexColor));
+		cursor += vertexColors.size() * sizeof(geom::VertexColor);
+		content->dumpJsonBlob(out, "vertexUVs", cursor, vertexUVs.size() * sizeof(geom::VertexUVs));
+		cursor += vertexUVs.size() * sizeof(geom::VertexUVs);
+		content->dumpJsonBlob(out, "faces", cursor, faces.size() * sizeof(geom::Face));
+	}
+
 	void AtomicSectionChunk::postReadHook() {
 		bool structWasSeen = false;
 		bool binMeshWasSeen = false;
 		binMeshPLG = nullptr;
+		meshletPLG = nullptr;
 		for (auto child : children) {
 			if (child->type == RW_STRUCT) {
 				if (structWasSeen) {
@@ -163,6 +231,8 @@ namespace rw {
 						binMeshWasSeen = true;
 
 						binMeshPLG = (BinMeshPLGChunk*) extension;
+					} else if (extension->type == RW_MESHLET_PLG) {
+						meshletPLG = (MeshletPLGChunk*) extension;
 					} else {
 						util::logger.warn("Unsupported extension in Atomic Section: %s", getChunkName(extension->type));
 					}
@@ -178,6 +248,33 @@ namespace rw {
 	}
 
 	void AtomicSectionChunk::preWriteHook() {
+		faceCount = faces.size();
+		vertexCount = vertexPositions.size();
+
+		uint32_t size = 44 + vertexPositions.size() * sizeof(geom::VertexPosition)
+						+ vertexColors.size() * sizeof(geom::VertexColor)
+						+ vertexUVs.size() * sizeof(geom::VertexUVs) + faces.size() * sizeof(geom::Face);
+
+		// serialize into a new buffer, as the struct may view memory shared with others
+		util::Buffer content(size);
+		content.write(modelFlags);
+		content.write(faceCount);
+		content.write(vertexCount);
+		content.write(bboxMax);
+		content.write(bboxMin);
+		content.write(unknownA);
+		content.write(unknownB);
+		content.write(vertexPositions.data(), vertexPositions.size() * sizeof(geom::VertexPosition));
+		content.write(vertexColors.data(), vertexColors.size() * sizeof(geom::VertexColor));
+		content.write(vertexUVs.data(), vertexUVs.size() * sizeof(geom::VertexUVs));
+		content.write(faces.data(), faces.size() * sizeof(geom::Face));
+
+		StructChunk* structChunk = getStruct();
+		if (structChunk) {
+			structChunk->setData(std::move(content));
+		}
+		invalidateHash();
+
 		ListChunk::preWriteHook();
 	}
 
@@ -185,32 +282,68 @@ namespace rw {
 		return true;
 	}
 
-	void PlaneSectionChunk::dump(util::DumpWriter out) {
+	/// Prints the fields of a plane section, without its children
+	static void dumpPlaneFields(PlaneSectionChunk* plane, util::DumpWriter& out) {
 		out.print("Plane Section:");
-		out.print("  type: %d", type);
-		out.print("  value: %f", value);
-		out.print("  leftIsAtomic: %s", leftIsAtomic ? "yes" : "no");
-		out.print("  rightIsAtomic: %s", leftIsAtomic ? "yes" : "no");
-		out.print("  leftValue: %f", leftValue);
-		out.print("  rightValue: %f", rightValue);
+		out.print("  type: %d", plane->type);
+		out.print("  value: %f", plane->value);
+		out.print("  leftIsAtomic: %s", plane->leftIsAtomic ? "yes" : "no");
+		out.print("  rightIsAtomic: %s", plane->rightIsAtomic ? "yes" : "no");
+		out.print("  leftValue: %f", plane->leftValue);
+		out.print("  rightValue: %f", plane->rightValue);
+	}
 
-		out.print("");
-		if (left)
-			left->dump(out);
-		else
-			out.print("  left: null");
+	void PlaneSectionChunk::dump(util::DumpWriter out) {
+		// plane sections below this one are dumped from an explicit stack rather than through
+		// their own dump, so deep trees do not recurse. Their writers live in a deque, as copying
+		// a writer indents it (just as passing one to dump does).
+		struct Pending {
+			AbstractSectionChunk* section; // (null) for a missing child
+			const char* side;
+			util::DumpWriter* writer; // of the parent
+		};
+		std::deque<util::DumpWriter> writers;
+		std::vector<Pending> stack;
+		auto pushChildren = [&](PlaneSectionChunk* plane, util::DumpWriter* writer) {
+			stack.push_back(Pending{plane->right, "right", writer});
+			stack.push_back(Pending{plane->left, "left", writer});
+		};
+
+		dumpPlaneFields(this, out);
+		pushChildren(this, &out);
+		while (!stack.empty()) {
+			Pending entry = stack.back();
+			stack.pop_back();
+
+			entry.writer->print("");
+			if (!entry.section) {
+				entry.writer->print("  %s: null", entry.side);
+			} else if (entry.section->isAtomic()) {
+				AbstractSectionChunk* section = entry.section;
+				entry.writer->spawn([section](util::DumpWriter& w) { section->dump(w); });
+			} else {
+				writers.emplace_back(*entry.writer);
+				dumpPlaneFields((PlaneSectionChunk*) entry.section, writers.back());
+				pushChildren((PlaneSectionChunk*) entry.section, &writers.back());
+			}
+		}
+	}
 
-		out.print("");
-		if (right)
-			right->dump(out);
-		else
-			out.print("  right: null");
+	void PlaneSectionChunk::dumpJson(util::JsonWriter& out) {
+		out.field("type", type);
+		out.field("value", value);
+		out.field("leftIsAtomic", leftIsAtomic);
+		out.field("rightIsAtomic", rightIsAtomic);
+		out.field("leftValue", leftValue);
+		out.field("rightValue", rightValue);
 	}
 
 	void PlaneSectionChunk::postReadHook() {
 		bool structWasSeen = false;
 		bool leftWasSeen = false;
 		bool rightWasSeen = false;
+		left = nullptr;
+		right = nullptr;
 		for (auto child : children) {
 			if (child->type == RW_STRUCT) {
 				if (structWasSeen) {
@@ -220,10 +353,13 @@ namespace rw {
 				structWasSeen = true;
 
 				util::Buffer& content = ((StructChunk*) child)->getBuffer();
+				// the child flags are stored as u32s
+				uint32_t childIsAtomic[2];
 				content.read(&type);
 				content.read(&value);
-				content.read(&leftIsAtomic);
-				content.read(&rightIsAtomic);
+				content.read(&childIsAtomic);
+				leftIsAtomic = childIsAtomic[0] != 0;
+				rightIsAtomic = childIsAtomic[1] != 0;
 				content.read(&leftValue);
 				content.read(&rightValue);
 			} else if (child->type == RW_ATOMIC_SECTION || child->type == RW_PLANE_SECTION) {
@@ -266,6 +402,21 @@ namespace rw {
 		return false;
 	}
 
+	void visitSections(AbstractSectionChunk* root, const std::function<void(AbstractSectionChunk*, uint32_t)>& fn) {
+		std::vector<std::pair<AbstractSectionChunk*, uint32_t>> stack;
+		if (root) stack.push_back(std::make_pair(root, 0u));
+		while (!stack.empty()) {
+			auto entry = stack.back();
+			stack.pop_back();
+			fn(entry.first, entry.second);
+			if (entry.first->isAtomic()) continue;
+
+			auto plane = (PlaneSectionChunk*) entry.first;
+			if (plane->right) stack.push_back(std::make_pair(plane->right, entry.second + 1));
+			if (plane->left) stack.push_back(std::make_pair(plane->left, entry.second + 1));
+		}
+	}
+
 	void WorldChunk::dump(util::DumpWriter out) {
 		out.print("World:");
 		out.print("  unknown a: {0x%x, 0x%x, 0x%x, 0x%x}", unknownA[0], unknownA[1], unknownA[2], unknownA[3]);
@@ -282,6 +433,23 @@ namespace rw {
 		rootSection->dump(out);
 	}
 
+	void WorldChunk::dumpJson(util::JsonWriter& out) {
+		out.beginArray("unknownA");
+		for (uint32_t v : unknownA) out.value(v);
+		out.endArray();
+		out.field("faceCount", faceCount);
+		out.field("vertexCount", vertexCount);
+		out.beginArray("unknownB");
+		for (uint32_t v : unknownB) out.value(v);
+		out.endArray();
+		out.beginArray("bboxMax");
+		for (float v : bboxMax) out.value(v);
+		out.endArray();
+		out.beginArray("bboxMin");
+		for (float v : bboxMin) out.value(v);
+		out.endArray();
+	}
+
 	void WorldChunk::postReadHook() {
 		bool structWasSeen = false;
 		bool materialListSeen = false;
@@ -334,6 +502,22 @@ namespace rw {
 	}
 
 	void WorldChunk::preWriteHook() {
+		// only the leading fields are decoded, so copy the struct and overwrite those
+		StructChunk* structChunk = getStruct();
+		const unsigned decodedSize = sizeof(unknownA) + 8 + sizeof(unknownB) + sizeof(bboxMax) + sizeof(bboxMin);
+		if (structChunk && structChunk->getBuffer().size() >= decodedSize) {
+			util::Buffer content = structChunk->getBuffer().copy();
+			content.seek(0);
+			content.write(unknownA);
+			content.write(faceCount);
+			content.write(vertexCount);
+			content.write(unknownB);
+			content.write(bboxMax);
+			content.write(bboxMin);
+			structChunk->setData(std::move(content));
+		}
+		invalidateHash();
+
 		ListChunk::preWriteHook();
 	}
 }
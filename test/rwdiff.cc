@@ -0,0 +1,56 @@
+/*
+ * File: rwdiff.cc
+ * Author: DeadlyFugu
+ * License: zlib
+ * Description: Reports structural differences between two RenderWare Binary Stream files
+ */
+
+#include <stdio.h>
+#include "util.hh"
+#include "chunk.hh"
+#include "diff.hh"
+
+int main(int argc, char** argv) {
+	using namespace rw;
+
+	if (argc > 2) {
+		util::Buffer bufferA(0);
+		util::Buffer bufferB(0);
+		if (!util::readFile(argv[1], bufferA) || !util::readFile(argv[2], bufferB)) {
+			return 2;
+		}
+		Chunk* a = readChunk(bufferA);
+		Chunk* b = readChunk(bufferB);
+		if (!a || !b) {
+			delete a;
+			delete b;
+			return 2;
+		}
+
+		std::vector<ChunkDiff> diffs;
+		diffChunks(a, b, diffs);
+
+		util::FileDumpSink sink(stdout);
+		util::DumpWriter out(&sink);
+		for (auto& diff : diffs) {
+			if (diff.kind == ChunkDiff::ADDED) {
+				out.print("+ %s (at 0x%x)", diff.path.c_str(), diff.b->offset);
+			} else if (diff.kind == ChunkDiff::REMOVED) {
+				out.print("- %s (at 0x%x)", diff.path.c_str(), diff.a->offset);
+			} else {
+				out.print("~ %s (at 0x%x -> 0x%x)", diff.path.c_str(), diff.a->offset, diff.b->offset);
+			}
+			for (auto& field : diff.fields) {
+				out.print("    %s", field.c_str());
+			}
+		}
+		sink.flush();
+
+		delete a;
+		delete b;
+		return diffs.empty() ? 0 : 1;
+	} else {
+		printf("usage: rwdiff <a.rws> <b.rws>");
+		return 2;
+	}
+}
\ No newline at end of file
@@ -6,25 +6,54 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include "util.hh"
 #include "chunk.hh"
 
+// keeps log messages out of machine-readable output
+static void stderrLoggerCallback(rw::util::Logger::LogLevel level, const char* str) {
+	static const char* levelNameTable = "INFO\0WARN\0ERR";
+	fprintf(stderr, "[%s] %s\n", &levelNameTable[level*5], str);
+}
+
 int main(int argc, char** argv) {
 	using namespace rw;
 
 	if (argc > 1) {
+		const char* mode = argc > 2 ? argv[2] : "";
+		bool json = !strcmp(mode, "json") || !strcmp(mode, "ndjson");
+		if (json) {
+			util::logger.setPrintCallback(stderrLoggerCallback);
+		}
+
 		util::Buffer b(0);
 		util::readFile(argv[1], b);
 		Chunk* root = readChunk(b); // note: functions like new Chunk(); - i.e. caller must delete pointer
 
-		bool verbose = false;
-		if (argc > 2) {
-			verbose = !strcmp(argv[2], "verbose");
+		util::FileDumpSink sink(stdout);
+
+		if (json) {
+			bool base64 = argc > 3 && !strcmp(argv[3], "base64");
+			util::JsonWriter out(&sink, base64 ? util::JsonWriter::BLOB_BASE64 : util::JsonWriter::BLOB_REFERENCE);
+			if (!strcmp(mode, "json")) {
+				exportJson(root, out);
+			} else {
+				exportNdjson(root, out);
+			}
+		} else {
+			bool verbose = !strcmp(mode, "verbose");
+			unsigned jobs = 0; // 0 uses all hardware threads
+			if (argc > 3) {
+				jobs = (unsigned) atoi(argv[3]);
+			}
+
+			util::DumpScheduler scheduler(jobs);
+			root->dump(util::DumpWriter(&sink, verbose, &scheduler));
+			scheduler.finish();
 		}
-		root->dump(util::DumpWriter(verbose));
 
 		delete root;
 	} else {
-		printf("usage: rwdump <file.rws> [verbose]");
+		printf("usage: rwdump <file.rws> [verbose [jobs] | json [base64] | ndjson [base64]]");
 	}
-}
\ No newline at end of file
+}